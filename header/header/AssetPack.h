@@ -0,0 +1,108 @@
+/*********************************************************************
+ * \file   AssetPack.h
+ * \brief  All the assets of the game in one file, with an index.
+ * Opening hundreds of small files is what dominates the startup on a
+ * cold disk or a network drive. An asset pack holds every model (already
+ * imported, as .mesh files), texture and shader in one file, with the
+ * data of each one aligned, and a table of contents sorted by the hash
+ * of the path. The game maps the pack once and every open() afterwards
+ * is a binary search returning a view into the mapping.
+ *
+ * Layout:  PackHeader | file data... | PackEntry[entryCount] | paths
+ *********************************************************************/
+#pragma once
+
+#include <FileSystem.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FileSystem {
+
+    /// <summary>
+    /// Header at the start of a pack.
+    /// </summary>
+    struct PackHeader {
+        char magic[4];          ///< "SSPK"
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;     ///< Alignment of the data of every file, in bytes.
+        uint64_t tocOffset;     ///< Offset of the PackEntry table.
+        uint64_t pathsOffset;   ///< Offset of the path strings.
+    };
+
+    /// <summary>
+    /// One file in the table of contents. The table is sorted by hash.
+    /// </summary>
+    struct PackEntry {
+        uint64_t hash;          ///< hashPath() of the normalized path.
+        uint64_t offset;        ///< Offset of the data from the start of the pack.
+        uint64_t size;          ///< Size of the data in bytes.
+        uint32_t pathOffset;    ///< Offset of the path from pathsOffset, to resolve hash collisions.
+        uint32_t pathLength;
+    };
+
+    /// <summary>
+    /// The 64-bit FNV-1a hash of a normalized path.
+    /// </summary>
+    uint64_t hashPath(const std::string& path);
+
+    /// <summary>
+    /// \class AssetPack
+    /// A pack mounted in the Vfs. The whole file is mapped once, and the views it
+    /// returns point straight into the mapping.
+    /// </summary>
+    class AssetPack : public Mount {
+     public:
+        /// <summary>
+        /// Maps the pack. Check isValid() to find out if it succeeded.
+        /// </summary>
+        explicit AssetPack(const std::string& path);
+
+        FileView open(const std::string& path) override;
+
+        bool isValid() const { return m_entries != nullptr; }
+        uint32_t getEntryCount() const { return m_entryCount; }
+
+     private:
+        std::shared_ptr<MappedFile> m_file;      ///< The mapped pack. The views share it.
+        const PackEntry* m_entries = nullptr;    ///< The table of contents, inside the mapping.
+        const char* m_paths = nullptr;           ///< The path strings, inside the mapping.
+        uint32_t m_entryCount = 0;
+    };
+
+    /// <summary>
+    /// \class AssetPackWriter
+    /// Writes a pack. The data of every file is streamed to disk as it is added,
+    /// and finish() appends the table of contents.
+    /// </summary>
+    class AssetPackWriter {
+     public:
+        /// <param name="path">The pack to create.</param>
+        /// <param name="alignment">Alignment of the data of every file. A power of two.</param>
+        explicit AssetPackWriter(const std::string& path, uint32_t alignment = 64);
+
+        /// <summary>
+        /// Adds a file. Adding the same path twice keeps the last one.
+        /// </summary>
+        /// <param name="path">The path the game will open the file with.</param>
+        bool add(const std::string& path, const char* data, size_t size);
+
+        /// <summary>
+        /// Writes the table of contents and the header. The pack is not usable before that.
+        /// </summary>
+        bool finish();
+
+     private:
+        void pad(uint64_t alignment);
+
+        std::ofstream m_out;
+        uint32_t m_alignment;
+        uint64_t m_position = 0;
+        std::vector<PackEntry> m_entries;
+        std::string m_paths;
+    };
+}
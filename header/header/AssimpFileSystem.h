@@ -0,0 +1,101 @@
+/*********************************************************************
+ * \file   AssimpFileSystem.h
+ * \brief  Lets Assimp read the model files through FileSystem::Vfs.
+ * Importer::ReadFileFromMemory() only sees one buffer, so a model made
+ * of several files (an .obj and its .mtl) could not find the rest of
+ * its files. Instead, the importer gets an IOSystem whose streams read
+ * straight from the memory-mapped views of the Vfs.
+ *********************************************************************/
+#pragma once
+
+#include <IOStream.hpp>
+#include <IOSystem.hpp>
+#include <FileSystem.h>
+
+#include <cstring>
+#include <string>
+
+namespace FileSystem {
+
+    /// <summary>
+    /// \class AssimpStream
+    /// A read-only Assimp stream over a FileView.
+    /// </summary>
+    class AssimpStream : public Assimp::IOStream {
+     public:
+        explicit AssimpStream(FileView view) : m_view(view) {}
+
+        size_t Read(void* buffer, size_t size, size_t count) override {
+            if (size == 0 || count == 0)
+                return 0;
+            size_t available = (m_view.size() - m_position) / size;
+            if (count > available)
+                count = available;
+            std::memcpy(buffer, m_view.data() + m_position, size * count);
+            m_position += size * count;
+            return count;
+        }
+
+        size_t Write(const void*, size_t, size_t) override {
+            return 0;
+        }
+
+        aiReturn Seek(size_t offset, aiOrigin origin) override {
+            size_t target;
+            if (origin == aiOrigin_SET)
+                target = offset;
+            else if (origin == aiOrigin_CUR)
+                target = m_position + offset;
+            else
+                target = m_view.size() - offset;
+            if (target > m_view.size())
+                return aiReturn_FAILURE;
+            m_position = target;
+            return aiReturn_SUCCESS;
+        }
+
+        size_t Tell() const override {
+            return m_position;
+        }
+
+        size_t FileSize() const override {
+            return m_view.size();
+        }
+
+        void Flush() override {}
+
+     private:
+        FileView m_view;
+        size_t m_position = 0;
+    };
+
+    /// <summary>
+    /// \class AssimpIOSystem
+    /// Opens the files Assimp asks for through the Vfs. Give it to Importer::SetIOHandler(),
+    /// which takes ownership of it.
+    /// </summary>
+    class AssimpIOSystem : public Assimp::IOSystem {
+     public:
+        bool Exists(const char* path) const override {
+            return static_cast<bool>(vfs().open(path));
+        }
+
+        char getOsSeparator() const override {
+            return '/';
+        }
+
+        Assimp::IOStream* Open(const char* path, const char* mode = "rb") override {
+            // the assets are read-only
+            if (std::strchr(mode, 'w') != nullptr || std::strchr(mode, 'a') != nullptr)
+                return nullptr;
+            FileView view = vfs().open(path);
+            if (!view)
+                return nullptr;
+            return new AssimpStream(view);
+        }
+
+        void Close(Assimp::IOStream* stream) override {
+            delete stream;
+        }
+    };
+}
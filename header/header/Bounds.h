@@ -0,0 +1,62 @@
+/*********************************************************************
+ * \file   Bounds.h
+ * \brief  Bounding volumes, used to skip objects that cannot be seen.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <algorithm>
+#include <limits>
+
+/// <summary>
+/// A sphere around an object.
+/// </summary>
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    /// <summary>
+    /// Returns the sphere around the object after it is transformed by a model matrix.
+    /// The radius grows with the largest scale of the matrix.
+    /// </summary>
+    BoundingSphere transformed(const glm::mat4& model) const {
+        BoundingSphere sphere;
+        sphere.center = glm::vec3(model * glm::vec4(center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        sphere.radius = radius * scale;
+        return sphere;
+    }
+};
+
+/// <summary>
+/// An axis-aligned box, grown point by point.
+/// </summary>
+struct BoundingBox {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void add(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const BoundingBox& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    /// <summary>
+    /// Returns the sphere around the box.
+    /// </summary>
+    BoundingSphere sphere() const {
+        BoundingSphere sphere;
+        if (isEmpty())
+            return sphere;
+        sphere.center = (min + max) * 0.5f;
+        sphere.radius = glm::length(max - min) * 0.5f;
+        return sphere;
+    }
+};
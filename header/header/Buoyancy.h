@@ -0,0 +1,71 @@
+/*********************************************************************
+ * \file   Buoyancy.h
+ * \brief  How a hull sits on the waves.
+ * The water is sampled under the bow, the stern and both sides of the
+ * hull: their mean is the heave, and their differences tilt the hull
+ * (pitch and roll). The four points of many hulls are meant to go to
+ * one Waves::sample() call, which does them four at a time.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <cmath>
+
+/// <summary>
+/// How far the hull lifts and tilts on the waves.
+/// </summary>
+struct HullPose {
+    float heave = 0.0f;  ///< Lift above the flat sea.
+    float pitch = 0.0f;  ///< Rotation around the hull's x-axis, in radians. Positive lowers the bow.
+    float roll = 0.0f;   ///< Rotation around the hull's z-axis, in radians. Positive lowers the -x side.
+};
+
+/// <summary>
+/// \class Buoyancy
+/// The sample points and the response of one hull shape.
+/// </summary>
+class Buoyancy {
+ public:
+    /// <summary>
+    /// The number of points sampled under a hull.
+    /// </summary>
+    static const int POINTS = 4;
+
+    /// <param name="halfLength">Half the length of the hull, from the center to the bow.</param>
+    /// <param name="halfBeam">Half the width of the hull.</param>
+    Buoyancy(float halfLength, float halfBeam) : m_halfLength(halfLength), m_halfBeam(halfBeam) {}
+
+    /// <summary>
+    /// Writes the bow, the stern, the +x side and the -x side of a hull.
+    /// </summary>
+    /// <param name="position">Where the hull is on the xz plane.</param>
+    /// <param name="angle">The heading, in degrees around the y-axis. The bow points along +z at 0.</param>
+    void samplePoints(const glm::vec2& position, float angle, float* x, float* z) const {
+        float s = std::sin(glm::radians(angle));
+        float c = std::cos(glm::radians(angle));
+        x[0] = position.x + s * m_halfLength; z[0] = position.y + c * m_halfLength;
+        x[1] = position.x - s * m_halfLength; z[1] = position.y - c * m_halfLength;
+        x[2] = position.x + c * m_halfBeam;   z[2] = position.y - s * m_halfBeam;
+        x[3] = position.x - c * m_halfBeam;   z[3] = position.y + s * m_halfBeam;
+    }
+
+    /// <summary>
+    /// Moves a pose towards the one the heights of the sample points ask for. The hull
+    /// follows with some delay, as it would not follow every ripple.
+    /// </summary>
+    void settle(const float* heights, float deltaTime, HullPose& pose) const {
+        float heave = 0.25f * (heights[0] + heights[1] + heights[2] + heights[3]);
+        float pitch = -std::atan((heights[0] - heights[1]) / (2.0f * m_halfLength));
+        float roll = std::atan((heights[2] - heights[3]) / (2.0f * m_halfBeam));
+
+        float follow = 1.0f - std::exp(-4.0f * deltaTime);
+        pose.heave += (heave - pose.heave) * follow;
+        pose.pitch += (pitch - pose.pitch) * follow;
+        pose.roll += (roll - pose.roll) * follow;
+    }
+
+ private:
+    float m_halfLength;
+    float m_halfBeam;
+};
@@ -103,13 +103,11 @@ namespace Camera
                     MovementSpeed = 1.0f;
             }
 
-            float velocity = MovementSpeed * deltaTime;
-            
-            if (direction == Camera_Movement::FORWARD) {
-                Position += Front * velocity;
-            }
-            if (direction == Camera_Movement::BACKWARD) {
-                Position -= Front * velocity;
+            // the ship may have been stopped by an island, so the camera keeps its place
+            // behind the ship instead of moving by itself
+            if (direction == Camera_Movement::FORWARD || direction == Camera_Movement::BACKWARD) {
+                Position.x = ship.getPosition().x + glm::sin(glm::radians(m_shipAngle)) * m_shipDistance;
+                Position.z = ship.getPosition().z + glm::cos(glm::radians(m_shipAngle)) * m_shipDistance;
             }
             if (direction == Camera_Movement::LEFT) {
                 m_shipAngle += 0.5f;
@@ -0,0 +1,141 @@
+/*********************************************************************
+ * \file   CascadedShadowMap.h
+ * \brief  Shadows of the directional light, with cascaded shadow maps.
+ * One shadow map over the whole view wastes most of its texels far
+ * away and leaves too few near the camera. The view frustum is split
+ * along its depth into a few slices (cascades), and every slice gets
+ * its own layer of a depth texture array, fitted around it.
+ * Each cascade is fitted with a sphere, so its size does not change as
+ * the camera turns, and its position is snapped to whole texels, so
+ * the shadow edges do not shimmer as the camera moves.
+ * The casters are drawn with a depth-only shader from the position-only
+ * VAO of their GeometryArena, and only into the cascades they touch.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <Bounds.h>
+#include <FrameUniforms.h>
+#include <Settings.h>
+#include <Shader.h>
+#include <StreamBuffer.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+/// <summary>
+/// The cost/quality knobs of the shadows, read from the settings file.
+/// </summary>
+struct ShadowSettings {
+    bool enabled = true;
+    int cascadeCount = 3;        ///< 1 to CascadedShadowMap::MAX_CASCADES.
+    int resolution = 2048;       ///< Width and height of every cascade, in texels.
+    float distance = 40.0f;      ///< How far from the camera the shadows reach.
+    float splitLambda = 0.75f;   ///< 0 for evenly spaced cascades, 1 for logarithmic ones.
+    float bias = 0.002f;         ///< Depth bias against shadow acne, in shadow map depth units.
+
+    /// <summary>
+    /// Reads the "shadow.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static ShadowSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class CascadedShadowMap
+/// Every frame: update() fits the cascades to the camera, render() draws the casters
+/// into them, and setUniforms() and bindTexture() hand them to the lit shaders.
+/// </summary>
+class CascadedShadowMap {
+ public:
+    /// <summary>
+    /// The maximum number of cascades. It must match the size of lightSpace in the Frame block.
+    /// </summary>
+    static const int MAX_CASCADES = 4;
+
+    /// <param name="stream">The stream the model matrices of the casters are written into.</param>
+    CascadedShadowMap(const ShadowSettings& settings, StreamBuffer& stream);
+    ~CascadedShadowMap();
+
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    /// <summary>
+    /// Splits the view frustum and fits a cascade around every slice.
+    /// </summary>
+    /// <param name="view">The view matrix of the camera.</param>
+    /// <param name="fovY">The vertical field of view, in radians.</param>
+    /// <param name="aspect">Width over height of the viewport.</param>
+    /// <param name="nearPlane">The near plane of the camera.</param>
+    /// <param name="lightDirection">The direction the light travels in.</param>
+    void update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection);
+
+    /// <summary>
+    /// Renders all the cascades. drawCasters is called once per cascade, with the depth
+    /// shader in use, and draws the casters that isVisible() for that cascade.
+    /// The framebuffer and viewport are restored afterwards.
+    /// </summary>
+    void render(const std::function<void(int cascade)>& drawCasters);
+
+    /// <summary>
+    /// The same, for a lambda, wrapped by reference so no std::function is allocated every frame.
+    /// </summary>
+    template <typename DrawCasters>
+    void render(const DrawCasters& drawCasters) {
+        render(std::function<void(int)>(std::cref(drawCasters)));
+    }
+
+    /// <summary>
+    /// Returns true if an object may cast a shadow into a cascade. Objects between the light
+    /// and the cascade are kept, since their shadows fall into it.
+    /// </summary>
+    bool isVisible(int cascade, const BoundingSphere& sphere) const;
+
+    /// <summary>
+    /// Switches to the depth shader and writes the model matrix of the next caster.
+    /// </summary>
+    void setModel(const glm::mat4& model);
+
+    /// <summary>
+    /// Switches to the instanced depth shader, for casters drawn with Model::DrawDepthInstanced().
+    /// The next setModel() switches back.
+    /// </summary>
+    void useInstanced();
+
+    /// <summary>
+    /// Fills the shadow part of the Frame block: the light-space matrices, the splits and the bias.
+    /// </summary>
+    void setUniforms(FrameUniforms& frame) const;
+
+    /// <summary>
+    /// Binds the depth texture array to a texture unit.
+    /// </summary>
+    void bindTexture(unsigned int unit) const;
+
+    int getCascadeCount() const { return m_settings.cascadeCount; }
+    const ShadowSettings& getSettings() const { return m_settings; }
+
+ private:
+    /// <summary>
+    /// One cascade: where it is in light space and how it projects.
+    /// </summary>
+    struct Cascade {
+        glm::mat4 lightSpace = glm::mat4(1.0f); ///< Projection times light view.
+        glm::vec3 center = glm::vec3(0.0f);     ///< Center of the cascade, in light view space.
+        float radius = 0.0f;                    ///< Half the size of the cascade.
+        float splitFar = 0.0f;                  ///< View-space depth where the cascade ends.
+    };
+
+    ShadowSettings m_settings;
+    Cascade m_cascades[MAX_CASCADES];
+    glm::mat4 m_lightView = glm::mat4(1.0f);    ///< Rotation into light space, shared by all cascades.
+    unsigned int m_depthArray = 0;              ///< GL_TEXTURE_2D_ARRAY, one layer per cascade.
+    unsigned int m_FBO = 0;
+    std::unique_ptr<Shader> m_depthShader;
+    std::unique_ptr<Shader> m_instancedShader;  ///< The depth shader with the INSTANCED define.
+    GLint m_lightSpaceLocation = -1;
+    GLint m_instancedLightSpaceLocation = -1;
+    ObjectUniformBuffer m_objects;              ///< The Object block of the depth shader.
+};
@@ -0,0 +1,173 @@
+/*********************************************************************
+ * \file   Collision.h
+ * \brief  Keeps the ships out of the islands.
+ * Every island model is turned into a heightfield once, when it is
+ * loaded: a grid over the model seen from above, holding the highest
+ * point of the model in every cell. Testing a hull against it is a few
+ * lookups, whatever the number of triangles of the model.
+ * The islands are placed in a CollisionWorld, which hashes their boxes
+ * into a uniform grid on the xz plane (the broad phase): a query only
+ * looks at the islands in the cells it passes through, so its cost does
+ * not grow with the number of islands. The hull is then swept along
+ * its move against the heightfields found (the narrow phase), in steps
+ * shorter than a heightfield cell, so a fast ship cannot jump over the
+ * shore in one frame.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <Model.h>
+#include <Settings.h>
+
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// The collision settings, read from the settings file.
+/// </summary>
+struct CollisionSettings {
+    float cellSize = 4.0f;   ///< The size of a cell of the broad phase grid.
+    int resolution = 64;     ///< The cells of a heightfield along each side.
+    float draft = 0.05f;     ///< Ground higher than this below the sea stops a ship.
+
+    /// <summary>
+    /// Reads the "collision.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static CollisionSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class Heightfield
+/// The highest point of a model over every cell of a grid on its xz plane, in model space.
+/// </summary>
+class Heightfield {
+ public:
+    /// <summary>
+    /// Rasterizes the triangles of the model into the grid. The model keeps its vertices
+    /// on the CPU, so this needs no OpenGL.
+    /// </summary>
+    /// <param name="model">The model, loaded.</param>
+    /// <param name="resolution">The cells along the longer side of the model.</param>
+    Heightfield(const Model& model, int resolution);
+
+    /// <summary>
+    /// The same, from a model that was only imported, so it can be built away from the
+    /// main thread (see WorldStreamer.h).
+    /// </summary>
+    Heightfield(const ModelData& model, int resolution);
+
+    /// <summary>
+    /// Returns the height of the model over a point, or a very low value outside of it.
+    /// </summary>
+    float height(float x, float z) const;
+
+    /// <summary>
+    /// Returns the direction the ground slopes down, on the xz plane, at a point: the way out.
+    /// </summary>
+    glm::vec2 downhill(float x, float z) const;
+
+    /// <summary>
+    /// Returns the memory the heights take.
+    /// </summary>
+    size_t getByteSize() const { return m_heights.size() * sizeof(float); }
+
+    const glm::vec3& getMin() const { return m_min; }
+    const glm::vec3& getMax() const { return m_max; }
+    float getCellSize() const { return m_cellSize; }
+
+ private:
+    template <typename Meshes>
+    void build(const Meshes& meshes, int resolution);
+    void rasterize(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+    float cell(int x, int z) const;
+
+    glm::vec3 m_min = glm::vec3(0.0f);
+    glm::vec3 m_max = glm::vec3(0.0f);
+    float m_cellSize = 1.0f;
+    int m_width = 0;
+    int m_depth = 0;
+    std::vector<float> m_heights;  ///< Row by row along z, m_width cells per row.
+};
+
+/// <summary>
+/// Where a swept hull stopped.
+/// </summary>
+struct SweepResult {
+    bool hit = false;
+    float fraction = 1.0f;               ///< How much of the move can be made, from 0 to 1.
+    glm::vec2 position = glm::vec2(0.0f); ///< Where the hull ends up, on the xz plane.
+    glm::vec2 normal = glm::vec2(0.0f);   ///< The way out of the ground it hit.
+};
+
+/// <summary>
+/// \class CollisionWorld
+/// The islands, in a grid, for the ships to be swept against.
+/// Add the islands, call build(), then sweep(). Islands may be added and removed later
+/// (as the world streams in and out), with another build() after the changes.
+/// </summary>
+class CollisionWorld {
+ public:
+    explicit CollisionWorld(const CollisionSettings& settings = CollisionSettings()) : m_settings(settings) {}
+
+    /// <summary>
+    /// Adds an island. The model matrix may translate, scale and turn the island around
+    /// the y-axis; the heightfield is not valid for any other rotation.
+    /// </summary>
+    /// <param name="heightfield">The heightfield of its model, shared by the islands using it.</param>
+    /// <param name="model">Its model matrix.</param>
+    /// <returns>The handle to remove it with.</returns>
+    unsigned int add(std::shared_ptr<const Heightfield> heightfield, const glm::mat4& model);
+
+    /// <summary>
+    /// Removes an island. Its handle may be given to a later island.
+    /// </summary>
+    void remove(unsigned int handle);
+
+    /// <summary>
+    /// Hashes the boxes of the islands into the grid. Call it after the last add() or remove().
+    /// </summary>
+    void build();
+
+    /// <summary>
+    /// Moves a round hull from one point to another on the xz plane, and stops it
+    /// before the first ground it would hit.
+    /// </summary>
+    /// <param name="from">Where the hull is. The islands it already touches there do not stop it.</param>
+    /// <param name="to">Where it wants to go.</param>
+    /// <param name="radius">The radius of the hull.</param>
+    SweepResult sweep(const glm::vec2& from, const glm::vec2& to, float radius) const;
+
+    /// <summary>
+    /// Returns true if a round hull at a point touches ground.
+    /// </summary>
+    bool overlaps(const glm::vec2& center, float radius) const;
+
+    size_t getColliderCount() const { return m_colliders.size() - m_freeHandles.size(); }
+
+ private:
+    /// <summary>
+    /// An island: a heightfield, where it is and its box on the xz plane.
+    /// </summary>
+    struct Collider {
+        std::shared_ptr<const Heightfield> heightfield;
+        glm::mat4 model;
+        glm::mat4 inverse;
+        glm::vec2 min;
+        glm::vec2 max;
+        bool active = true;
+    };
+
+    void gather(const glm::vec2& min, const glm::vec2& max, std::vector<unsigned int>& found) const;
+    bool touches(const Collider& collider, const glm::vec2& center, float radius, glm::vec2* normal) const;
+    unsigned int hashCell(int x, int z) const;
+
+    CollisionSettings m_settings;
+    std::vector<Collider> m_colliders;
+    std::vector<unsigned int> m_freeHandles;  ///< The removed colliders, to be reused.
+
+    // the grid: the colliders of every bucket, one after the other
+    std::vector<unsigned int> m_bucketStart;  ///< First entry of every bucket, and the end of the last one.
+    std::vector<unsigned int> m_entries;
+    unsigned int m_bucketMask = 0;
+};
@@ -0,0 +1,120 @@
+/*********************************************************************
+ * \file   Components.h
+ * \brief  The components the objects of the game are made of.
+ * An object is an entity of the Registry (see Ecs.h) with some of
+ * these components; the systems in Systems.h give them their behavior:
+ * - the player's ship: Transform, Renderable and PointLight (its
+ *   lantern), moved by the GameObject::Ship controller;
+ * - a seagull: Transform, Renderable and Follower, moved by its flock;
+ * - a bug: Transform, Renderable, Orbit and Parent, circling its
+ *   seagull;
+ * - an island: Transform, Static and PointLight (its harbour light),
+ *   placed once (see WorldStreamer.h).
+ * The components are plain data, as the registry requires.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+#include <matrix_transform.hpp>
+
+#include <Bounds.h>
+#include <Ecs.h>
+#include <Flock.h>
+
+/// <summary>
+/// Where an entity is, and how it is turned and scaled: in the world, or in the space of its
+/// parent if it has a Parent. Whatever changes these sets dirty, and the TransformHierarchy
+/// (see Systems.h) computes the model matrix again, and the ones of the children.
+/// </summary>
+struct Transform {
+    glm::vec3 position = glm::vec3(0.0f);
+    float yaw = 0.0f;             ///< The angle around the y-axis, in degrees.
+    float pitch = 0.0f;           ///< The angle around the x-axis, in radians.
+    float roll = 0.0f;            ///< The angle around the z-axis, in radians.
+    float scale = 1.0f;
+    glm::mat4 matrix = glm::mat4(1.0f); ///< The model matrix, in the world.
+    bool dirty = true;            ///< The above changed since the matrix was computed.
+
+    /// <summary>
+    /// Returns the matrix of the transform on its own, in the space of the parent.
+    /// </summary>
+    glm::mat4 local() const {
+        glm::mat4 local = glm::translate(glm::mat4(1.0f), position);
+        local = glm::rotate(local, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        if (pitch != 0.0f)
+            local = glm::rotate(local, pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+        if (roll != 0.0f)
+            local = glm::rotate(local, roll, glm::vec3(0.0f, 0.0f, 1.0f));
+        return glm::scale(local, glm::vec3(scale, scale, scale));
+    }
+
+    /// <summary>
+    /// Computes the model matrix of an entity without a parent.
+    /// </summary>
+    void update() {
+        matrix = local();
+        dirty = false;
+    }
+};
+
+/// <summary>
+/// An entity placed in the space of another one, which moves it along. The parent must have
+/// a Transform and must not be Static.
+/// </summary>
+struct Parent {
+    Ecs::Entity entity;
+};
+
+/// <summary>
+/// An entity drawn with a model of the RenderSystem.
+/// </summary>
+struct Renderable {
+    unsigned int model = 0;       ///< The index of the model in the RenderSystem.
+    bool castsShadow = true;      ///< False for the objects too small to show up in the shadows.
+};
+
+/// <summary>
+/// An entity moved by a bird of a flock.
+/// </summary>
+struct Follower {
+    const Flock* flock = nullptr;
+    unsigned int bird = 0;
+};
+
+/// <summary>
+/// An entity circling the origin of its space: its parent, if it has one.
+/// </summary>
+struct Orbit {
+    float radius = 0.2f;          ///< In the space of the parent.
+    float angle = 0.0f;           ///< Where on the circle it is, in radians.
+    float speed = 0.6f;           ///< In radians per second.
+};
+
+/// <summary>
+/// A point light carried by an entity (see LightClusters.h).
+/// </summary>
+struct PointLight {
+    glm::vec3 offset = glm::vec3(0.0f);  ///< Where the light is, in the space of the model.
+    float radius = 4.0f;                 ///< How far it reaches, in the world.
+    glm::vec3 color = glm::vec3(1.0f);   ///< Its color, times its intensity.
+};
+
+/// <summary>
+/// Returns the lantern of a ship, above the middle of its model.
+/// </summary>
+inline PointLight shipLantern(const BoundingSphere& bounds) {
+    return { bounds.center + glm::vec3(0.0f, bounds.radius * 0.5f, 0.0f), 3.0f, glm::vec3(1.0f, 0.7f, 0.35f) * 2.0f };
+}
+
+/// <summary>
+/// Returns the harbour light of an island, near the top of its model.
+/// </summary>
+inline PointLight harbourLight(const BoundingSphere& bounds) {
+    return { bounds.center + glm::vec3(0.0f, bounds.radius * 0.8f, 0.0f), 10.0f, glm::vec3(1.0f, 0.85f, 0.6f) * 4.0f };
+}
+
+/// <summary>
+/// A tag for the entities that never move. Their model matrix is computed when they are
+/// created, and the per-frame systems skip them. They have no parent.
+/// </summary>
+struct Static {};
@@ -0,0 +1,105 @@
+/*********************************************************************
+ * \file   DynamicResolution.h
+ * \brief  Renders at the resolution the GPU can afford this frame.
+ * The cost of a frame grows with the fleet and with the islands in
+ * view, and past the budget of the GPU the frame rate drops. Here the
+ * scene is rendered into an offscreen framebuffer instead of the
+ * window, into a part of it scaled down from the size of the window,
+ * and blitted up to the window at the end, filtered.
+ * The time the GPU takes for every frame is measured with timer
+ * queries, read a few frames later so the CPU never waits for them.
+ * The scale moves towards the one whose area would fit the target
+ * budget: down quickly, when the frames get slower, and back up slowly,
+ * so it does not swing back and forth. The framebuffer has the size of
+ * the window, so a new scale only moves the viewport and never
+ * reallocates anything.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+
+#include <Settings.h>
+
+/// <summary>
+/// The budget of the GPU and the range of the scale, read from the settings file.
+/// </summary>
+struct ResolutionSettings {
+    bool enabled = true;
+    float targetMs = 14.0f;       ///< The time the GPU may take for a frame.
+    float minScale = 0.5f;        ///< The smallest scale of the width and the height.
+    float maxScale = 1.0f;        ///< The largest, 1 for the resolution of the window.
+
+    /// <summary>
+    /// Reads the "resolution.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static ResolutionSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class DynamicResolution
+/// Every frame: resize() with the size of the window, begin() before the first pass of the
+/// frame, then end() after the last one, which blits the frame to the window.
+/// </summary>
+class DynamicResolution {
+ public:
+    explicit DynamicResolution(const ResolutionSettings& settings);
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    /// <summary>
+    /// Sets the size of the window the frames are blitted to. A new size reallocates the
+    /// framebuffer.
+    /// </summary>
+    void resize(int width, int height);
+
+    /// <summary>
+    /// Picks the scale of the frame from the GPU times measured so far, binds the framebuffer
+    /// with the viewport of the scaled frame, and starts timing the GPU.
+    /// </summary>
+    void begin();
+
+    /// <summary>
+    /// Stops timing the GPU and blits the frame up to the window.
+    /// </summary>
+    void end();
+
+    /// <summary>
+    /// Returns the size the frame is rendered at, e.g. for the light clusters.
+    /// </summary>
+    int getRenderWidth() const { return m_renderWidth; }
+    int getRenderHeight() const { return m_renderHeight; }
+
+    float getScale() const { return m_scale; }
+
+    /// <summary>
+    /// Returns the time the GPU took for a frame, smoothed over the last few.
+    /// </summary>
+    float getGpuMs() const { return m_gpuMs; }
+
+ private:
+    /// <summary>
+    /// The timer queries in flight. The GPU is a few frames behind at most.
+    /// </summary>
+    static const int QUERIES = 4;
+
+    void collectQueries();
+    void adapt(float frameMs);
+
+    ResolutionSettings m_settings;
+    unsigned int m_FBO = 0;
+    unsigned int m_colorBuffer = 0;
+    unsigned int m_depthBuffer = 0;
+    int m_width = 0;                      ///< The size of the window and of the framebuffer.
+    int m_height = 0;
+    int m_renderWidth = 0;                ///< The part of it the frame is rendered into.
+    int m_renderHeight = 0;
+    float m_scale = 1.0f;
+    float m_gpuMs = 0.0f;
+
+    unsigned int m_queries[QUERIES] = {};
+    int m_firstQuery = 0;                 ///< The oldest query in flight.
+    int m_pendingQueries = 0;
+    bool m_timing = false;                ///< Whether the frame between begin() and end() is timed.
+};
@@ -0,0 +1,298 @@
+/*********************************************************************
+ * \file   Ecs.h
+ * \brief  Entities made of components, stored by archetype in chunks.
+ * An entity is only a handle. What it is comes from the components it
+ * has (see Components.h): a seagull is a Transform, a Renderable and a
+ * Follower, and a new kind of object is a new mix of components, not a
+ * new class. The entities with the same set of components (the same
+ * archetype) are stored together, in chunks of a fixed size, with one
+ * array per component in every chunk. A system asks for the entities
+ * with some components and walks those arrays in order, so the memory
+ * it reads is contiguous, and the chunks can be split across the cores
+ * (see Parallel.h).
+ * The chunks come from a BlockPool (see Memory.h), so creating and
+ * destroying entities reuses the chunks emptied before.
+ * The components must be plain data: they are moved with memcpy when
+ * an entity changes archetype or another entity fills its place.
+ *********************************************************************/
+#pragma once
+
+#include <Memory.h>
+#include <Parallel.h>
+
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace Ecs {
+
+    /// <summary>
+    /// A set of components, one bit per component type.
+    /// </summary>
+    using Mask = unsigned int;
+
+    /// <summary>
+    /// The most component types there can be, the bits of a Mask.
+    /// </summary>
+    const unsigned int MAX_COMPONENTS = 32;
+
+    /// <summary>
+    /// The handle of an entity. It stays invalid once the entity is destroyed, even when
+    /// the index is given to a new entity, since the generation differs.
+    /// </summary>
+    struct Entity {
+        static const unsigned int INVALID = 0xffffffffu;
+
+        unsigned int index = INVALID;
+        unsigned int generation = 0;
+
+        bool isValid() const { return index != INVALID; }
+        bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const Entity& other) const { return !(*this == other); }
+    };
+
+    namespace detail {
+        /// <summary>
+        /// Gives the next component type its id, and remembers its size.
+        /// </summary>
+        unsigned int registerComponent(size_t size);
+
+        /// <summary>
+        /// Returns the size of a component type.
+        /// </summary>
+        size_t componentSize(unsigned int id);
+    }
+
+    /// <summary>
+    /// Returns the id of a component type. The ids are given on first use.
+    /// </summary>
+    template <typename T>
+    unsigned int componentId() {
+        static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+        static const unsigned int id = detail::registerComponent(sizeof(T));
+        return id;
+    }
+
+    /// <summary>
+    /// Returns the mask of some component types.
+    /// </summary>
+    template <typename... Ts>
+    Mask maskOf() {
+        return (Mask(0) | ... | (Mask(1) << componentId<Ts>()));
+    }
+
+    /// <summary>
+    /// \class Registry
+    /// The entities and their components. Entities may be created and destroyed, and gain
+    /// and lose components, except while the registry is being iterated.
+    /// </summary>
+    class Registry {
+     public:
+        /// <summary>
+        /// The size of a chunk. Each chunk holds as many entities of its archetype as fit.
+        /// </summary>
+        static const size_t CHUNK_BYTES = 16 * 1024;
+
+        Registry() : m_chunkPool(CHUNK_BYTES) {}
+        Registry(const Registry&) = delete;
+        Registry& operator=(const Registry&) = delete;
+
+        /// <summary>
+        /// Creates an entity with some components.
+        /// </summary>
+        template <typename... Ts>
+        Entity create(const Ts&... components) {
+            Entity entity = allocate();
+            Archetype& archetype = archetypeFor(maskOf<Ts...>());
+            Location location = insert(archetype, entity);
+            (write(location, componentId<Ts>(), &components), ...);
+            return entity;
+        }
+
+        /// <summary>
+        /// Destroys an entity. Does nothing if it is no longer alive.
+        /// </summary>
+        void destroy(Entity entity);
+
+        /// <summary>
+        /// Returns true if the entity has not been destroyed.
+        /// </summary>
+        bool isAlive(Entity entity) const {
+            return entity.index < m_generations.size() && m_generations[entity.index] == entity.generation && m_locations[entity.index].archetype != NO_ARCHETYPE;
+        }
+
+        /// <summary>
+        /// Adds a component to an entity, or overwrites it if the entity already has one.
+        /// The entity moves to the archetype with the component.
+        /// </summary>
+        template <typename T>
+        void add(Entity entity, const T& component) {
+            if (!isAlive(entity))
+                return;
+            unsigned int id = componentId<T>();
+            Mask mask = m_archetypes[m_locations[entity.index].archetype]->mask;
+            if ((mask & (Mask(1) << id)) == 0)
+                move(entity, mask | (Mask(1) << id));
+            write(m_locations[entity.index], id, &component);
+        }
+
+        /// <summary>
+        /// Removes a component from an entity. The entity moves to the archetype without it.
+        /// </summary>
+        template <typename T>
+        void remove(Entity entity) {
+            if (!isAlive(entity))
+                return;
+            Mask bit = Mask(1) << componentId<T>();
+            Mask mask = m_archetypes[m_locations[entity.index].archetype]->mask;
+            if ((mask & bit) != 0)
+                move(entity, mask & ~bit);
+        }
+
+        /// <summary>
+        /// Returns a component of an entity, or null if it does not have it. The pointer is
+        /// only good until the next change to the entities.
+        /// </summary>
+        template <typename T>
+        T* get(Entity entity) {
+            if (!isAlive(entity))
+                return nullptr;
+            return static_cast<T*>(column(m_locations[entity.index], componentId<T>()));
+        }
+
+        template <typename T>
+        bool has(Entity entity) const {
+            return isAlive(entity) && (m_archetypes[m_locations[entity.index].archetype]->mask & (Mask(1) << componentId<T>())) != 0;
+        }
+
+        /// <summary>
+        /// Calls f(count, entities, components...) for every chunk of the entities with the
+        /// components Ts and none of the excluded ones, with the arrays of the chunk.
+        /// </summary>
+        template <typename... Ts, typename F>
+        void eachChunk(F&& f, Mask exclude = 0) {
+            Mask required = maskOf<Ts...>();
+            for (auto& archetype : m_archetypes) {
+                if ((archetype->mask & required) != required || (archetype->mask & exclude) != 0)
+                    continue;
+                for (Chunk& chunk : archetype->chunks)
+                    f(static_cast<size_t>(chunk.count), entities(*archetype, chunk), static_cast<Ts*>(column(*archetype, chunk, componentId<Ts>()))...);
+            }
+        }
+
+        /// <summary>
+        /// Calls f(entity, components...) for every entity with the components Ts and none
+        /// of the excluded ones.
+        /// </summary>
+        template <typename... Ts, typename F>
+        void each(F&& f, Mask exclude = 0) {
+            eachChunk<Ts...>([&f](size_t count, const Entity* entities, Ts*... components) {
+                for (size_t i = 0; i < count; i++)
+                    f(entities[i], components[i]...);
+            }, exclude);
+        }
+
+        /// <summary>
+        /// The same as each(), with the chunks split across the cores. f must only touch
+        /// the components it is given.
+        /// </summary>
+        template <typename... Ts, typename F>
+        void eachParallel(F&& f, Mask exclude = 0) {
+            Mask required = maskOf<Ts...>();
+            // the list of chunks only lives for this call, in the frame arena
+            Memory::ArenaVector<std::pair<Archetype*, Chunk*>> chunks{ Memory::ArenaAllocator<std::pair<Archetype*, Chunk*>>(Memory::frameArena()) };
+            for (auto& archetype : m_archetypes) {
+                if ((archetype->mask & required) != required || (archetype->mask & exclude) != 0)
+                    continue;
+                for (Chunk& chunk : archetype->chunks)
+                    chunks.emplace_back(archetype.get(), &chunk);
+            }
+            Parallel::forRange(chunks.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; c++) {
+                    Archetype& archetype = *chunks[c].first;
+                    Chunk& chunk = *chunks[c].second;
+                    const Entity* ids = entities(archetype, chunk);
+                    std::tuple<Ts*...> columns(static_cast<Ts*>(column(archetype, chunk, componentId<Ts>()))...);
+                    for (size_t i = 0; i < chunk.count; i++)
+                        f(ids[i], std::get<Ts*>(columns)[i]...);
+                }
+            });
+        }
+
+        /// <summary>
+        /// Returns a number that changes whenever an entity is created or destroyed, or gains
+        /// or loses a component. The components may have moved then, and the pointers to
+        /// them are not good anymore.
+        /// </summary>
+        unsigned int getVersion() const { return m_version; }
+
+        size_t getEntityCount() const { return m_generations.size() - m_free.size(); }
+        size_t getArchetypeCount() const { return m_archetypes.size(); }
+
+     private:
+        static const unsigned int NO_ARCHETYPE = 0xffffffffu;
+
+        /// <summary>
+        /// The memory of a chunk: the entities, then the array of every component. The
+        /// memory belongs to the pool of the registry.
+        /// </summary>
+        struct Chunk {
+            void* data = nullptr;
+            unsigned int count = 0;
+        };
+
+        /// <summary>
+        /// The entities with one set of components.
+        /// </summary>
+        struct Archetype {
+            Mask mask = 0;
+            unsigned int capacity = 0;                ///< Entities per chunk.
+            size_t offsets[MAX_COMPONENTS] = {};      ///< Where the array of every component starts in a chunk.
+            std::vector<Chunk> chunks;                ///< All full but the last.
+        };
+
+        /// <summary>
+        /// Where the components of an entity are.
+        /// </summary>
+        struct Location {
+            unsigned int archetype = NO_ARCHETYPE;
+            unsigned int chunk = 0;
+            unsigned int row = 0;
+        };
+
+        Entity allocate();
+        Archetype& archetypeFor(Mask mask);
+        Location insert(Archetype& archetype, Entity entity);
+        void erase(const Location& location);
+        void move(Entity entity, Mask mask);
+        void write(const Location& location, unsigned int id, const void* component);
+
+        static Entity* entities(Archetype& archetype, Chunk& chunk) {
+            (void)archetype;
+            return static_cast<Entity*>(chunk.data);
+        }
+
+        static void* column(Archetype& archetype, Chunk& chunk, unsigned int id) {
+            return static_cast<unsigned char*>(chunk.data) + archetype.offsets[id];
+        }
+
+        void* column(const Location& location, unsigned int id) {
+            Archetype& archetype = *m_archetypes[location.archetype];
+            if ((archetype.mask & (Mask(1) << id)) == 0)
+                return nullptr;
+            return static_cast<unsigned char*>(column(archetype, archetype.chunks[location.chunk], id)) + location.row * detail::componentSize(id);
+        }
+
+        Memory::BlockPool m_chunkPool;            ///< The memory of all the chunks.
+        std::vector<std::unique_ptr<Archetype>> m_archetypes;
+        std::map<Mask, unsigned int> m_archetypeOfMask;
+        std::vector<Location> m_locations;        ///< By entity index.
+        std::vector<unsigned int> m_generations;  ///< By entity index.
+        std::vector<unsigned int> m_free;         ///< The indices of the destroyed entities.
+        unsigned int m_version = 0;
+    };
+}
@@ -0,0 +1,134 @@
+/*********************************************************************
+ * \file   FileSystem.h
+ * \brief  Read-only access to the asset files through memory mappings.
+ * This file contains the namespace FileSystem. Instead of reading the
+ * shaders line by line, and letting Assimp and stb_image open the files
+ * with their own buffered readers, every asset is memory-mapped once and
+ * handed to the loaders as a view of the mapped bytes. The files are
+ * found through mounts, so the same paths can later be served from an
+ * archive instead of from loose files on disk.
+ *********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FileSystem {
+
+    /// <summary>
+    /// \class MappedFile
+    /// A whole file mapped read-only into memory (mmap on Linux, MapViewOfFile on Windows).
+    /// The mapping is released when the object is destroyed.
+    /// </summary>
+    class MappedFile {
+     public:
+        /// <summary>
+        /// Maps the file. Check isValid() to find out if it succeeded.
+        /// </summary>
+        /// <param name="path">The path of the file on disk.</param>
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool isValid() const { return m_valid; }
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+     private:
+        const char* m_data = nullptr; ///< Start of the mapping.
+        size_t m_size = 0;            ///< Size of the file in bytes.
+        bool m_valid = false;         ///< Whether the file was opened (an empty file is valid but has no mapping).
+    };
+
+    /// <summary>
+    /// \class FileView
+    /// The bytes of one file, without copying them. The view keeps whatever it points
+    /// into (a MappedFile, or an archive) alive, so it can be passed around freely.
+    /// </summary>
+    class FileView {
+     public:
+        FileView() {}
+        FileView(const char* data, size_t size, std::shared_ptr<const void> owner) : m_data(data), m_size(size), m_owner(owner) {}
+
+        /// <summary>
+        /// Returns true if the file was found.
+        /// </summary>
+        explicit operator bool() const { return m_owner != nullptr; }
+
+        const char* data() const { return m_data; }
+        const unsigned char* bytes() const { return reinterpret_cast<const unsigned char*>(m_data); }
+        size_t size() const { return m_size; }
+
+     private:
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+        std::shared_ptr<const void> m_owner; ///< Keeps the memory behind m_data alive.
+    };
+
+    /// <summary>
+    /// \class Mount
+    /// A source of files, searched by Vfs::open().
+    /// </summary>
+    class Mount {
+     public:
+        virtual ~Mount() {}
+
+        /// <summary>
+        /// Returns the file, or an empty view if the mount does not have it.
+        /// </summary>
+        /// <param name="path">A path normalized by Vfs::normalize().</param>
+        virtual FileView open(const std::string& path) = 0;
+    };
+
+    /// <summary>
+    /// \class DirectoryMount
+    /// Serves the loose files under a directory, each file memory-mapped on its own.
+    /// </summary>
+    class DirectoryMount : public Mount {
+     public:
+        /// <param name="root">The directory the paths are relative to. Empty for the working directory.</param>
+        explicit DirectoryMount(const std::string& root = "") : m_root(root) {}
+
+        FileView open(const std::string& path) override;
+
+     private:
+        std::string m_root;
+    };
+
+    /// <summary>
+    /// \class Vfs
+    /// The virtual file system: a list of mounts searched from the most recently
+    /// mounted to the first one. If nothing is mounted, the working directory is used.
+    /// </summary>
+    class Vfs {
+     public:
+        /// <summary>
+        /// Adds a mount. It takes priority over the ones already mounted.
+        /// </summary>
+        void mount(std::shared_ptr<Mount> mount);
+
+        /// <summary>
+        /// Opens a file. Returns an empty view if no mount has it.
+        /// </summary>
+        /// <param name="path">The path of the file, with either kind of separator.</param>
+        FileView open(const std::string& path);
+
+        /// <summary>
+        /// Turns the Windows separators used in the asset paths into '/', drops
+        /// "./" parts and resolves "..", so every mount sees the same spelling.
+        /// </summary>
+        static std::string normalize(const std::string& path);
+
+     private:
+        std::vector<std::shared_ptr<Mount>> m_mounts;
+    };
+
+    /// <summary>
+    /// Returns the file system the loaders read from.
+    /// </summary>
+    Vfs& vfs();
+}
@@ -0,0 +1,53 @@
+/*********************************************************************
+ * \file   FileWatcher.h
+ * \brief  Tells which files on disk changed since the last check.
+ * Used to reload the shaders while the game runs. On Linux the
+ * directories of the files are watched with inotify, so a check is one
+ * non-blocking read. Elsewhere the modification times are compared a
+ * few times per second.
+ * Only loose files are watched: a file served from an asset pack does
+ * not change, so the pack should not be built while editing.
+ *********************************************************************/
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// \class FileWatcher
+/// Files are added with watch() and poll() returns the ones that changed.
+/// </summary>
+class FileWatcher {
+ public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    /// <summary>
+    /// Starts watching a file.
+    /// </summary>
+    /// <param name="path">The path of the file, with either kind of separator.</param>
+    void watch(const std::string& path);
+
+    /// <summary>
+    /// Returns the watched files that were written since the last call, as normalized
+    /// by FileSystem::Vfs::normalize(). Never blocks.
+    /// </summary>
+    std::vector<std::string> poll();
+
+ private:
+    std::set<std::string> m_files;                            ///< The watched files, normalized.
+#ifdef __linux__
+    int m_inotify = -1;                                       ///< The inotify descriptor.
+    std::map<int, std::string> m_directories;                 ///< The watched directory of every inotify watch.
+#else
+    std::map<std::string, std::filesystem::file_time_type> m_times; ///< The last seen modification times.
+    std::chrono::steady_clock::time_point m_lastCheck;
+#endif
+};
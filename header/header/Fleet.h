@@ -0,0 +1,262 @@
+/*********************************************************************
+ * \file   Fleet.h
+ * \brief  The ships that sail around the player's ship.
+ * The ship the player sails is an entity (see GameObject.h), with its
+ * own draw calls. The other ships are kept together instead:
+ * their state lives in flat arrays, updated in one pass per frame (all
+ * the hulls are floated with one batched Waves::sample() call), and
+ * every model is drawn once for the whole fleet with instancing. The
+ * draw calls, the uniform uploads and the state changes stay the same
+ * however many ships there are; only the instance buffers grow. With
+ * OpenGL 4.3 the instances can also be culled on the GPU (see
+ * GpuCuller.h), which leaves the CPU no work per instance past update().
+ * Each ship is steered by the AI, which wanders between random points
+ * and turns away from the islands it runs into, or replays a recorded
+ * track. The seagulls of all the ships fly in one
+ * Flock, each after its own ship.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <Buoyancy.h>
+#include <CascadedShadowMap.h>
+#include <Collision.h>
+#include <Flock.h>
+#include <GpuCuller.h>
+#include <InstanceBuffer.h>
+#include <LightClusters.h>
+#include <MaterialTable.h>
+#include <Model.h>
+#include <OcclusionCuller.h>
+#include <Settings.h>
+#include <ShaderVariants.h>
+#include <StreamBuffer.h>
+#include <Waves.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// The size of the fleet, read from the settings file.
+/// </summary>
+struct FleetSettings {
+    int ships = 6;            ///< Number of ships besides the player's.
+    int followers = 2;        ///< Seagulls following every ship.
+    int bugs = 2;             ///< Bugs following every seagull.
+    float radius = 60.0f;     ///< The AI ships sail within this distance of the origin.
+    std::string replay;       ///< A track for the replayed ships. Without one, all ships use the AI.
+    int replayShips = 1;      ///< How many of the ships replay the track.
+
+    /// <summary>
+    /// Reads the "fleet.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static FleetSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class ReplayTrack
+/// The course of a ship over time, to play it back.
+/// The file has one "time x z angle" line per recorded moment.
+/// </summary>
+class ReplayTrack {
+ public:
+    /// <summary>
+    /// Where the ship was at one moment.
+    /// </summary>
+    struct Key {
+        float time;
+        glm::vec2 position;
+        float angle;          ///< Heading, in degrees.
+    };
+
+    /// <summary>
+    /// Reads a track through the Vfs. Returns false if it does not exist or is empty.
+    /// </summary>
+    bool load(const std::string& path);
+
+    /// <summary>
+    /// Writes the track to a file.
+    /// </summary>
+    bool save(const std::string& path) const;
+
+    /// <summary>
+    /// Appends a moment. The times must increase.
+    /// </summary>
+    void record(float time, const glm::vec2& position, float angle);
+
+    /// <summary>
+    /// Returns where the ship is at a time, between the recorded moments. The track loops.
+    /// </summary>
+    Key sample(float time) const;
+
+    bool empty() const { return m_keys.empty(); }
+
+ private:
+    std::vector<Key> m_keys;
+};
+
+/// <summary>
+/// \class Fleet
+/// Every frame: update() moves the ships and their followers and uploads the instance
+/// matrices, then render() and renderShadow() draw them.
+/// </summary>
+class Fleet {
+ public:
+    /// <summary>
+    /// What steers a ship.
+    /// </summary>
+    enum class Controller {
+        AI,
+        REPLAY
+    };
+
+    /// <param name="shipModel">Path to the 3D model of the ships.</param>
+    /// <param name="seagullModel">Path to the 3D model of the seagulls.</param>
+    /// <param name="bugModel">Path to the 3D model of the bugs.</param>
+    /// <param name="stream">The stream the instance matrices are written into every frame.</param>
+    /// <param name="table">The material table the textures of the models go to, if any.</param>
+    Fleet(const std::string& shipModel, const std::string& seagullModel, const std::string& bugModel, StreamBuffer& stream, MaterialTable* table = nullptr);
+
+    Fleet(const Fleet&) = delete;
+    Fleet& operator=(const Fleet&) = delete;
+
+    /// <summary>
+    /// Adds a ship.
+    /// </summary>
+    /// <param name="position">Where the ship starts, on the xz plane. A replayed ship
+    /// sails its track around this point.</param>
+    /// <param name="angle">The heading it starts with, in degrees.</param>
+    /// <param name="followers">The number of seagulls following it.</param>
+    /// <param name="bugs">The number of bugs following every seagull.</param>
+    /// <param name="controller">What steers it.</param>
+    void addShip(const glm::vec2& position, float angle, int followers, int bugs, Controller controller = Controller::AI);
+
+    /// <summary>
+    /// Sets the track the REPLAY ships follow.
+    /// </summary>
+    void setReplay(const ReplayTrack& track) { m_replay = track; }
+
+    /// <summary>
+    /// Sets the islands the AI ships cannot sail through. Without them, nothing stops them.
+    /// </summary>
+    void setCollision(const CollisionWorld* world) { m_collision = world; }
+
+    /// <summary>
+    /// Adds the ships of the settings on rings around the origin, clear of the islands
+    /// near it. Loads the replay track of the settings, if any.
+    /// </summary>
+    void spawn(const FleetSettings& settings);
+
+    /// <summary>
+    /// Steers and floats every ship, moves the followers and uploads the matrices of all
+    /// of them. Call it once per frame, before the shadow and the main passes.
+    /// </summary>
+    /// <param name="waves">The waves, updated to the current frame.</param>
+    /// <param name="time">The time since the start, in seconds.</param>
+    /// <param name="deltaTime">The time since the last frame.</param>
+    void update(const Waves& waves, float time, float deltaTime);
+
+    /// <summary>
+    /// Culls the fleet on the GPU from now on. The context must support it
+    /// (see GpuCuller::isSupported()).
+    /// </summary>
+    void useGpuCulling(const GpuCullingSettings& settings);
+
+    /// <summary>
+    /// Keeps only the ships, seagulls and bugs that are in the view and not hidden behind
+    /// the occluders, if there is a culler. On the CPU, without the GPU culling, there is
+    /// nothing to do without one. Call it after the shadow pass, which draws them all, and
+    /// before render().
+    /// </summary>
+    void cull(const glm::mat4& view, const glm::mat4& projection, const OcclusionCuller* culler);
+
+    /// <summary>
+    /// Draws the whole fleet: one instanced draw per mesh of each model, or with the GPU
+    /// culling one indirect multi-draw per material group of each model.
+    /// </summary>
+    void render(ShaderVariants& shaders);
+
+    /// <summary>
+    /// Draws the depth of the ships and the seagulls into a shadow cascade.
+    /// </summary>
+    void renderShadow(CascadedShadowMap& shadows, int cascade);
+
+    /// <summary>
+    /// Adds the lantern of every ship to the lights of the frame, after update().
+    /// </summary>
+    void addLights(LightClusters& lights) const;
+
+    /// <summary>
+    /// Returns the flock the seagulls fly in, e.g. to change its settings.
+    /// </summary>
+    Flock& getFlock() { return m_flock; }
+
+    size_t getShipCount() const { return m_positions.size(); }
+    size_t getFollowerCount() const { return m_flock.getBirdCount(); }
+    size_t getBugCount() const { return m_bugs.size(); }
+
+    /// <summary>
+    /// Returns the GPU culler, or null when the fleet is culled on the CPU.
+    /// </summary>
+    const GpuCuller* getGpuCuller() const { return m_gpuCuller.get(); }
+
+ private:
+    /// <summary>
+    /// A bug circling a seagull.
+    /// </summary>
+    struct Bug {
+        unsigned int follower;
+        float radius;
+        float angle;          ///< Position on the circle, in radians.
+    };
+
+    void steer(size_t ship, float time, float deltaTime);
+    glm::vec2 randomPoint();
+    void uploadInstances(Model& model, const std::vector<glm::mat4>& matrices, InstanceBuffer& instances);
+
+    Model m_shipModel;
+    Model m_seagullModel;
+    Model m_bugModel;
+    Buoyancy m_hull;
+    float m_hullRadius;                   ///< The hulls as circles, for the collisions.
+    const CollisionWorld* m_collision = nullptr;
+
+    // the ships, one element per ship in every vector
+    std::vector<glm::vec2> m_positions;
+    std::vector<float> m_angles;          ///< Headings, in degrees.
+    std::vector<HullPose> m_poses;
+    std::vector<Controller> m_controllers;
+    std::vector<glm::vec2> m_origins;     ///< Where the replayed ships sail their track around.
+    std::vector<glm::vec2> m_targets;     ///< Where the AI ships are heading.
+
+    Flock m_flock;                        ///< The seagulls. The target of every ship has its index.
+    std::vector<Bug> m_bugs;
+
+    // the sample points of all the hulls, Buoyancy::POINTS per ship
+    std::vector<float> m_sampleX;
+    std::vector<float> m_sampleZ;
+    std::vector<float> m_sampleHeights;
+
+    std::vector<glm::mat4> m_shipMatrices;
+    std::vector<glm::mat4> m_seagullMatrices;
+    std::vector<glm::mat4> m_bugMatrices;
+    std::vector<glm::mat4> m_visibleMatrices; ///< Scratch of cull().
+    StreamBuffer& m_stream;
+    InstanceBuffer m_shipInstances;
+    InstanceBuffer m_seagullInstances;
+    InstanceBuffer m_bugInstances;
+
+    // the culling on the GPU, which replaces the instance buffers when it is used
+    std::unique_ptr<GpuCuller> m_gpuCuller;
+    unsigned int m_gpuShips = 0;
+    unsigned int m_gpuSeagulls = 0;
+    unsigned int m_gpuBugs = 0;
+
+    ReplayTrack m_replay;
+    float m_radius = 60.0f;
+    std::mt19937 m_random;
+};
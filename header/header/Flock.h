@@ -0,0 +1,105 @@
+/*********************************************************************
+ * \file   Flock.h
+ * \brief  Seagulls that fly as a flock, with boids.
+ * Every bird steers by the birds around it: away from the ones too
+ * close (separation), along with their mean velocity (alignment) and
+ * towards their center (cohesion), and also towards the ship it
+ * follows (its target), which it circles.
+ * The neighbours are found with a uniform grid of cells as large as the
+ * neighbour radius, hashed into a table: the birds are sorted by cell
+ * every step (a counting sort), and a bird only looks at the 27 cells
+ * around it. The cost grows with the number of birds, not its square.
+ * The steering of the birds is split across the cores (see Parallel.h).
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <Settings.h>
+
+#include <vector>
+
+/// <summary>
+/// The weights of the steering rules, read from the settings file.
+/// </summary>
+struct FlockSettings {
+    float neighbourRadius = 1.0f;   ///< Birds closer than this are neighbours. Also the size of a cell.
+    float separationRadius = 0.4f;  ///< Neighbours closer than this are pushed away.
+    int maxNeighbours = 24;         ///< A bird only looks at this many neighbours, to bound the cost in dense flocks.
+    float separation = 1.5f;
+    float alignment = 0.6f;
+    float cohesion = 0.4f;
+    float attraction = 1.0f;        ///< Towards the target.
+    float orbit = 0.6f;             ///< Around the target, so the birds circle it instead of gathering on it.
+    float maxSpeed = 4.0f;
+    float maxForce = 8.0f;
+    float minHeight = 0.5f;         ///< The birds stay above the sea.
+
+    /// <summary>
+    /// Reads the "flock.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static FlockSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class Flock
+/// The birds, and the targets they follow. Call update() once per frame.
+/// </summary>
+class Flock {
+ public:
+    Flock() {}
+    explicit Flock(const FlockSettings& settings) : m_settings(settings) {}
+
+    void setSettings(const FlockSettings& settings) { m_settings = settings; }
+
+    /// <summary>
+    /// Adds a bird and returns its index.
+    /// </summary>
+    /// <param name="position">Where it starts.</param>
+    /// <param name="target">The index of the target it follows.</param>
+    unsigned int addBird(const glm::vec3& position, unsigned int target);
+
+    /// <summary>
+    /// Moves a target, adding it if needed.
+    /// </summary>
+    void setTarget(unsigned int target, const glm::vec3& position);
+
+    /// <summary>
+    /// Steers and moves every bird.
+    /// </summary>
+    void update(float deltaTime);
+
+    size_t getBirdCount() const { return m_positions.size(); }
+    const glm::vec3& getPosition(unsigned int bird) const { return m_positions[bird]; }
+    const glm::vec3& getVelocity(unsigned int bird) const { return m_velocities[bird]; }
+
+    /// <summary>
+    /// Returns the heading of a bird, in degrees around the y-axis, 0 along +z.
+    /// </summary>
+    float getHeading(unsigned int bird) const;
+
+ private:
+    void buildGrid();
+    void steer(size_t begin, size_t end, float deltaTime);
+    unsigned int cellOf(const glm::vec3& position) const;
+    unsigned int hashCell(int x, int y, int z) const;
+
+    FlockSettings m_settings;
+
+    // the birds, by index
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::vec3> m_velocities;
+    std::vector<glm::vec3> m_newVelocities;
+    std::vector<unsigned int> m_birdTargets;
+    std::vector<glm::vec3> m_targets;
+
+    // the grid: the birds sorted by the bucket of their cell, copied in that order so
+    // the neighbours of a bird are read from contiguous memory
+    std::vector<unsigned int> m_bucketStart;   ///< First sorted bird of every bucket, and the end of the last one.
+    std::vector<unsigned int> m_birdBuckets;
+    std::vector<unsigned int> m_bucketNext;     ///< Where the next bird of every bucket goes, while sorting.
+    std::vector<unsigned int> m_sortedBirds;
+    std::vector<glm::vec3> m_sortedPositions;
+    std::vector<glm::vec3> m_sortedVelocities;
+    unsigned int m_bucketMask = 0;
+};
@@ -0,0 +1,121 @@
+/*********************************************************************
+ * \file   FramePacer.h
+ * \brief  When the frames are presented, and how evenly.
+ * Without a swap interval the main loop renders as many frames as the
+ * GPU can, most of which the screen never shows, and keeps a core busy
+ * all the time. The pacer sets the swap interval of the context by its
+ * mode:
+ * - VSYNC waits for the vertical blank in glfwSwapBuffers().
+ * - ADAPTIVE does too, but a late frame is shown at once, with a tear,
+ *   instead of waiting for the next blank. It needs the
+ *   swap_control_tear extension, and falls back to VSYNC without it.
+ * - CAPPED does not wait for the blank, and holds every frame back to
+ *   a fixed rate instead. The wait sleeps, which leaves the core free,
+ *   until a little before the deadline and spins the rest, as a sleep
+ *   can wake up late by a millisecond or more.
+ * - UNCAPPED does not wait at all, for benchmarks.
+ * Either way the time between frames is measured, and its mean and its
+ * deviation tell how smooth the frames come out for the CPU they take.
+ *********************************************************************/
+#pragma once
+
+#include <Settings.h>
+
+#include <chrono>
+#include <cstddef>
+
+/// <summary>
+/// How the frames are paced, read from the settings file.
+/// </summary>
+struct PacingSettings {
+    enum class Mode {
+        VSYNC,
+        ADAPTIVE,
+        CAPPED,
+        UNCAPPED
+    };
+
+    Mode mode = Mode::VSYNC;
+    int fps = 60;                 ///< The frame rate of CAPPED.
+    float spinMs = 2.0f;          ///< The last part of the wait of CAPPED that is spun instead of slept.
+
+    /// <summary>
+    /// Reads the "pacing.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static PacingSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// The time between the frames, since the last FramePacer::resetStats().
+/// </summary>
+struct FrameStats {
+    size_t frames = 0;
+    double meanMs = 0.0;
+    double deviationMs = 0.0;     ///< The standard deviation: zero when every frame takes as long.
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    size_t hitches = 0;           ///< The frames that took more than half as long again as the mean.
+    double sleptMs = 0.0;         ///< The time CAPPED slept, per frame.
+    double spunMs = 0.0;          ///< The time CAPPED spun, per frame.
+};
+
+/// <summary>
+/// \class FramePacer
+/// Once the context is current: apply(). Every frame: endFrame() right before glfwSwapBuffers().
+/// </summary>
+class FramePacer {
+ public:
+    explicit FramePacer(const PacingSettings& settings);
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    /// <summary>
+    /// Sets the swap interval of the current context for the mode.
+    /// </summary>
+    void apply();
+
+    /// <summary>
+    /// Holds the frame back to the rate of CAPPED, then measures the time since the last call.
+    /// </summary>
+    void endFrame();
+
+    /// <summary>
+    /// Returns the statistics of the frames since the last resetStats().
+    /// </summary>
+    FrameStats getStats() const;
+    void resetStats();
+
+    /// <summary>
+    /// Returns the mode in use, which is VSYNC when ADAPTIVE is not supported.
+    /// </summary>
+    PacingSettings::Mode getMode() const { return m_settings.mode; }
+
+    /// <summary>
+    /// Returns the name of a mode, as in the settings file.
+    /// </summary>
+    static const char* modeName(PacingSettings::Mode mode);
+
+ private:
+    using Clock = std::chrono::steady_clock;
+
+    void wait();
+    void measure(Clock::time_point now);
+
+    PacingSettings m_settings;
+    Clock::duration m_period{};           ///< The time of a frame of CAPPED.
+    Clock::time_point m_deadline;         ///< When the last frame of CAPPED was due.
+    Clock::time_point m_lastFrame;
+    bool m_started = false;
+
+    // the frame times, accumulated by Welford's method so the variance keeps its precision
+    size_t m_frames = 0;
+    double m_mean = 0.0;
+    double m_squares = 0.0;               ///< The sum of the squared differences from the mean.
+    double m_min = 0.0;
+    double m_max = 0.0;
+    size_t m_hitches = 0;
+    double m_slept = 0.0;                 ///< In milliseconds, over all the frames.
+    double m_spun = 0.0;
+};
@@ -0,0 +1,104 @@
+/*********************************************************************
+ * \file   FrameUniforms.h
+ * \brief  The uniforms that are the same for every draw of a frame.
+ * The camera, the light and the fog live in one uniform buffer, bound
+ * to the Frame block of every shader. They are uploaded once per frame
+ * instead of once per shader program, which matters as soon as there
+ * is more than one program (see ShaderVariants.h). The cascades of the
+ * shadow map are in here too (see CascadedShadowMap.h), and so are the
+ * waves of the sea (see Waves.h) and the light clusters (see
+ * LightClusters.h). They are written into the stream of the frame (see
+ * StreamBuffer.h), as is the Object block with the model matrix of
+ * every object drawn on its own.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <StreamBuffer.h>
+
+/// <summary>
+/// The contents of the Frame block, in std140 layout: every vec3 takes a whole vec4.
+/// </summary>
+struct FrameUniforms {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::vec4 viewPos = glm::vec4(0.0f);
+    glm::vec4 lightDirection = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);
+    glm::vec4 lightAmbient = glm::vec4(1.0f);
+    glm::vec4 lightDiffuse = glm::vec4(1.0f);
+    glm::vec4 lightSpecular = glm::vec4(1.0f);
+    glm::vec4 fog = glm::vec4(0.0f);    ///< The fog color in xyz, its density in w.
+    glm::mat4 lightSpace[4] = { glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f) }; ///< Light projection times light view of every shadow cascade.
+    glm::vec4 cascadeSplits = glm::vec4(0.0f); ///< View-space depth where each cascade ends.
+    glm::vec4 shadowParams = glm::vec4(0.0f);  ///< Cascade count, depth bias, texel size of the shadow map.
+    glm::vec4 time = glm::vec4(0.0f);          ///< Seconds since the start in x, the number of waves in y.
+    glm::vec4 waves[8] = {};                   ///< Direction xy, steepness and wavelength of every Gerstner wave (see Waves.h).
+    glm::vec4 clusterScale = glm::vec4(0.0f);  ///< Tiles per pixel in xy, slices per log of the depth in z, the slice of depth 1 in w.
+    glm::vec4 clusterGrid = glm::vec4(0.0f);   ///< Tiles across and down, slices, and the number of lights.
+};
+
+/// <summary>
+/// \class FrameUniformBuffer
+/// The uniform buffer behind the Frame block: a range of the stream, written once per frame.
+/// </summary>
+class FrameUniformBuffer {
+ public:
+    /// <summary>
+    /// The binding point of the Frame block.
+    /// </summary>
+    static const unsigned int BINDING = 0;
+
+    explicit FrameUniformBuffer(StreamBuffer& stream) :
+        m_stream(stream)
+    {
+    }
+
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+    /// <summary>
+    /// Writes the uniforms of the frame into the stream and binds them to the Frame block.
+    /// </summary>
+    void update(const FrameUniforms& uniforms) {
+        StreamRange range = m_stream.write(&uniforms, sizeof(FrameUniforms), m_stream.getUniformAlignment());
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, range.buffer, range.offset, range.size);
+    }
+
+ private:
+    StreamBuffer& m_stream;
+};
+
+/// <summary>
+/// \class ObjectUniformBuffer
+/// The Object block of the shaders that draw one object at a time: its model matrix.
+/// Every object gets its own range of the stream, so the matrix of the object before
+/// is never overwritten while a draw may still read it.
+/// </summary>
+class ObjectUniformBuffer {
+ public:
+    /// <summary>
+    /// The binding point of the Object block.
+    /// </summary>
+    static const unsigned int BINDING = 1;
+
+    explicit ObjectUniformBuffer(StreamBuffer& stream) :
+        m_stream(stream)
+    {
+    }
+
+    ObjectUniformBuffer(const ObjectUniformBuffer&) = delete;
+    ObjectUniformBuffer& operator=(const ObjectUniformBuffer&) = delete;
+
+    /// <summary>
+    /// Writes the model matrix of the next object into the stream and binds it to the Object block.
+    /// </summary>
+    void update(const glm::mat4& model) {
+        StreamRange range = m_stream.write(&model, sizeof(glm::mat4), m_stream.getUniformAlignment());
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, range.buffer, range.offset, range.size);
+    }
+
+ private:
+    StreamBuffer& m_stream;
+};
@@ -1,12 +1,14 @@
 /*********************************************************************
  * \file   GameObject.h
- * \brief  All the objects that will be used in the game.
- * This file contains the namespace GameObject. To this namespace, 
- * belong the classes that represent the ship, the islands, the 
- * seagulls and the bugs. This namespace was created to avoid any
- * naming conflicts with the already existing code that is used. Since
- * the classes are small, they will be kept in this header file only.
- * from https://learnopengl.com.
+ * \brief  The objects of the game.
+ * The objects are entities of the Registry (see Ecs.h), made of the
+ * components in Components.h and moved and drawn by the systems in
+ * Systems.h. What is left in the namespace GameObject is what has no
+ * place in a component: the ship the player controls, which turns the
+ * input, the islands and the waves into the Transform of its entity,
+ * and the placement of the islands. This namespace was created to
+ * avoid any naming conflicts with the already existing code that is
+ * used.
  * \author Vasilis
  * \date   January 2021
  *********************************************************************/
@@ -16,8 +18,15 @@
 #include <glm.hpp>
 #include <matrix_transform.hpp>
 #include <cmath>
-#include <Model.h>
-#include <Shader.h>
+#include <memory>
+#include <vector>
+#include <Components.h>
+#include <Ecs.h>
+#include <Systems.h>
+#include <Waves.h>
+#include <Buoyancy.h>
+#include <Flock.h>
+#include <Collision.h>
 
 namespace GameObject {   
 
@@ -34,213 +43,43 @@ namespace GameObject {
     };
 
     /// <summary>
-    /// \class Island
-    /// The class used to render the Island objects.
+    /// Returns the Transform of an island at a point of the world map. The islands are
+    /// scaled down to 0.05 of the size of their model.
     /// </summary>
-    class Island {
-     public:
-        /// <summary>
-        /// Constructor
-        /// </summary>
-        /// <param name="model"> The path of the 3D model that will be used.</param>
-        /// <param name="origin">The location of the island in the world map.</param>
-        Island(std::string& model, glm::vec3 origin) : m_islandModel(model), m_position(origin) {
-            m_islandModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_islandModelMatrix = glm::scale(m_islandModelMatrix, glm::vec3(0.05f, 0.05f, 0.05f));
-        }
-
-        ~Island() {}
-
-        // Getters
-
-        /// <summary>
-        /// Returns the 3D model of the island.
-        /// </summary>
-        const Model& getModel() const {
-            return m_islandModel;
-        }
-
-        /// <summary>
-        /// Returns the position of the island.
-        /// </summary>
-        const glm::vec3 getPosition() const {
-            return m_position;
-        }
-
-        /// <summary>
-        /// Renders the island when called in the main loop.
-        /// </summary>
-        /// <param name="shader">The main shader program.</param>
-        void render(Shader& shader) {
-            shader.setMat4("model", m_islandModelMatrix);
-            m_islandModel.Draw(shader);
-        }
-
-     private:
-        Model m_islandModel;           ///< The 3D model of the island.
-        glm::vec3 m_position;          ///< The position of the island.
-        glm::mat4 m_islandModelMatrix; ///< The island's model matrix.    
-    };
-
-    /// <summary>
-    /// \class Bug
-    /// The class used for rendering bugs.
-    /// </summary>
-    class Bug {
-     public:
-        /// <summary>
-        /// The constructor for the bug.
-        /// </summary>
-        /// <param name="model">Path to the 3D model.</param>
-        /// <param name="origin">The position in the world that the bug will spawn.</param>
-        /// <param name="seagullPosition">The position of the seagull that the bug will be following.</param>
-        Bug(std::string& model, glm::vec3 origin, glm::vec3 seagullPosition) : m_bugModel(model), m_position(origin) {
-            m_bugModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_bugModelMatrix = glm::rotate(m_bugModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_bugModelMatrix = glm::scale(m_bugModelMatrix, glm::vec3(0.0003f, 0.0003f, 0.0003f));
-
-            m_seagullOffsets = m_position - seagullPosition;
-            m_radius = glm::sqrt(pow(m_seagullOffsets.x, 2.0f) + pow(m_seagullOffsets.z, 2.0f));
-            m_angle = (m_seagullOffsets.x < 0) ? 180.0f : 0.0f;
-        }
-
-        ~Bug() {}
-
-        /// <summary>
-        /// Renders the bug. The bug will be rotating around its seagull over time, based
-        /// on its current position in the x axis (left or right of the seagull).
-        /// Scaling the model down to 0.0003 of its size was appropriate, in order to 
-        /// look normal.
-        /// </summary>
-        /// <param name="seagullPosition">The position of the seagull.</param>
-        /// <param name="shader">The current shader program.</param>
-        void render(glm::vec3 seagullPosition, Shader& shader) {
-            m_angle += 0.01f;
-            if (m_angle > 360.0f)
-                m_angle = 0.0f;
-
-            m_position.x = seagullPosition.x + glm::sin(m_angle) * m_radius;
-            m_position.z = seagullPosition.z + glm::cos(m_angle) * m_radius;
-
-            m_bugModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_bugModelMatrix = glm::rotate(m_bugModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_bugModelMatrix = glm::scale(m_bugModelMatrix, glm::vec3(0.0003f, 0.0003f, 0.0003f));
-
-            shader.setMat4("model", m_bugModelMatrix);
-            m_bugModel.Draw(shader);
-        }
-
-     private:
-        Model m_bugModel;           ///< The 3D model of the bug
-        glm::vec3 m_position;       ///< The current position of the bug in the world
-        glm::mat4 m_bugModelMatrix; ///< The model matrix of the bug
-        glm::vec3 m_seagullOffsets; ///< Offsets from the seagull
-        float m_radius;             ///< Radius from the seagull
-        float m_angle;              ///< The angle towards the seagull
-        
-        friend class Seagull;
-    };
-
-    /// <summary>
-    /// \class Seagull
-    /// The Seagull object follows the ship around. When the ship turns, the seagulls turn along
-    /// with it. Each seagull will have two bugs following them, initialized in the populate()
-    /// function.
-    /// </summary>
-    class Seagull {
-     public:
-        /// <summary>
-        /// The constructor for the seagull.
-        /// </summary>
-        /// <param name="model">Path to the 3D model.</param>
-        /// <param name="origin">The position in the world that the seagull will spawn</param>
-        /// <param name="shipPosition">The position of the ship that the seagull will be following.</param>
-        Seagull(std::string& model, glm::vec3 origin, glm::vec3 shipPosition) : m_seagullModel(model), m_position(origin) {
-            m_seagullModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_seagullModelMatrix = glm::rotate(m_seagullModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_seagullModelMatrix = glm::scale(m_seagullModelMatrix, glm::vec3(0.03f, 0.03f, 0.03f));
-
-            m_shipOffsets = m_position - shipPosition;
-
-            m_radius = glm::sqrt(pow(m_shipOffsets.x, 2.0f) + pow(m_shipOffsets.z, 2.0f)); 
-        }
-
-        ~Seagull() {}
-
-        /// <summary>
-        /// Renders the seagull according to the ship's position.
-        /// </summary>
-        /// <param name="shipPosition">The position of the ship.</param>
-        /// <param name="shader">The current shader program.</param>
-        void render(glm::vec3 shipPosition, Shader& shader) {
-            m_seagullModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_seagullModelMatrix = glm::rotate(m_seagullModelMatrix, glm::radians(m_angle), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_seagullModelMatrix = glm::scale(m_seagullModelMatrix, glm::vec3(0.03f, 0.03f, 0.03f));
-            shader.setMat4("model", m_seagullModelMatrix);
-            m_seagullModel.Draw(shader);
-        }
-
-        /// <summary>
-        /// Initializes the Bug objects that will follow the seagull.
-        /// \warning This method is not called in the constructor during the initialization of the Seagull object.
-        ///          It must be called on its own after the object creation.
-        /// </summary>
-        /// <param name="bugModel">The path to the 3D model that will be used for the bugs.</param>
-        void populate(std::string& bugModel) {
-            m_bugs.emplace_back(bugModel, glm::vec3(m_position.x + 0.2f, m_position.y, m_position.z), m_position);
-            m_bugs.emplace_back(bugModel, glm::vec3(m_position.x - 0.2f, m_position.y, m_position.z), m_position);
-        }
-
-        // Getters
-
-        /// <summary>
-        /// Returns the current position of the seagull.
-        /// </summary>
-        glm::vec3 getPosition() {
-            return m_position;
-        }
-        
-        /// <summary>
-        /// Returns a reference to the vector with the bugs.
-        /// </summary>
-        std::vector<Bug>& getBugs() {
-            return m_bugs;
-        }
- 
-     private:
-         float m_angle = 180.0f;         ///< Angle of the seagull relative to the y-axis. Used for rotating.
-         float m_radius;                 ///< The radius that the seagull will use to circle the ship.
-         Model m_seagullModel;           ///< The 3D model of the seagull.
-         glm::vec3 m_position;           ///< The current position of the seagull.
-         glm::mat4 m_seagullModelMatrix; ///< The model matrix used in the shaders.
-
-         glm::vec3 m_shipOffsets;        ///< offsets from the ship.
-         std::vector<Bug> m_bugs;        ///< vector containing the Bug objects.
-
-         friend class Ship;
-    };
+    inline Transform islandTransform(const glm::vec3& position) {
+        Transform transform;
+        transform.position = position;
+        transform.scale = 0.05f;
+        transform.update();
+        return transform;
+    }
 
     /// <summary>
     /// \class Ship
-    /// This is the ship class that contains all the information about our ship. Regarding its movement, 
-    /// the ship can move forward and backward, and also it can turn (rotate around the y-axis). The 
-    /// seagulls following the ship move exactly the same way.
+    /// The controller of the ship the player sails. The ship itself is an entity, drawn by
+    /// the RenderSystem; the controller moves it. Regarding its movement, the ship can move
+    /// forward and backward, and also it can turn (rotate around the y-axis). The seagulls
+    /// following the ship are entities too, which fly after it as a flock (see Flock.h),
+    /// each with bugs circling it.
     /// </summary>
     class Ship {
      public:
          /// <summary>
-         /// The constructor for the ship.
+         /// The constructor for the ship. It creates the entity of the ship.
          /// </summary>
-         /// <param name="shipModel">Path to the 3D model.</param>
-         /// <param name="seagullModel">Path to the seagull's 3D model. Used in the populate() function.</param>
+         /// <param name="registry">The entities of the game.</param>
+         /// <param name="renderer">The models of the entities.</param>
+         /// <param name="shipModel">The index of the 3D model of the ship in the renderer.</param>
          /// <param name="origin">The position in the world that the ship will spawn.</param>
-        Ship(std::string& shipModel, std::string& seagullModel, glm::vec3 origin = glm::vec3(0.0f, 0.0f, 0.0f)) : 
-            m_shipModel(shipModel), 
-            m_position(origin), 
+        Ship(Ecs::Registry& registry, RenderSystem& renderer, unsigned int shipModel, glm::vec3 origin = glm::vec3(0.0f, 0.0f, 0.0f)) :
+            m_registry(registry),
+            m_position(origin),
             m_front(glm::vec3(0.0f, 0.0f, -1.0f)) {
-            m_shipModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_shipModelMatrix = glm::rotate(m_shipModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_shipModelMatrix = glm::scale(m_shipModelMatrix, glm::vec3(0.03f, 0.03f, 0.03f));
+            m_hullRadius = renderer.getModel(shipModel).bounds.radius * 0.03f;
+            Transform transform;
+            transform.scale = 0.03f;
+            m_entity = m_registry.create(transform, Renderable{ shipModel, true }, shipLantern(renderer.getModel(shipModel).bounds));
+            updateTransform();
         }
 
         ~Ship() {}
@@ -265,22 +104,19 @@ namespace GameObject {
             float velocity = m_movementSpeed * deltaTime;
 
             if (movement == Ship_Movement::FORWARD) {
-                m_position += m_front * velocity;
-                for (auto& seagull : m_seagulls)
-                    seagull.m_position += m_front * velocity;
+                sail(m_front * velocity);
             } else if (movement == Ship_Movement::BACKWARD) {
-                m_position -= m_front * velocity;
-                for (auto& seagull : m_seagulls)
-                    seagull.m_position -= m_front * velocity;
+                sail(-m_front * velocity);
             } else if (movement == Ship_Movement::LEFT) {
                 turn(Ship_Movement::LEFT);
             } else if (movement == Ship_Movement::RIGHT) {
                 turn(Ship_Movement::RIGHT);
             }
+            updateTransform();
         }
 
         /// <summary>
-        /// Turns the ship around the y-axis. The seagulls follow accordingly.
+        /// Turns the ship around the y-axis.
         /// </summary>
         void turn(Ship_Movement turn) {
             if (turn == Ship_Movement::LEFT)
@@ -289,54 +125,93 @@ namespace GameObject {
                 m_angle -= 0.5f;
             m_front.x = glm::sin(glm::radians(m_angle));
             m_front.z = glm::cos(glm::radians(m_angle));
+        }
 
-            for (auto& seagull : m_seagulls) {
-                if (seagull.m_shipOffsets.x > 0) {
-                    seagull.m_position.x = m_position.x - glm::cos(glm::radians(m_angle)) * seagull.m_radius;
-                    seagull.m_position.z = m_position.z + glm::sin(glm::radians(m_angle)) * seagull.m_radius;
-                } else if (seagull.m_shipOffsets.x < 0) {
-                    seagull.m_position.x = m_position.x + glm::cos(glm::radians(m_angle)) * seagull.m_radius;
-                    seagull.m_position.z = m_position.z - glm::sin(glm::radians(m_angle)) * seagull.m_radius;
-                }
-                if (turn == Ship_Movement::LEFT)
-                    seagull.m_angle += 0.5f;
-                else if (turn == Ship_Movement::RIGHT)
-                    seagull.m_angle -= 0.5f;
-            }
+        /// <summary>
+        /// Sets the islands the ship cannot sail through. Without them, nothing stops it.
+        /// </summary>
+        void setCollision(const CollisionWorld* world) {
+            m_collision = world;
         }
 
         /// <summary>
-        /// Renders the ship.
+        /// Moves the flock of the seagulls after a point above the ship. The seagulls follow
+        /// their birds in Systems::follow().
         /// </summary>
-        void render(Shader& shader) {
-            m_shipModelMatrix = glm::translate(glm::mat4(1.0f), m_position);
-            m_shipModelMatrix = glm::rotate(m_shipModelMatrix, glm::radians(m_angle), glm::vec3(0.0f, 1.0f, 0.0f));
-            m_shipModelMatrix = glm::scale(m_shipModelMatrix, glm::vec3(0.03f, 0.03f, 0.03f));
-            shader.setMat4("model", m_shipModelMatrix);
-            m_shipModel.Draw(shader);
+        /// <param name="deltaTime">The time since the last frame.</param>
+        void updateSeagulls(float deltaTime) {
+            m_flock.setTarget(0, m_position + glm::vec3(0.0f, 1.0f, 0.0f));
+            m_flock.update(deltaTime);
         }
 
         /// <summary>
-        /// Creates the seagulls that will be following the ship. 
-        /// In this case, two seagulls will be created, one on the left and one 
-        /// on the right of the ship.
+        /// Floats the ship on the waves (see Buoyancy.h).
         /// </summary>
-        void populate(std::string& seagullModel) {
-            m_seagulls.emplace_back(seagullModel, glm::vec3(m_position.x + 1.0f, m_position.y + 1.0f, m_position.z), m_position);
-            m_seagulls.emplace_back(seagullModel, glm::vec3(m_position.x - 1.0f, m_position.y + 1.0f, m_position.z), m_position);
+        /// <param name="waves">The waves, updated to the current frame.</param>
+        /// <param name="deltaTime">The time since the last frame.</param>
+        void updateBuoyancy(const Waves& waves, float deltaTime) {
+            float halfLength = m_hullRadius * 0.6f;
+            Buoyancy hull(halfLength, halfLength * 0.3f);
+            float x[Buoyancy::POINTS], z[Buoyancy::POINTS], heights[Buoyancy::POINTS];
+            hull.samplePoints(glm::vec2(m_position.x, m_position.z), m_angle, x, z);
+            waves.sample(x, z, Buoyancy::POINTS, heights);
+            hull.settle(heights, deltaTime, m_pose);
+            updateTransform();
+        }
+
+        /// <summary>
+        /// Creates the seagulls that will be following the ship, as entities following the
+        /// birds of its flock. They are placed in turn on the right and on the left of the
+        /// ship, each pair a bit further out than the last.
+        /// </summary>
+        /// <param name="seagullModel">The index of the 3D model of the seagulls in the renderer.</param>
+        /// <param name="count">The number of seagulls.</param>
+        void populate(unsigned int seagullModel, int count = 2) {
+            for (int i = 0; i < count; i++) {
+                float offset = (i % 2 == 0 ? 1.0f : -1.0f) * (1.0f + 0.5f * (i / 2));
+                Transform transform;
+                transform.position = glm::vec3(m_position.x + offset, m_position.y + 1.0f, m_position.z);
+                transform.yaw = 180.0f;
+                transform.scale = 0.03f;
+                transform.update();
+                unsigned int bird = m_flock.addBird(transform.position, 0);
+                m_seagulls.push_back(m_registry.create(transform, Renderable{ seagullModel, true }, Follower{ &m_flock, bird }));
+            }
+        }
+
+        /// <summary>
+        /// Creates the bugs that circle every seagull. The bugs are too small to show up in
+        /// the shadows.
+        /// </summary>
+        /// <param name="bugModel">The index of the 3D model of the bugs in the renderer.</param>
+        /// <param name="count">The number of bugs of every seagull, placed in turn on the right and on the left.</param>
+        void populateBugs(unsigned int bugModel, int count = 2) {
+            // the bugs live in the space of their seagull, which is scaled down to 0.03
+            const float seagullScale = 0.03f;
+            for (Ecs::Entity seagull : m_seagulls) {
+                for (int i = 0; i < count; i++) {
+                    float radius = 0.2f * (1.0f + 0.5f * (i / 2)) / seagullScale;
+                    Orbit orbit{ radius, i % 2 == 0 ? glm::radians(90.0f) : glm::radians(270.0f), 0.6f };
+                    Transform transform;
+                    transform.position = glm::vec3(glm::sin(orbit.angle), 0.0f, glm::cos(orbit.angle)) * radius;
+                    transform.yaw = 180.0f;
+                    transform.scale = 0.0003f / seagullScale;
+                    m_registry.create(transform, Renderable{ bugModel, false }, orbit, Parent{ seagull });
+                }
+            }
         }
 
         // Getters
 
         /// <summary>
-        /// Returns the 3D model of the ship.
+        /// Returns the entity of the ship.
         /// </summary>
-        Model& getModel() {
-            return m_shipModel;
+        Ecs::Entity getEntity() const {
+            return m_entity;
         }
 
         /// <summary>
-        /// Returns the current position of the ship.
+        /// Returns the current position of the ship, on the flat sea.
         /// </summary>
         glm::vec3 getPosition() {
             return m_position;
@@ -350,9 +225,16 @@ namespace GameObject {
         }
 
         /// <summary>
-        /// Returns a reference to the vector with the Seagull objects.
+        /// Returns the flock the seagulls fly in, e.g. to change its settings.
         /// </summary>
-        std::vector<Seagull>& getSeagulls() {
+        Flock& getFlock() {
+            return m_flock;
+        }
+
+        /// <summary>
+        /// Returns the entities of the seagulls.
+        /// </summary>
+        const std::vector<Ecs::Entity>& getSeagulls() const {
             return m_seagulls;
         }
         
@@ -364,15 +246,56 @@ namespace GameObject {
         }
 
      private:
+        Ecs::Registry& m_registry;       ///< The entities of the game.
+        Ecs::Entity m_entity;            ///< The entity of the ship.
+
         float m_movementSpeed = 2.5f;    ///< The movement speed of the ship.
         float m_angle = 180.0f;          ///< The angle of the ship relative to the y-axis
-
-        Model m_shipModel;               ///< The 3D model of the ship.
+        float m_hullRadius = 1.0f;       ///< The radius of the model of the ship, scaled.
+        HullPose m_pose;                 ///< How the waves lift and tilt the ship.
 
         glm::vec3 m_position;            ///< The current position of the ship.
-        glm::mat4 m_shipModelMatrix;     ///< The ship's model matrix.
         glm::vec3 m_front;               ///< The ship's front vector.
 
-        std::vector<Seagull> m_seagulls; ///< Vector containing all the seagulls following  the ship.
+        std::vector<Ecs::Entity> m_seagulls; ///< The seagulls following the ship.
+        Flock m_flock;                   ///< Moves the seagulls.
+        const CollisionWorld* m_collision = nullptr; ///< The islands, may be null.
+
+        /// <summary>
+        /// Moves the ship, unless an island is in the way: then it stops at the shore and
+        /// slides along it with what is left of the move. The hull is taken as a circle, so
+        /// turning never runs it aground.
+        /// </summary>
+        void sail(const glm::vec3& move) {
+            glm::vec2 from(m_position.x, m_position.z);
+            glm::vec2 to = from + glm::vec2(move.x, move.z);
+            if (m_collision != nullptr) {
+                float radius = m_hullRadius * 0.3f;
+                SweepResult result = m_collision->sweep(from, to, radius);
+                if (result.hit) {
+                    glm::vec2 left = to - result.position;
+                    float into = glm::dot(left, result.normal);
+                    if (into < 0.0f)
+                        left -= result.normal * into;
+                    result = m_collision->sweep(result.position, result.position + left, radius);
+                }
+                to = result.position;
+            }
+            m_position.x = to.x;
+            m_position.z = to.y;
+        }
+
+        /// <summary>
+        /// Writes the position and angle, and the motion on the waves, to the Transform of the
+        /// entity. The position itself stays on the flat sea, for the camera and the seagulls.
+        /// </summary>
+        void updateTransform() {
+            Transform* transform = m_registry.get<Transform>(m_entity);
+            transform->position = m_position + glm::vec3(0.0f, m_pose.heave, 0.0f);
+            transform->yaw = m_angle;
+            transform->pitch = m_pose.pitch;
+            transform->roll = m_pose.roll;
+            transform->dirty = true;
+        }
     };
-}
\ No newline at end of file
+}
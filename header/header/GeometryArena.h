@@ -0,0 +1,132 @@
+/*********************************************************************
+ * \file   GeometryArena.h
+ * \brief  A shared vertex/index buffer that many meshes are packed into.
+ * Instead of every Mesh owning its own VAO, VBO and EBO, the meshes
+ * of a model (or of all the static models in the scene) are appended
+ * to one arena. Each mesh is then just a range inside the arena, and
+ * several ranges can be drawn with a single glMultiDrawElementsBaseVertex
+ * call while the VAO stays bound.
+ * The positions are also kept tightly packed in a buffer of their own,
+ * with a second VAO, for the passes that need nothing else (shadows):
+ * they fetch 12 bytes per vertex instead of a whole Vertex.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <Vertex.h>
+
+#include <vector>
+
+/// <summary>
+/// The location of a mesh inside a GeometryArena. The indices of the mesh
+/// are stored relative to its first vertex, so baseVertex must be passed
+/// to the draw call.
+/// </summary>
+struct ArenaRange {
+    unsigned int firstIndex = 0;  ///< Offset of the first index, in indices.
+    unsigned int indexCount = 0;  ///< Number of indices of the mesh.
+    int baseVertex = 0;           ///< Offset of the first vertex, in vertices.
+    unsigned int vertexCount = 0; ///< Number of vertices of the mesh.
+};
+
+/// <summary>
+/// \class GeometryArena
+/// Growable GPU vertex/index storage shared by many meshes. Meshes are staged
+/// on the CPU with append() and pushed to the GPU with upload(). Appending after
+/// an upload is allowed; the next upload() grows the buffers on the GPU side
+/// without re-sending the geometry that is already there.
+/// </summary>
+class GeometryArena {
+ public:
+    GeometryArena() {}
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    /// <summary>
+    /// Stages a mesh for upload and returns the range it will occupy.
+    /// </summary>
+    /// <param name="vertices">The vertices of the mesh.</param>
+    /// <param name="indices">The indices of the mesh, relative to its first vertex.</param>
+    /// <param name="material">Index of the mesh's material in the MaterialTable. It is stored
+    /// for every vertex and read by the shaders from attribute location 5.</param>
+    ArenaRange append(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int material = 0);
+
+    /// <summary>
+    /// Same as above, for meshes whose vertices do not all use the same material,
+    /// like the merged meshes of a StaticBatch.
+    /// </summary>
+    /// <param name="materials">The material index of every vertex.</param>
+    ArenaRange append(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<unsigned int>& materials);
+
+    /// <summary>
+    /// Sends all staged geometry to the GPU. Must be called with a current
+    /// OpenGL context, before any of the appended ranges is drawn.
+    /// </summary>
+    void upload();
+
+    /// <summary>
+    /// Binds the arena's VAO. Does nothing if it is already bound by a
+    /// previous call, so consecutive draws from one arena pay for one bind.
+    /// </summary>
+    void bind() const;
+
+    /// <summary>
+    /// Binds the position-only VAO, for depth passes. The ranges are the same as for bind().
+    /// </summary>
+    void bindDepth() const;
+
+    /// <summary>
+    /// Reads the per-instance model matrices of both VAOs from a buffer, at attribute
+    /// locations 6 to 9, for the INSTANCED shaders (see InstanceBuffer.h). The arena
+    /// must have been uploaded. Pointing them at the range they already read does nothing.
+    /// </summary>
+    /// <param name="offset">Where the first matrix is in the buffer, in bytes.</param>
+    void setInstanceBuffer(unsigned int buffer, size_t offset = 0);
+
+    /// <summary>
+    /// Forgets which VAO was bound through bind(). Call this after binding
+    /// another VAO directly with glBindVertexArray.
+    /// </summary>
+    static void invalidateBinding();
+
+    // Getters
+
+    unsigned int getVAO() const { return m_VAO; }
+    unsigned int getVertexCount() const { return m_vertexCount; }
+    unsigned int getIndexCount() const { return m_indexCount; }
+
+ private:
+    ArenaRange appendGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+    void createVertexArray();
+    void setVertexAttributes();
+    void setDepthAttributes();
+    static void setInstanceAttributes(unsigned int buffer, size_t offset);
+    void grow(unsigned int& buffer, size_t& capacity, size_t used, size_t needed);
+
+    unsigned int m_VAO = 0;                   ///< VAO describing the Vertex layout of the arena.
+    unsigned int m_VBO = 0;                   ///< Vertex buffer holding every appended vertex.
+    unsigned int m_MBO = 0;                   ///< Vertex buffer with the material index of every vertex.
+    unsigned int m_EBO = 0;                   ///< Index buffer holding every appended index.
+    unsigned int m_depthVAO = 0;              ///< VAO with only the positions, from m_PBO.
+    unsigned int m_PBO = 0;                   ///< Vertex buffer with the position of every vertex.
+    unsigned int m_instanceBuffer = 0;        ///< Where both VAOs read the instance matrices from.
+    size_t m_instanceOffset = 0;
+
+    size_t m_vertexCapacity = 0;              ///< Size of the VBO on the GPU, in bytes.
+    size_t m_materialCapacity = 0;            ///< Size of the MBO on the GPU, in bytes.
+    size_t m_indexCapacity = 0;               ///< Size of the EBO on the GPU, in bytes.
+    size_t m_positionCapacity = 0;            ///< Size of the PBO on the GPU, in bytes.
+
+    unsigned int m_vertexCount = 0;           ///< Vertices appended so far (staged and uploaded).
+    unsigned int m_indexCount = 0;            ///< Indices appended so far (staged and uploaded).
+    unsigned int m_uploadedVertices = 0;      ///< Vertices already on the GPU.
+    unsigned int m_uploadedIndices = 0;       ///< Indices already on the GPU.
+
+    std::vector<Vertex> m_stagedVertices;     ///< Vertices waiting for upload().
+    std::vector<unsigned int> m_stagedMaterials; ///< Material indices waiting for upload().
+    std::vector<unsigned int> m_stagedIndices;///< Indices waiting for upload().
+
+    static unsigned int s_boundVAO;           ///< The VAO last bound through bind().
+};
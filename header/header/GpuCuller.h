@@ -0,0 +1,181 @@
+/*********************************************************************
+ * \file   GpuCuller.h
+ * \brief  Culls the instances of a few models on the GPU and draws the
+ * visible ones with indirect draws.
+ * With instancing the draw calls of the fleet stay the same however
+ * many ships there are, but the CPU still tests every instance against
+ * the view before it uploads the visible ones (see Fleet::cull()).
+ * Here the matrices of all the instances are uploaded once, as they
+ * are, through the stream of the frame into one buffer. A compute
+ * shader tests every instance against the view, the draw distance of
+ * its model and the occlusion pyramid of the frame, appends the
+ * visible ones to the second half of the same buffer and counts them
+ * into the indirect draw commands of the model.
+ * Each material group of a model is then one glMultiDrawElementsIndirect,
+ * so the draws and the work of the CPU do not grow with the instances.
+ * The shadow passes draw every instance, from the first half.
+ * This needs OpenGL 4.3: compute shaders, storage buffers and indirect
+ * multi-draws. The game asks for such a context only when the settings
+ * enable the GPU culling (see Game.cpp). A glad loader generated for an
+ * older version builds the culler without them, never supported.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <Model.h>
+#include <OcclusionCuller.h>
+#include <Settings.h>
+#include <Shader.h>
+#include <ShaderVariants.h>
+#include <StreamBuffer.h>
+
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// The settings of the culling on the GPU, read from the settings file.
+/// </summary>
+struct GpuCullingSettings {
+    bool enabled = false;
+    float seagullDistance = 60.0f;  ///< The seagulls of the fleet farther than this are not drawn.
+    float bugDistance = 20.0f;      ///< Nor the bugs farther than this.
+
+    /// <summary>
+    /// Reads the "gpu_culling.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static GpuCullingSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class GpuCuller
+/// Once: addModel() for every model, and setInstanceBuffer() of their arenas to getBuffer().
+/// Every frame: setInstances() for every model and upload(), then drawDepth() for the
+/// shadows, cull() with the camera of the frame, and draw().
+/// </summary>
+class GpuCuller {
+ public:
+    /// <summary>
+    /// Returns whether the context has what the culling needs, OpenGL 4.3.
+    /// </summary>
+    static bool isSupported();
+
+    /// <param name="stream">The stream the matrices and the commands are written into every frame.</param>
+    explicit GpuCuller(StreamBuffer& stream);
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+
+    /// <summary>
+    /// Adds a model and returns its index. The model must stay alive as long as the culler.
+    /// </summary>
+    /// <param name="model">The model, with its own arena.</param>
+    /// <param name="maxDistance">Its instances farther than this from the camera are not
+    /// drawn. Zero draws them at any distance.</param>
+    unsigned int addModel(Model& model, float maxDistance = 0.0f);
+
+    /// <summary>
+    /// Sets the matrices of the instances of a model for this frame.
+    /// </summary>
+    void setInstances(unsigned int model, const std::vector<glm::mat4>& matrices);
+
+    /// <summary>
+    /// Uploads the matrices of all the models and resets the draw commands, copying them
+    /// from the stream into the buffers of the culler.
+    /// </summary>
+    void upload();
+
+    /// <summary>
+    /// Tests every instance on the GPU and fills the draw commands with the visible ones.
+    /// </summary>
+    /// <param name="occlusion">The occlusion culler of the frame, after finish(), if any.</param>
+    void cull(const glm::mat4& view, const glm::mat4& projection, const OcclusionCuller* occlusion);
+
+    /// <summary>
+    /// Draws the visible instances of every model, one indirect multi-draw per material group.
+    /// </summary>
+    void draw(ShaderVariants& shaders);
+
+    /// <summary>
+    /// Draws the positions of every instance of a model, culled or not, with one indirect
+    /// multi-draw. The instanced depth shader is set by the caller.
+    /// </summary>
+    void drawDepth(unsigned int model);
+
+    /// <summary>
+    /// Returns the buffer the INSTANCED shaders read the matrices from.
+    /// </summary>
+    unsigned int getBuffer() const { return m_matrixBuffer; }
+
+    size_t getInstanceCount() const { return m_instanceCount; }
+
+    /// <summary>
+    /// Returns the number of glMultiDrawElementsIndirect calls of draw().
+    /// </summary>
+    size_t getDrawCount() const { return m_drawCount; }
+
+ private:
+    /// <summary>
+    /// The DrawElementsIndirectCommand of OpenGL.
+    /// </summary>
+    struct Command {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    /// <summary>
+    /// A model as the compute shader reads it, in the std430 layout.
+    /// </summary>
+    struct CullModel {
+        glm::vec4 sphere;             ///< The bounding sphere in model space: center and radius.
+        GLuint firstInstance;         ///< Its instances in the first half of the matrix buffer.
+        GLuint instanceCount;
+        GLuint firstCommand;          ///< Its draw commands, whose instances it counts.
+        GLuint commandCount;
+        float maxDistance;
+        float padding[3];
+    };
+
+    /// <summary>
+    /// A model, and the material groups its draw commands are sorted by.
+    /// </summary>
+    struct Entry {
+        Model* model;
+        float maxDistance;
+        std::vector<glm::mat4> matrices;
+        struct Group {
+            unsigned int batch;       ///< The batch of the model the group draws.
+            GLuint firstCommand;
+            GLsizei commandCount;
+        };
+        std::vector<Group> groups;
+        GLuint firstDepthCommand = 0;
+        GLsizei depthCommandCount = 0;
+    };
+
+    void buildCommands();
+    void copyFromStream(const StreamRange& range, unsigned int buffer, size_t offset);
+    void uploadPyramid(const OcclusionCuller& occlusion);
+
+    StreamBuffer& m_stream;
+    std::unique_ptr<Shader> m_shader;
+    std::vector<Entry> m_entries;
+    std::vector<CullModel> m_models;
+    std::vector<Command> m_commands;      ///< The draw commands of every model, then their depth commands.
+    bool m_commandsBuilt = false;
+
+    unsigned int m_matrixBuffer = 0;      ///< The matrices of all the instances, then of the visible ones.
+    unsigned int m_modelBuffer = 0;
+    unsigned int m_commandBuffer = 0;
+    unsigned int m_pyramid = 0;           ///< A copy of the occlusion pyramid, one mipmap per level.
+    int m_pyramidWidth = 0;
+    int m_pyramidHeight = 0;
+    size_t m_instanceCount = 0;           ///< Of all the models, at the last upload().
+    size_t m_matrixCapacity = 0;          ///< Instances the matrix buffer has room for, in each half.
+    size_t m_drawCount = 0;
+};
@@ -0,0 +1,60 @@
+/*********************************************************************
+ * \file   InstanceBuffer.h
+ * \brief  The model matrices of many copies of one model.
+ * Drawing a model once per object costs a uniform upload and a draw
+ * call per object. With instancing the matrices of all the objects go
+ * into one buffer, which GeometryArena::setInstanceBuffer() hands to
+ * the INSTANCED shaders as a per-instance attribute, and the model is
+ * drawn once for all of them (see Model::DrawInstanced()). The matrices
+ * are written into the stream of the frame (see StreamBuffer.h), so an
+ * update is a copy into memory the GPU is done with.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <StreamBuffer.h>
+
+#include <vector>
+
+/// <summary>
+/// \class InstanceBuffer
+/// The model matrices of this frame, in a range of the stream.
+/// </summary>
+class InstanceBuffer {
+ public:
+    explicit InstanceBuffer(StreamBuffer& stream) :
+        m_stream(stream)
+    {
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    /// <summary>
+    /// Writes the matrices of this frame into the stream. They move to another range every
+    /// time, so the arenas reading them must be pointed at getBuffer() and getOffset() again.
+    /// </summary>
+    void update(const std::vector<glm::mat4>& matrices) {
+        m_range = m_stream.write(matrices.data(), matrices.size() * sizeof(glm::mat4), sizeof(glm::mat4));
+        m_count = static_cast<GLsizei>(matrices.size());
+    }
+
+    unsigned int getBuffer() const { return m_range.buffer; }
+
+    /// <summary>
+    /// Returns where the matrices of the last update() start in getBuffer(), in bytes.
+    /// </summary>
+    size_t getOffset() const { return m_range.offset; }
+
+    /// <summary>
+    /// Returns the number of matrices of the last update().
+    /// </summary>
+    GLsizei getCount() const { return m_count; }
+
+ private:
+    StreamBuffer& m_stream;
+    StreamRange m_range;
+    GLsizei m_count = 0;
+};
@@ -0,0 +1,159 @@
+/*********************************************************************
+ * \file   LightClusters.h
+ * \brief  Many point lights, shaded only where they reach.
+ * Looping over every light in every fragment costs as much for a
+ * lantern on the far side of the world as for one next to the camera.
+ * The view frustum is cut into clusters instead: tiles across the
+ * screen, and slices along the depth, thinner near the camera. Every
+ * frame the lights are binned into the clusters they touch, on all the
+ * cores, one range of slices per worker. The lights, the range of
+ * every cluster and the lists of lights go to the POINT_LIGHTS shaders
+ * in texture buffers (there are no storage buffers in OpenGL 3.3), and
+ * a fragment only shades the lights of its own cluster.
+ * A cluster holds at most maxPerCluster lights, the nearest ones to the
+ * camera first, so the cost of a fragment stays bounded however many
+ * lights there are.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <FrameUniforms.h>
+#include <Settings.h>
+
+#include <vector>
+
+/// <summary>
+/// The cost/quality knobs of the point lights, read from the settings file.
+/// </summary>
+struct LightSettings {
+    bool enabled = true;
+    int tilesX = 16;             ///< Clusters across the screen.
+    int tilesY = 9;              ///< Clusters down the screen.
+    int slices = 24;             ///< Clusters along the depth.
+    int maxLights = 4096;        ///< Lights beyond this many in a frame are dropped.
+    int maxPerCluster = 64;      ///< The most lights a fragment shades.
+    float distance = 100.0f;     ///< How far from the camera the clusters reach.
+
+    /// <summary>
+    /// Reads the "lights.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static LightSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class LightClusters
+/// Every frame: clear(), add() every light, then update() bins them into the clusters and
+/// uploads them, and setUniforms() and bindTextures() hand them to the lit shaders.
+/// </summary>
+class LightClusters {
+ public:
+    explicit LightClusters(const LightSettings& settings);
+    ~LightClusters();
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    /// <summary>
+    /// Forgets the lights of the last frame.
+    /// </summary>
+    void clear() { m_lights.clear(); }
+
+    /// <summary>
+    /// Adds a light for this frame. Does nothing once there are maxLights.
+    /// </summary>
+    /// <param name="position">Where it is, in the world.</param>
+    /// <param name="radius">How far it reaches. It fades to nothing there.</param>
+    /// <param name="color">Its color, times its intensity.</param>
+    void add(const glm::vec3& position, float radius, const glm::vec3& color);
+
+    /// <summary>
+    /// Bins the lights into the clusters of the camera and uploads them.
+    /// </summary>
+    /// <param name="view">The view matrix of the camera.</param>
+    /// <param name="projection">The projection matrix of the camera.</param>
+    /// <param name="nearPlane">The near plane of the projection.</param>
+    /// <param name="width">The width of the viewport, in pixels.</param>
+    /// <param name="height">The height of the viewport, in pixels.</param>
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, int width, int height);
+
+    /// <summary>
+    /// Fills the cluster part of the Frame block: how a fragment finds its cluster.
+    /// </summary>
+    void setUniforms(FrameUniforms& frame) const;
+
+    /// <summary>
+    /// Binds the texture buffers of the clusters, the light lists and the lights to three
+    /// texture units in a row, starting at firstUnit.
+    /// </summary>
+    void bindTextures(unsigned int firstUnit) const;
+
+    size_t getLightCount() const { return m_lights.size(); }
+
+    /// <summary>
+    /// Returns the number of light references of the last update(), over all the clusters.
+    /// </summary>
+    size_t getReferenceCount() const { return m_indices.size(); }
+
+    /// <summary>
+    /// Returns the number of lights of the busiest cluster of the last update().
+    /// </summary>
+    unsigned int getBusiestCluster() const { return m_busiest; }
+
+    const LightSettings& getSettings() const { return m_settings; }
+
+ private:
+    /// <summary>
+    /// A light as the shaders read it: two texels of the light buffer.
+    /// </summary>
+    struct Light {
+        glm::vec4 positionRadius;
+        glm::vec4 color;
+    };
+
+    /// <summary>
+    /// The clusters a light touches, as ranges of tiles and slices, inclusive.
+    /// </summary>
+    struct Extent {
+        int minX, maxX;
+        int minY, maxY;
+        int minSlice, maxSlice;     ///< maxSlice < minSlice if the light is out of view.
+        float depth;                ///< The view depth of the center, to keep the nearest lights.
+    };
+
+    /// <summary>
+    /// A texture buffer: the buffer and the texture that reads it.
+    /// </summary>
+    struct TextureBuffer {
+        unsigned int buffer = 0;
+        unsigned int texture = 0;
+    };
+
+    void fitTextureBuffers();
+    int sliceOf(float depth) const;
+    Extent extentOf(const Light& light, const glm::mat4& view, const glm::mat4& projection) const;
+    void binSlices(int begin, int end);
+    static TextureBuffer createTextureBuffer(GLenum format, size_t bytes);
+
+    LightSettings m_settings;
+    float m_near = 0.1f;
+    float m_sliceScale = 0.0f;      ///< Slices per unit of log(depth).
+    float m_sliceBias = 0.0f;
+    glm::vec2 m_tileScale = glm::vec2(0.0f); ///< Tiles per pixel.
+
+    std::vector<Light> m_lights;
+    std::vector<Extent> m_extents;          ///< By light.
+    std::vector<unsigned int> m_order;      ///< The lights, nearest first.
+    // the lists of the clusters while they are binned, maxPerCluster entries each
+    std::vector<unsigned int> m_slots;
+    std::vector<unsigned int> m_counts;     ///< By cluster.
+    // what is uploaded: the offset and count of every cluster, and the lists one after another
+    std::vector<glm::uvec2> m_ranges;
+    std::vector<unsigned int> m_indices;
+    unsigned int m_busiest = 0;
+
+    TextureBuffer m_clusterBuffer;          ///< RG32UI, by cluster.
+    TextureBuffer m_indexBuffer;            ///< R32UI.
+    TextureBuffer m_lightBuffer;            ///< RGBA32F, two texels by light.
+};
@@ -0,0 +1,133 @@
+/*********************************************************************
+ * \file   MaterialTable.h
+ * \brief  Textures packed into texture arrays, and the materials using them.
+ * Binding a separate texture for every mesh costs a texture bind and
+ * a sampler uniform per draw, and it forces one draw call per material.
+ * The MaterialTable packs all the textures with the same size into the
+ * layers of one GL_TEXTURE_2D_ARRAY. A material then becomes a pair of
+ * layer numbers, looked up in the shaders through the material index
+ * stored with every vertex, so all the meshes whose textures share the
+ * same arrays can be drawn together without touching the bindings.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <Vertex.h>
+#include <Shader.h>
+#include <ShaderVariants.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// \class MaterialTable
+/// Materials are registered while the models load, with addMaterial(), which only records
+/// the file names. build() then decodes the images and fills the texture arrays. After
+/// that, apply() gives the layer table to a shader, and bind() binds the arrays of a group.
+/// </summary>
+class MaterialTable {
+ public:
+    /// <summary>
+    /// The maximum number of materials. It must match MAX_MATERIALS in the shaders.
+    /// </summary>
+    static const unsigned int MAX_MATERIALS = 128;
+
+    MaterialTable() {}
+    ~MaterialTable();
+
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+
+    /// <summary>
+    /// Registers the material of a mesh and returns its index. Materials using
+    /// the same diffuse and specular images get the same index.
+    /// </summary>
+    /// <param name="textures">The textures of the mesh. Only the first diffuse and
+    /// the first specular texture are used, as in the fragment shader.</param>
+    /// <param name="directory">The directory the texture paths are relative to.</param>
+    unsigned int addMaterial(const std::vector<Texture>& textures, const std::string& directory);
+
+    /// <summary>
+    /// Loads all the registered images into texture arrays, one array per image size.
+    /// Must be called with a current OpenGL context, after all models are loaded.
+    /// </summary>
+    void build();
+
+    /// <summary>
+    /// Uploads the layer table to the shader and points its samplers to the texture units
+    /// used by bind(). Needed once per shader program, after build().
+    /// </summary>
+    void apply(Shader& shader) const;
+
+    /// <summary>
+    /// Returns the group of a material. Materials in the same group use the same texture
+    /// arrays, so they can be drawn together after a single bind().
+    /// </summary>
+    unsigned int getGroup(unsigned int material) const {
+        return m_materials[material].group;
+    }
+
+    /// <summary>
+    /// Returns the shader features (SHADER_DIFFUSE_MAP, SHADER_SPECULAR_MAP) a group needs.
+    /// Every material of a group has the same maps, so the whole group runs one variant.
+    /// </summary>
+    unsigned int getFeatures(unsigned int group) const {
+        const std::pair<int, int>& arrays = m_groups[group];
+        return (arrays.first >= 0 ? SHADER_DIFFUSE_MAP : 0u) | (arrays.second >= 0 ? SHADER_SPECULAR_MAP : 0u);
+    }
+
+    /// <summary>
+    /// Binds the texture arrays of a group. Does nothing if the group is already bound.
+    /// </summary>
+    void bind(unsigned int group) const;
+
+    // Getters
+
+    bool isBuilt() const { return m_built; }
+    size_t getMaterialCount() const { return m_materials.size(); }
+    size_t getArrayCount() const { return m_arrays.size(); }
+    size_t getGroupCount() const { return m_groups.size(); }
+
+ private:
+    static const unsigned int NO_GROUP = 0xffffffffu;
+
+    /// <summary>
+    /// The two images of a material and where they ended up.
+    /// </summary>
+    struct Material {
+        std::string diffusePath;
+        std::string specularPath;
+        int diffuseLayer = -1;      ///< Layer in the diffuse array, -1 if the material has no diffuse map.
+        int specularLayer = -1;     ///< Layer in the specular array, -1 if the material has no specular map.
+        unsigned int group = 0;     ///< Index in m_groups.
+    };
+
+    /// <summary>
+    /// One GL_TEXTURE_2D_ARRAY holding all the images of one size.
+    /// </summary>
+    struct Array {
+        unsigned int id = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<std::string> layers; ///< The image of every layer.
+    };
+
+    /// <summary>
+    /// Where an image was placed.
+    /// </summary>
+    struct Slot {
+        int array = -1;
+        int layer = -1;
+    };
+
+    Slot place(const std::string& path, std::map<std::pair<int, int>, int>& arrayOfSize);
+
+    std::vector<Material> m_materials;                        ///< All registered materials.
+    std::vector<Array> m_arrays;                              ///< The texture arrays.
+    std::vector<std::pair<int, int>> m_groups;                ///< Diffuse and specular array of each group, -1 for none.
+    std::map<std::pair<std::string, std::string>, unsigned int> m_materialOfPaths; ///< Deduplicates the materials.
+    bool m_built = false;                                     ///< Whether build() has run.
+    mutable unsigned int m_boundGroup = NO_GROUP;             ///< The group bound by the last bind().
+};
@@ -0,0 +1,184 @@
+/*********************************************************************
+ * \file   Memory.h
+ * \brief  Arenas and pools, so the game does not hit the heap every frame.
+ * - The frame arena holds what lives for one frame only: the scratch
+ *   lists of the systems and of the world streamer. Allocating from it
+ *   is a pointer bump, and beginFrame() takes all of it back at once.
+ * - The load arena holds the staging buffers of a load, taken back when
+ *   the ScopedArena around the load ends. Every thread has its own, so
+ *   the loader thread of the WorldStreamer can use it too.
+ * - A BlockPool hands out blocks of one size and keeps the ones given
+ *   back for the next request. The chunks of the entities come from one
+ *   (see Ecs.h), so islands streaming in and out reuse the same memory.
+ * The arenas keep their memory when they are reset, so after the first
+ * frames they stop allocating. The counters count every allocation of
+ * the global operator new, to check that a frame makes none.
+ *********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Memory {
+
+    /// <summary>
+    /// The allocations of the global operator new since the start of the game.
+    /// </summary>
+    struct Counters {
+        size_t allocations = 0;
+        size_t frees = 0;
+        size_t bytes = 0;           ///< The bytes asked for by all the allocations.
+    };
+
+    /// <summary>
+    /// Returns the counters, from all the threads.
+    /// </summary>
+    Counters counters();
+
+    /// <summary>
+    /// \class LinearArena
+    /// Memory handed out in order from big blocks. Nothing is freed on its own: mark() and
+    /// rewind() take back everything allocated in between, and reset() takes back all of it.
+    /// Not thread safe.
+    /// </summary>
+    class LinearArena {
+     public:
+        /// <summary>
+        /// Where the arena is, to rewind() to.
+        /// </summary>
+        struct Marker {
+            size_t block = 0;
+            size_t offset = 0;
+        };
+
+        /// <param name="blockSize">The size of the blocks. Bigger allocations get a block of their own.</param>
+        explicit LinearArena(size_t blockSize = 1024 * 1024) : m_blockSize(blockSize) {}
+
+        LinearArena(const LinearArena&) = delete;
+        LinearArena& operator=(const LinearArena&) = delete;
+
+        /// <summary>
+        /// Returns memory for size bytes. It is valid until the arena is rewound past it.
+        /// </summary>
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        Marker mark() const { return { m_block, m_offset }; }
+        void rewind(const Marker& marker);
+        void reset() { rewind(Marker()); }
+
+        size_t getUsedBytes() const;
+        size_t getPeakBytes() const { return m_peak; }
+        size_t getCapacity() const;
+
+     private:
+        struct Block {
+            std::unique_ptr<std::max_align_t[]> data;
+            size_t size = 0;
+        };
+
+        size_t m_blockSize;
+        std::vector<Block> m_blocks;
+        size_t m_block = 0;         ///< The block being filled.
+        size_t m_offset = 0;        ///< The first free byte in it.
+        size_t m_peak = 0;
+    };
+
+    /// <summary>
+    /// A standard allocator over an arena, for containers of temporaries. Deallocating does
+    /// nothing: the memory comes back when the arena is rewound, which the container must
+    /// not outlive.
+    /// </summary>
+    template <typename T>
+    class ArenaAllocator {
+     public:
+        using value_type = T;
+
+        explicit ArenaAllocator(LinearArena& arena) : m_arena(&arena) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+        T* allocate(size_t count) { return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T))); }
+        void deallocate(T*, size_t) {}
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+     private:
+        LinearArena* m_arena;
+
+        template <typename U>
+        friend class ArenaAllocator;
+    };
+
+    template <typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+    /// <summary>
+    /// \class ScopedArena
+    /// Rewinds an arena to where it was when the scope started.
+    /// </summary>
+    class ScopedArena {
+     public:
+        explicit ScopedArena(LinearArena& arena) : m_arena(arena), m_marker(arena.mark()) {}
+        ~ScopedArena() { m_arena.rewind(m_marker); }
+
+        ScopedArena(const ScopedArena&) = delete;
+        ScopedArena& operator=(const ScopedArena&) = delete;
+
+        LinearArena& arena() { return m_arena; }
+
+     private:
+        LinearArena& m_arena;
+        LinearArena::Marker m_marker;
+    };
+
+    /// <summary>
+    /// The arena of the current frame. For the main thread only.
+    /// </summary>
+    LinearArena& frameArena();
+
+    /// <summary>
+    /// The load arena of the calling thread. Use it inside a ScopedArena.
+    /// </summary>
+    LinearArena& loadArena();
+
+    /// <summary>
+    /// Takes back the frame arena. Call it at the start of every frame.
+    /// </summary>
+    void beginFrame();
+
+    /// <summary>
+    /// \class BlockPool
+    /// Blocks of one size. The blocks given back are kept for the next acquire(), and only
+    /// freed with the pool. Not thread safe.
+    /// </summary>
+    class BlockPool {
+     public:
+        explicit BlockPool(size_t blockSize) : m_blockSize(blockSize) {}
+
+        BlockPool(const BlockPool&) = delete;
+        BlockPool& operator=(const BlockPool&) = delete;
+
+        /// <summary>
+        /// Returns a block, aligned for any type.
+        /// </summary>
+        void* acquire();
+
+        /// <summary>
+        /// Gives a block back to the pool.
+        /// </summary>
+        void release(void* block) { m_free.push_back(block); }
+
+        size_t getBlockSize() const { return m_blockSize; }
+        size_t getBlockCount() const { return m_blocks.size(); }
+        size_t getFreeCount() const { return m_free.size(); }
+
+     private:
+        size_t m_blockSize;
+        std::vector<std::unique_ptr<std::max_align_t[]>> m_blocks;
+        std::vector<void*> m_free;
+    };
+}
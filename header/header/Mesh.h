@@ -6,29 +6,55 @@
 #include <matrix_transform.hpp>
 
 #include <Shader.h>
+#include <Vertex.h>
+#include <GeometryArena.h>
 
+#include <cstdio>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-};
-
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
-};
+// binds the given textures to consecutive texture units and points the material samplers at them
+inline void BindMaterialTextures(const vector<Texture>& textures, Shader& shader)
+{
+    // bind appropriate textures
+    unsigned int diffuseNr = 1;
+    unsigned int specularNr = 1;
+    unsigned int normalNr = 1;
+    unsigned int heightNr = 1;
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+        // retrieve texture number (the N in diffuse_textureN)
+        unsigned int number = 0;
+        const string& name = textures[i].type;
+        if (name == "texture_diffuse")
+            number = diffuseNr++;
+        else if (name == "texture_specular")
+            number = specularNr++;
+        else if (name == "texture_normal")
+            number = normalNr++;
+        else if (name == "texture_height")
+            number = heightNr++;
+
+        // the uniform name is put together on the stack, so binding the textures does not allocate
+        char uniform[64];
+        if (number > 0)
+            snprintf(uniform, sizeof(uniform), "material.%s%u", name.c_str(), number);
+        else
+            snprintf(uniform, sizeof(uniform), "material.%s", name.c_str());
+
+        // now set the sampler to the correct texture unit
+        glUniform1i(glGetUniformLocation(shader.ID, uniform), i);
+        // and finally bind the texture
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
+}
+
+// passed to the constructors of Mesh and Model for geometry that is only read on the CPU (e.g. the
+// islands baked into a StaticBatch): it is neither appended to an arena nor given buffers of its own
+struct SourceOnly {};
 
 class Mesh {
 public:
@@ -37,56 +63,74 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // index of the material of the mesh inside its model, meshes sharing it use the same textures
+    unsigned int materialIndex;
+    // index of the material of the mesh in the MaterialTable, if the model uses one
+    unsigned int tableMaterial;
+    // where the mesh lives when it is packed into a GeometryArena
+    GeometryArena* arena;
+    ArenaRange range;
+
+    // constructor. When an arena is given the mesh is appended to it instead of getting its own buffers,
+    // and the arena has to be uploaded before the mesh is drawn.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GeometryArena* arena = nullptr, unsigned int materialIndex = 0, unsigned int tableMaterial = 0)
+        : VAO(0), materialIndex(materialIndex), tableMaterial(tableMaterial), arena(arena)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (arena != nullptr)
+            range = arena->append(this->vertices, this->indices, tableMaterial);
+        else
+            setupMesh();
+    }
+
+    // constructor for a mesh that is never drawn itself, only read by whatever copies it elsewhere
+    Mesh(SourceOnly, vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, unsigned int materialIndex = 0, unsigned int tableMaterial = 0)
+        : VAO(0), materialIndex(materialIndex), tableMaterial(tableMaterial), arena(nullptr), VBO(0), EBO(0)
+    {
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
     }
 
     // render the mesh
     void Draw(Shader& shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, ("material." + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
+        BindTextures(shader);
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        DrawGeometry();
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // binds the textures of the mesh and points the material samplers at them
+    void BindTextures(Shader& shader)
+    {
+        BindMaterialTextures(textures, shader);
+    }
+
+    // issues the draw call of the mesh, without touching the textures
+    void DrawGeometry()
+    {
+        if (arena != nullptr)
+        {
+            arena->bind();
+            glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+        }
+        else
+        {
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+            GeometryArena::invalidateBinding();
+        }
+    }
+
 private:
     // render data 
     unsigned int VBO, EBO;
@@ -128,5 +172,6 @@ private:
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
         glBindVertexArray(0);
+        GeometryArena::invalidateBinding();
     }
 };
\ No newline at end of file
@@ -4,18 +4,21 @@
 #include <glm.hpp>
 #include <matrix_transform.hpp>
 #include <stb_image.h>
-#include <Importer.hpp>
-#include <scene.h>
-#include <postprocess.h>
 
 #include <..\header\Mesh.h>
+#include <MaterialTable.h>
+#include <Bounds.h>
+#include <FileSystem.h>
+#include <ModelImporter.h>
 #include <Shader.h>
+#include <ShaderVariants.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -29,169 +32,282 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // the vertex/index arena all meshes of the model are packed into. It is either private to the model,
+    // or shared with other models (e.g. all the static models of the scene) when one is passed to the constructor.
+    shared_ptr<GeometryArena> arena;
+    // the table the materials of the model are registered in. When set, the textures are not loaded
+    // one by one but packed into the table's texture arrays by MaterialTable::build().
+    MaterialTable* materialTable;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // one multi-draw per material (or per group of the material table): the ranges of all meshes that share it
+    struct DrawBatch {
+        unsigned int meshIndex;      // first mesh of the batch, its textures are bound for the whole batch
+        unsigned int group;          // group of the material table, when the model uses one
+        vector<GLsizei> counts;
+        vector<const void*> offsets;
+        vector<GLint> baseVertices;
+    };
+    vector<DrawBatch> batches;
+    // all the meshes in one batch, for the depth passes, which need no textures
+    DrawBatch depthBatch;
+    // a sphere around all the meshes, in model space
+    BoundingSphere bounds;
+
+    // constructor, expects a filepath to a 3D model. If no arena is given the model creates and uploads its own,
+    // otherwise the caller uploads the shared arena once all models using it have been loaded.
+    // With a material table, the table has to be built before the model is drawn.
+    Model(string const& path, bool gamma = false, shared_ptr<GeometryArena> sharedArena = nullptr, MaterialTable* table = nullptr)
+        : gammaCorrection(gamma), arena(sharedArena), materialTable(table), batchesBuilt(false)
     {
+        if (!arena)
+            arena = make_shared<GeometryArena>();
         loadModel(path);
+        if (!sharedArena)
+            arena->upload();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // constructor from a model that was already imported (e.g. on a loader thread, see WorldStreamer.h),
+    // so only the GPU half of the loading is left. The path is only used to find the textures.
+    Model(ModelData& data, string const& path, bool gamma = false, shared_ptr<GeometryArena> sharedArena = nullptr, MaterialTable* table = nullptr)
+        : gammaCorrection(gamma), arena(sharedArena), materialTable(table), batchesBuilt(false)
     {
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        if (!arena)
+            arena = make_shared<GeometryArena>();
+        processModel(data, path);
+        if (!sharedArena)
+            arena->upload();
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
+    // constructor for a model that is never drawn itself, only read on the CPU (e.g. baked into a
+    // StaticBatch, see WorldStreamer.h): the meshes keep their vertices and indices and register their
+    // materials in the table, but nothing is staged in an arena or loaded into OpenGL. It has no batches.
+    Model(SourceOnly, ModelData& data, string const& path, MaterialTable* table = nullptr)
+        : gammaCorrection(false), materialTable(table), sourceOnly(true), batchesBuilt(false)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
-        }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('\\'));
-
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processModel(data, path);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // draws the model, and thus all its meshes. Meshes sharing a material are submitted together
+    // with one glMultiDrawElementsBaseVertex call and the arena VAO is bound at most once.
+    // With a material table, a batch spans all meshes whose textures live in the same arrays.
+    void Draw(Shader& shader)
     {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
-        {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
-        }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        // the groups of the material table are only known after it is built, so the batches are built on first use
+        if (!batchesBuilt)
+            buildBatches();
+        if (batches.empty())
+            return;
+
+        arena->bind();
+        for (unsigned int i = 0; i < batches.size(); i++)
         {
-            processNode(node->mChildren[i], scene);
+            DrawBatch& batch = batches[i];
+            if (materialTable != nullptr)
+                materialTable->bind(batch.group);
+            else
+                meshes[batch.meshIndex].BindTextures(shader);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), GL_UNSIGNED_INT, batch.offsets.data(), static_cast<GLsizei>(batch.counts.size()), batch.baseVertices.data());
         }
-
+        glActiveTexture(GL_TEXTURE0);
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // draws the model with the shader variant each batch needs: a batch whose material has no
+    // specular map runs a program without the specular fetch. The model matrix is taken from
+    // ShaderVariants::setModel(). Without a material table the textures are bound as above.
+    void Draw(ShaderVariants& shaders)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        if (!batchesBuilt)
+            buildBatches();
+        if (batches.empty())
+            return;
 
-        // walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        arena->bind();
+        for (unsigned int i = 0; i < batches.size(); i++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
+            DrawBatch& batch = batches[i];
+            if (materialTable != nullptr)
             {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                shaders.use(materialTable->getFeatures(batch.group));
+                materialTable->bind(batch.group);
             }
-            // texture coordinates
-            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            else
+                meshes[batch.meshIndex].BindTextures(shaders.use(0));
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), GL_UNSIGNED_INT, batch.offsets.data(), static_cast<GLsizei>(batch.counts.size()), batch.baseVertices.data());
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws instanceCount copies of the model, with the INSTANCED variants: the model matrices come from
+    // the instance buffer set on the arena (GeometryArena::setInstanceBuffer()). There is no instanced
+    // multi-draw before GL 4.3, so every mesh range is one draw call, however many instances there are.
+    void DrawInstanced(ShaderVariants& shaders, GLsizei instanceCount)
+    {
+        if (!batchesBuilt)
+            buildBatches();
+        if (batches.empty() || instanceCount == 0)
+            return;
+
+        arena->bind();
+        for (unsigned int i = 0; i < batches.size(); i++)
+        {
+            DrawBatch& batch = batches[i];
+            if (materialTable != nullptr)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                shaders.use(materialTable->getFeatures(batch.group) | SHADER_INSTANCED);
+                materialTable->bind(batch.group);
             }
             else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
+                meshes[batch.meshIndex].BindTextures(shaders.use(SHADER_INSTANCED));
+            for (unsigned int j = 0; j < batch.counts.size(); j++)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.counts[j], GL_UNSIGNED_INT, batch.offsets[j], instanceCount, batch.baseVertices[j]);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the multi-draw batches and the depth batch, built on first use like in Draw(), for the
+    // callers that submit the ranges themselves (see GpuCuller.h)
+    const vector<DrawBatch>& getBatches()
+    {
+        if (!batchesBuilt)
+            buildBatches();
+        return batches;
+    }
+
+    const DrawBatch& getDepthBatch()
+    {
+        if (!batchesBuilt)
+            buildBatches();
+        return depthBatch;
+    }
+
+    // draws only the positions of all the meshes, with one call, for the shadow maps.
+    // The depth shader and its model matrix are set by the caller
+    void DrawDepth()
+    {
+        if (!batchesBuilt)
+            buildBatches();
+        if (depthBatch.counts.empty())
+            return;
+
+        arena->bindDepth();
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, depthBatch.counts.data(), GL_UNSIGNED_INT, depthBatch.offsets.data(), static_cast<GLsizei>(depthBatch.counts.size()), depthBatch.baseVertices.data());
+    }
+
+    // draws the positions of instanceCount copies, for the shadow maps, with the instanced depth shader
+    void DrawDepthInstanced(GLsizei instanceCount)
+    {
+        if (!batchesBuilt)
+            buildBatches();
+        if (depthBatch.counts.empty() || instanceCount == 0)
+            return;
+
+        arena->bindDepth();
+        for (unsigned int j = 0; j < depthBatch.counts.size(); j++)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, depthBatch.counts[j], GL_UNSIGNED_INT, depthBatch.offsets[j], instanceCount, depthBatch.baseVertices[j]);
+    }
+
+private:
+    bool sourceOnly = false;
+    bool batchesBuilt;
+
+    // loads a model with supported ASSIMP extensions (or its preprocessed .mesh file) and stores the resulting meshes in the meshes vector.
+    void loadModel(string const& path)
+    {
+        // the CPU part of the import: vertices, indices and texture paths
+        ModelData data;
+        if (!ModelImporter::import(path, data))
+            return;
+        processModel(data, path);
+    }
+
+    // turns the imported meshes into Mesh objects, appended to the arena
+    void processModel(ModelData& data, string const& path)
+    {
+        // retrieve the directory path of the filepath, which may use either separator (see Vfs::normalize)
+        directory = path.substr(0, path.find_last_of("/\\"));
+
+        meshes.reserve(data.meshes.size());
+        BoundingBox box;
+        for (MeshData& mesh : data.meshes)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            for (const Vertex& vertex : mesh.vertices)
+                box.add(vertex.Position);
+            meshes.push_back(processMesh(mesh));
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        bounds = box.sphere();
+    }
+
+    Mesh processMesh(MeshData& mesh)
+    {
+        // load the textures of the mesh, skipping the ones this model already loaded
+        vector<Texture> textures = loadMaterialTextures(mesh.textures);
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        unsigned int tableMaterial = materialTable != nullptr ? materialTable->addMaterial(textures, directory) : 0;
+        if (sourceOnly)
+            return Mesh(SourceOnly{}, std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), mesh.materialIndex, tableMaterial);
+        return Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), arena.get(), mesh.materialIndex, tableMaterial);
+    }
+
+    // groups the mesh ranges by material, so that each material costs one texture bind and one draw call
+    void buildBatches()
+    {
+        batches.clear();
+        depthBatch = DrawBatch();
+        batchesBuilt = true;
+        map<unsigned int, unsigned int> batchOfMaterial;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const Mesh& mesh = meshes[i];
+            if (mesh.range.indexCount == 0)
+                continue;
+
+            unsigned int key = materialTable != nullptr ? materialTable->getGroup(mesh.tableMaterial) : mesh.materialIndex;
+            auto found = batchOfMaterial.find(key);
+            if (found == batchOfMaterial.end())
+            {
+                found = batchOfMaterial.emplace(key, static_cast<unsigned int>(batches.size())).first;
+                batches.emplace_back();
+                batches.back().meshIndex = i;
+                batches.back().group = key;
+            }
+
+            DrawBatch& batch = batches[found->second];
+            batch.counts.push_back(static_cast<GLsizei>(mesh.range.indexCount));
+            batch.offsets.push_back((const void*)(mesh.range.firstIndex * sizeof(unsigned int)));
+            batch.baseVertices.push_back(mesh.range.baseVertex);
+
+            depthBatch.counts.push_back(static_cast<GLsizei>(mesh.range.indexCount));
+            depthBatch.offsets.push_back((const void*)(mesh.range.firstIndex * sizeof(unsigned int)));
+            depthBatch.baseVertices.push_back(mesh.range.baseVertex);
+        }
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // checks the textures a mesh refers to and loads the ones that are not loaded yet.
+    // the required info is returned as Texture structs.
+    vector<Texture> loadMaterialTextures(const vector<Texture>& wanted)
     {
         vector<Texture> textures;
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        textures.reserve(wanted.size());
+        for (const Texture& want : wanted)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
             bool skip = false;
             for (unsigned int j = 0; j < textures_loaded.size(); j++)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if (textures_loaded[j].path == want.path)
                 {
                     textures.push_back(textures_loaded[j]);
+                    textures.back().type = want.type;
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
                     break;
                 }
             }
             if (!skip)
             {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
+                Texture texture = want;
+                // with a material table the image ends up in one of its texture arrays instead
+                texture.id = materialTable != nullptr || sourceOnly ? 0 : TextureFromFile(want.path.c_str(), this->directory);
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
             }
@@ -210,7 +326,10 @@ inline unsigned int TextureFromFile(const char* path, const string& directory, b
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    unsigned char* data = nullptr;
+    FileSystem::FileView file = FileSystem::vfs().open(filename);
+    if (file)
+        data = stbi_load_from_memory(file.bytes(), static_cast<int>(file.size()), &width, &height, &nrComponents, 0);
     if (data)
     {
         GLenum format;
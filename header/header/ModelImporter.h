@@ -0,0 +1,78 @@
+/*********************************************************************
+ * \file   ModelImporter.h
+ * \brief  Loads the meshes of a model into memory, without OpenGL.
+ * This is the CPU half of loading a Model: it turns a model file into
+ * vertices, indices and texture paths, and nothing in here needs an
+ * OpenGL context. The GPU half (textures, arenas) stays in Model. The
+ * split lets the asset packer, which runs without a window, import the
+ * models ahead of time and store the result as a .mesh file that the
+ * game then loads instead of running Assimp again.
+ * The import flattens the model: the transforms of Assimp's nodes are
+ * baked into the vertices, and the meshes that share a material are
+ * merged into one, so a model is one draw range per material however
+ * many parts it was made of. The .mesh files store the flat result.
+ *********************************************************************/
+#pragma once
+
+#include <Vertex.h>
+#include <FileSystem.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// The data of one mesh, as it comes out of the importer.
+/// </summary>
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Texture> textures;  ///< Type and path of every texture. The ids are not set yet.
+    unsigned int materialIndex = 0; ///< Index of the material inside the model.
+};
+
+/// <summary>
+/// The data of a whole model.
+/// </summary>
+struct ModelData {
+    std::vector<MeshData> meshes;
+};
+
+namespace ModelImporter {
+
+    /// <summary>
+    /// Imports a model. If the Vfs has a preprocessed "path.mesh" file (for example
+    /// inside an asset pack), it is loaded from that. Otherwise Assimp imports the model file.
+    /// </summary>
+    /// <param name="path">The path of the model file.</param>
+    /// <param name="model">Receives the meshes.</param>
+    /// <returns>True on success.</returns>
+    bool import(const std::string& path, ModelData& model);
+
+    /// <summary>
+    /// Imports a model file with Assimp, flattened and merged by material.
+    /// </summary>
+    bool importWithAssimp(const std::string& path, ModelData& model);
+
+    /// <summary>
+    /// Merges the meshes that share a material into one, in the order the materials first
+    /// appear. The meshes must already be in the space of the model.
+    /// </summary>
+    void mergeByMaterial(ModelData& model);
+
+    /// <summary>
+    /// Reads a .mesh file written by writeMeshFile().
+    /// </summary>
+    bool readMeshFile(const FileSystem::FileView& file, ModelData& model);
+
+    /// <summary>
+    /// Writes a model in the .mesh format: a small header, then for every mesh its
+    /// texture paths followed by the raw Vertex and index arrays, ready to be copied.
+    /// </summary>
+    bool writeMeshFile(const ModelData& model, std::ostream& out);
+
+    /// <summary>
+    /// Returns the path of the preprocessed .mesh file of a model.
+    /// </summary>
+    std::string meshFilePath(const std::string& path);
+}
@@ -0,0 +1,147 @@
+/*********************************************************************
+ * \file   OcclusionCuller.h
+ * \brief  Skips the objects hidden behind the islands.
+ * With the camera low behind the ship, the islands in front hide much
+ * of the scene, which is still drawn. Every frame the islands near the
+ * camera are rasterized on the CPU into a small depth buffer, as coarse
+ * proxies made from their heightfields (see Collision.h), on all the
+ * cores, one band of rows per worker. A pyramid of that buffer keeps
+ * the farthest depth of every 2x2 texels of the level below, so the
+ * bounding sphere of an object is tested against a few texels whatever
+ * its size on the screen: it is hidden if its nearest point is behind
+ * the farthest occluder over all of them.
+ * The proxies lie inside the islands, so they hide no more than the
+ * islands do, up to a texel of the small buffer at their edges, which
+ * the test covers by growing the rectangle of every sphere by a texel.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <Bounds.h>
+#include <Collision.h>
+#include <Settings.h>
+
+#include <vector>
+
+/// <summary>
+/// The cost/quality knobs of the occlusion culling, read from the settings file.
+/// </summary>
+struct OcclusionSettings {
+    bool enabled = true;
+    int width = 256;             ///< The width of the depth buffer, a power of two.
+    int height = 128;            ///< Its height, a power of two.
+    float distance = 60.0f;      ///< The islands farther than this from the camera hide nothing.
+    float minSize = 8.0f;        ///< The islands smaller than this on the buffer, in texels, hide nothing.
+
+    /// <summary>
+    /// Reads the "occlusion.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static OcclusionSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// The proxy of an island as an occluder: a coarse grid over its heightfield, in model
+/// space, each vertex at the lowest height around it so the grid stays inside the island.
+/// </summary>
+struct OccluderMesh {
+    /// <summary>
+    /// The cells of the grid along the longer side of the heightfield.
+    /// </summary>
+    static const int CELLS = 16;
+
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    BoundingSphere bounds;
+
+    /// <summary>
+    /// Builds the proxy of a heightfield. The cells below all of the island are left out.
+    /// </summary>
+    explicit OccluderMesh(const Heightfield& heightfield);
+
+    size_t getByteSize() const { return vertices.size() * sizeof(glm::vec3) + indices.size() * sizeof(unsigned int); }
+};
+
+/// <summary>
+/// \class OcclusionCuller
+/// Every frame: begin() with the camera, addOccluder() for every island, finish(), then
+/// isVisible() for the objects about to be drawn.
+/// </summary>
+class OcclusionCuller {
+ public:
+    /// <summary>
+    /// A level of the pyramid: the farthest depth of every texel.
+    /// </summary>
+    struct Level {
+        int width = 0;
+        int height = 0;
+        std::vector<float> depth;
+    };
+
+    explicit OcclusionCuller(const OcclusionSettings& settings);
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    /// <summary>
+    /// Clears the depth buffer and the occluders for a new view.
+    /// </summary>
+    void begin(const glm::mat4& view, const glm::mat4& projection);
+
+    /// <summary>
+    /// Adds the triangles of an occluder, unless it is too far or too small to hide anything.
+    /// </summary>
+    void addOccluder(const OccluderMesh& mesh, const glm::mat4& model);
+
+    /// <summary>
+    /// Rasterizes the occluders and builds the pyramid.
+    /// </summary>
+    void finish();
+
+    /// <summary>
+    /// Returns false for a sphere out of the view, or behind the occluders.
+    /// </summary>
+    bool isVisible(const BoundingSphere& sphere) const;
+
+    size_t getOccluderCount() const { return m_occluders; }
+    size_t getTriangleCount() const { return m_triangles.size(); }
+
+    /// <summary>
+    /// Returns the number of isVisible() calls since begin(), and how many said false.
+    /// </summary>
+    size_t getTestedCount() const { return m_tested; }
+    size_t getCulledCount() const { return m_culled; }
+
+    const OcclusionSettings& getSettings() const { return m_settings; }
+
+    /// <summary>
+    /// Returns the buffer, then every level of the pyramid above it, after finish(). The GPU
+    /// culling tests against a copy of them (see GpuCuller.h).
+    /// </summary>
+    const std::vector<Level>& getLevels() const { return m_levels; }
+
+ private:
+    /// <summary>
+    /// A triangle on the buffer: x and y in texels, z the depth in normalized device coordinates.
+    /// </summary>
+    struct Triangle {
+        glm::vec3 a, b, c;
+    };
+
+    bool screenRect(const glm::vec3& center, float radius, glm::ivec4& rect) const;
+    void clipAndAdd(const glm::vec4* clip);
+    void rasterize(const Triangle& triangle, int firstRow, int endRow);
+
+    OcclusionSettings m_settings;
+    glm::mat4 m_view = glm::mat4(1.0f);
+    glm::mat4 m_projection = glm::mat4(1.0f);
+    glm::mat4 m_viewProjection = glm::mat4(1.0f);
+    float m_near = 0.1f;
+
+    std::vector<Triangle> m_triangles;
+    std::vector<glm::vec4> m_clip;      ///< Scratch: the vertices of an occluder in clip space.
+    std::vector<Level> m_levels;        ///< The buffer itself, then every level above it.
+    size_t m_occluders = 0;
+    mutable size_t m_tested = 0;
+    mutable size_t m_culled = 0;
+};
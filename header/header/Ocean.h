@@ -0,0 +1,79 @@
+/*********************************************************************
+ * \file   Ocean.h
+ * \brief  The surface of the sea, animated on the GPU.
+ * The water is a geometry clipmap: square rings of grid around the
+ * camera, each with cells twice the size of the one inside it. The
+ * grid is built once, in cells, and never uploaded again. Every frame
+ * the vertex shader places each ring around the camera, snapped to its
+ * own cell size so the vertices do not swim, and moves the vertices by
+ * the Gerstner waves of the Frame block. The cost is the same however
+ * large the sea is: the rings simply reach further out.
+ * Near its outer edge every ring is morphed into the grid of the next
+ * one, so the two meet without cracks, and where a ring overlaps the
+ * finer one inside it, its fragments are discarded.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <Settings.h>
+#include <ShaderVariants.h>
+
+#include <memory>
+
+/// <summary>
+/// The size of the clipmap, read from the settings file.
+/// </summary>
+struct OceanSettings {
+    bool enabled = true;
+    int levels = 6;          ///< Number of rings, including the full grid in the middle.
+    int gridSize = 64;       ///< Cells along a side of every ring. A multiple of 8.
+    float cellSize = 0.25f;  ///< Size of the cells of the finest ring.
+
+    /// <summary>
+    /// Reads the "ocean.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static OceanSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// \class Ocean
+/// Draws the sea. The waves and the camera come from the Frame block.
+/// </summary>
+class Ocean {
+ public:
+    /// <param name="settings">The size of the clipmap.</param>
+    /// <param name="skyColor">The color the water reflects.</param>
+    Ocean(const OceanSettings& settings, const glm::vec3& skyColor);
+    ~Ocean();
+
+    Ocean(const Ocean&) = delete;
+    Ocean& operator=(const Ocean&) = delete;
+
+    /// <summary>
+    /// Draws the sea with one draw call.
+    /// </summary>
+    void Draw();
+
+    /// <summary>
+    /// The variants of the water shader, to set the global features (fog) on.
+    /// </summary>
+    ShaderVariants& getShaders() { return *m_shaders; }
+
+    /// <summary>
+    /// Returns how far from the camera the water reaches.
+    /// </summary>
+    float getExtent() const;
+
+ private:
+    void buildGrid();
+
+    OceanSettings m_settings;
+    glm::vec3 m_skyColor;
+    std::unique_ptr<ShaderVariants> m_shaders;
+    unsigned int m_VAO = 0;
+    unsigned int m_VBO = 0;
+    unsigned int m_EBO = 0;
+    unsigned int m_indexCount = 0;
+};
@@ -0,0 +1,40 @@
+/*********************************************************************
+ * \file   Parallel.h
+ * \brief  Splits a loop across the cores.
+ * A few worker threads are started the first time they are needed and
+ * kept for the rest of the game. forRange() hands them chunks of a
+ * loop, works on chunks itself too, and returns once the whole loop is
+ * done. The chunks are taken from a shared counter, so a slow chunk
+ * does not hold up the others.
+ *********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace Parallel {
+
+    /// <summary>
+    /// Returns the number of threads a loop runs on, including the calling one.
+    /// </summary>
+    unsigned int threadCount();
+
+    /// <summary>
+    /// Calls body(begin, end) for chunks of [0, count) of at most grain iterations, on all
+    /// the threads, and waits for all of them. The chunks must not depend on each other.
+    /// Loops of one chunk run on the calling thread only. Call it from the main thread.
+    /// </summary>
+    /// <param name="count">The number of iterations.</param>
+    /// <param name="grain">The iterations of one chunk. Chunks should take a few microseconds at least.</param>
+    /// <param name="body">The loop body, for a range of iterations.</param>
+    void forRange(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+    /// <summary>
+    /// The same, for a lambda. It is wrapped by reference, so no std::function holding a copy
+    /// of its captures is allocated for every loop.
+    /// </summary>
+    template <typename Body>
+    void forRange(size_t count, size_t grain, const Body& body) {
+        forRange(count, grain, std::function<void(size_t, size_t)>(std::cref(body)));
+    }
+}
@@ -0,0 +1,33 @@
+/*********************************************************************
+ * \file   Settings.h
+ * \brief  Settings read from a text file at startup.
+ * The cost of some features (shadows, for a start) has to be tuned
+ * per machine, without rebuilding the game. The settings file holds
+ * one "key value" pair per line; lines starting with '#' are comments.
+ * A missing file or key leaves the default of the caller in place.
+ *********************************************************************/
+#pragma once
+
+#include <map>
+#include <string>
+
+/// <summary>
+/// \class Settings
+/// The key/value pairs of a settings file.
+/// </summary>
+class Settings {
+ public:
+    /// <summary>
+    /// Reads a settings file through the Vfs. Returns false if it does not exist.
+    /// </summary>
+    bool load(const std::string& path);
+
+    bool has(const std::string& key) const { return m_values.count(key) != 0; }
+    int getInt(const std::string& key, int fallback) const;
+    float getFloat(const std::string& key, float fallback) const;
+    bool getBool(const std::string& key, bool fallback) const;
+    std::string getString(const std::string& key, const std::string& fallback) const;
+
+ private:
+    std::map<std::string, std::string> m_values;
+};
@@ -3,10 +3,12 @@
 #include <glad.h> // include glad to get all the required OpenGL headers
 #include <glm.hpp>
 
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader {
 public:
@@ -16,8 +18,21 @@ public:
     // constructor reads and builds the shader
     //Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
     Shader(std::string& vertexPath, std::string& fragmentPath, std::string* geometryPath = nullptr);
+    // constructor that compiles the sources with #define lines inserted after their #version line (see ShaderVariants.h)
+    Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines);
+    // constructor of a compute program, which needs OpenGL 4.3 (see GpuCuller.h)
+    explicit Shader(const std::string& computePath);
     // use/activate the shader
     void use();
+    // starts compiling the sources again, e.g. after they were edited. The program keeps
+    // working as before until update() swaps in the new one
+    void reload();
+    // swaps in the program started by reload() once the driver has linked it. Returns true if the
+    // ID changed, so the caller can set its uniforms again. If the new sources do not compile,
+    // the errors are printed and the old program stays in use
+    bool update();
+    // the files the program is compiled from
+    std::vector<std::string> getSourcePaths() const;
     // utility uniform functions
     void setBool(const std::string& name, bool value) const;
     void setInt(const std::string& name, int value) const;
@@ -33,5 +48,31 @@ public:
     void setMat4(const std::string& name, const glm::mat4& mat) const;
 
 private:
-    void checkCompileErrors(unsigned int shader, std::string type);
+    // a program being compiled and linked
+    struct Build {
+        unsigned int program = 0;
+        unsigned int shaders[3] = { 0, 0, 0 };
+        unsigned int shaderCount = 0;
+        uint64_t key = 0;           // the key of the program in the ShaderCache
+        bool cached = false;        // whether the program was loaded from the ShaderCache
+        bool unread = false;        // whether a source could not be read, so nothing was compiled
+    };
+
+    // the program made current by the last use()
+    static unsigned int s_currentProgram;
+
+    std::string m_vertexPath;
+    std::string m_fragmentPath;
+    std::string m_geometryPath;     // empty without a geometry shader
+    std::string m_computePath;      // set for a compute program only, which has no other stage
+    std::string m_defines;
+    Build m_reload;                 // the program started by reload()
+    bool m_reloading = false;
+
+    void start(Build& build);
+    void startCompute(Build& build);
+    bool isFinished(const Build& build) const;
+    bool finish(Build& build);
+    unsigned int compile(unsigned int type, const char* source, size_t size, const std::string& defines);
+    bool checkCompileErrors(unsigned int shader, std::string type);
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*********************************************************************
+ * \file   ShaderCache.h
+ * \brief  Keeps the linked shader programs on disk between runs.
+ * Compiling and linking GLSL is the slowest part of creating a Shader,
+ * and it is repeated on every launch although the sources rarely change.
+ * After a program is linked, its driver-specific binary is saved with
+ * glGetProgramBinary, under a key made of the hash of the sources and of
+ * the driver strings. The next launch gives the binary back to the
+ * driver with glProgramBinary and only compiles when the binary is
+ * missing or rejected (new driver, new GPU, changed sources).
+ * Needs OpenGL 4.1 or ARB_get_program_binary, both in the glad loader it
+ * is built with and in the context it runs in, otherwise it does nothing.
+ *********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ShaderCache {
+
+    /// <summary>
+    /// The value to start a hash() chain with.
+    /// </summary>
+    const uint64_t HASH_SEED = 14695981039346656037ull;
+
+    /// <summary>
+    /// Adds bytes to a 64-bit FNV-1a hash. Chain the calls to hash several sources.
+    /// </summary>
+    uint64_t hash(const char* data, size_t size, uint64_t seed = HASH_SEED);
+
+    /// <summary>
+    /// Returns true if the driver can both save and load program binaries.
+    /// </summary>
+    bool isSupported();
+
+    /// <summary>
+    /// Loads the cached binary into a program. On failure the program is
+    /// left empty, ready to have its shaders attached and linked.
+    /// </summary>
+    /// <param name="program">A program with no shaders attached.</param>
+    /// <param name="key">The hash of the sources of the program.</param>
+    /// <returns>True if the program is linked and ready to use.</returns>
+    bool load(unsigned int program, uint64_t key);
+
+    /// <summary>
+    /// Marks a program as one whose binary will be saved. Call it before linking.
+    /// </summary>
+    void prepare(unsigned int program);
+
+    /// <summary>
+    /// Saves the binary of a linked program.
+    /// </summary>
+    void save(unsigned int program, uint64_t key);
+
+    /// <summary>
+    /// The directory the binaries are kept in. It is created on the first save.
+    /// </summary>
+    void setDirectory(const std::string& directory);
+}
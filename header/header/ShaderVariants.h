@@ -0,0 +1,134 @@
+/*********************************************************************
+ * \file   ShaderVariants.h
+ * \brief  Variants of one shader, each compiled with its own #defines.
+ * A single pair of shader sources is written with #ifdef blocks for
+ * every optional feature (diffuse map, specular map, fog, instancing,
+ * shadows, point lights).
+ * ShaderVariants compiles one program per combination of features
+ * that is actually used, and keeps them by their feature mask, so a
+ * material without a specular map runs a shader that does not fetch
+ * one or compute the highlight at all.
+ * The per-frame uniforms are shared by all the variants through the
+ * Frame uniform block (see FrameUniforms.h). The model matrix, which
+ * changes per object, is written once with setModel() into the stream
+ * of the frame and bound to the Object block, which all the variants
+ * read, so using another variant uploads nothing.
+ * With enableHotReload(), edits to the sources are picked up by update()
+ * while the game runs, and every variant is recompiled in the background.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+#include <Shader.h>
+#include <FileWatcher.h>
+#include <FrameUniforms.h>
+#include <StreamBuffer.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+/// <summary>
+/// The optional features of the shaders. Each one is a #define in the sources.
+/// </summary>
+enum ShaderFeature : unsigned int {
+    SHADER_DIFFUSE_MAP  = 1u << 0, ///< DIFFUSE_MAP: sample the diffuse texture array, white otherwise.
+    SHADER_SPECULAR_MAP = 1u << 1, ///< SPECULAR_MAP: sample the specular texture array and add the highlight.
+    SHADER_FOG          = 1u << 2, ///< FOG: blend with the fog of the Frame block by distance.
+    SHADER_INSTANCED    = 1u << 3, ///< INSTANCED: the model matrix comes from the per-instance attributes 6 to 9.
+    SHADER_SHADOWS      = 1u << 4, ///< SHADOWS: look up the cascaded shadow map of the directional light.
+    SHADER_POINT_LIGHTS = 1u << 5, ///< POINT_LIGHTS: add the point lights of the cluster of the fragment (see LightClusters.h).
+    SHADER_FEATURE_COUNT = 6
+};
+
+/// <summary>
+/// \class ShaderVariants
+/// All the variants of one shader. A variant is compiled the first time its features
+/// are asked for, so the ones known at load time should be asked for with get() then.
+/// </summary>
+class ShaderVariants {
+ public:
+    /// <param name="vertexPath">The vertex shader source.</param>
+    /// <param name="fragmentPath">The fragment shader source.</param>
+    ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    /// <summary>
+    /// Sets a function called once for every new variant, right after it is compiled,
+    /// to set the uniforms that never change (samplers, material table).
+    /// </summary>
+    void setOnCreate(std::function<void(Shader&)> onCreate) { m_onCreate = std::move(onCreate); }
+
+    /// <summary>
+    /// Sets the features added to every variant, e.g. fog for the whole scene.
+    /// </summary>
+    void setGlobalFeatures(unsigned int features) { m_globalFeatures = features; }
+    unsigned int getGlobalFeatures() const { return m_globalFeatures; }
+
+    /// <summary>
+    /// Returns the variant with the given features (plus the global ones), compiling it if needed.
+    /// </summary>
+    Shader& get(unsigned int features);
+
+    /// <summary>
+    /// Sets the stream the model matrices are written into. The variants with an Object
+    /// block need one before the first setModel().
+    /// </summary>
+    void setStream(StreamBuffer& stream) { m_objects = std::make_unique<ObjectUniformBuffer>(stream); }
+
+    /// <summary>
+    /// Writes the model matrix of the object about to be drawn and binds it to the Object block.
+    /// </summary>
+    void setModel(const glm::mat4& model);
+
+    /// <summary>
+    /// Makes the variant with the given features the current program and returns it.
+    /// </summary>
+    Shader& use(unsigned int features);
+
+    /// <summary>
+    /// Starts watching the source files. From then on, update() recompiles all the
+    /// variants when a source changes.
+    /// </summary>
+    void enableHotReload();
+
+    /// <summary>
+    /// Starts recompiling the variants if their sources changed, and swaps in the ones
+    /// that finished linking. A variant whose new sources fail keeps its old program.
+    /// Call it once per frame.
+    /// </summary>
+    void update();
+
+    /// <summary>
+    /// Returns the number of variants compiled so far.
+    /// </summary>
+    size_t getVariantCount() const { return m_variants.size(); }
+
+    /// <summary>
+    /// Returns the #define lines of a feature mask.
+    /// </summary>
+    static std::string defines(unsigned int features);
+
+ private:
+    /// <summary>
+    /// One compiled variant.
+    /// </summary>
+    struct Variant {
+        std::unique_ptr<Shader> shader;
+    };
+
+    Variant& variant(unsigned int features);
+    void initialize(Variant& variant);
+
+    std::string m_vertexPath;
+    std::string m_fragmentPath;
+    std::map<unsigned int, Variant> m_variants;  ///< The variants by feature mask.
+    std::function<void(Shader&)> m_onCreate;
+    std::unique_ptr<FileWatcher> m_watcher;      ///< Watches the sources, with hot reloading.
+    unsigned int m_globalFeatures = 0;
+    std::unique_ptr<ObjectUniformBuffer> m_objects;  ///< The model matrices, with a stream.
+};
@@ -0,0 +1,130 @@
+/*********************************************************************
+ * \file   StaticBatch.h
+ * \brief  Geometry that never moves, baked into world space.
+ * Objects like the islands are placed once and never move again. At
+ * scene load their meshes are transformed into world space and the
+ * ones that share a material are merged together, so the whole group
+ * is drawn with one draw call per material and an identity model
+ * matrix, instead of going through Model::Draw for every object.
+ * The index range of every object is remembered inside the merged
+ * meshes, so the shadow pass can still skip the objects one by one.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+#include <Model.h>
+#include <Shader.h>
+#include <ShaderVariants.h>
+#include <GeometryArena.h>
+#include <MaterialTable.h>
+#include <CascadedShadowMap.h>
+#include <OcclusionCuller.h>
+#include <Bounds.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// \class StaticBatch
+/// Collects static objects with add(), bakes them with build() and draws them with Draw().
+/// Dynamic objects (the ship, the seagulls, the bugs) stay on the Model::Draw path.
+/// </summary>
+class StaticBatch {
+ public:
+    /// <summary>
+    /// Constructor
+    /// </summary>
+    /// <param name="arena">Arena the baked geometry is stored in. It is uploaded by build().</param>
+    /// <param name="table">The material table of the baked models, if they use one. It must
+    /// be built before add() is called, since the merging follows its groups.</param>
+    StaticBatch(std::shared_ptr<GeometryArena> arena = std::make_shared<GeometryArena>(), const MaterialTable* table = nullptr) 
+        : m_arena(arena), m_table(table) {}
+
+    /// <summary>
+    /// Adds an instance of a model to the batch. The model must stay alive until build() is called,
+    /// and instances of the same Model object share their textures, so they end up in the same group.
+    /// </summary>
+    /// <param name="model">The model to bake.</param>
+    /// <param name="modelMatrix">The model matrix of the instance.</param>
+    void add(const Model& model, const glm::mat4& modelMatrix);
+
+    /// <summary>
+    /// Merges the added instances into one mesh per material and uploads them.
+    /// </summary>
+    void build();
+
+    /// <summary>
+    /// Draws the whole batch. Sets the model matrix of the shader to identity,
+    /// since the vertices are already in world space.
+    /// </summary>
+    /// <param name="shader">The main shader program.</param>
+    void Draw(Shader& shader);
+
+    /// <summary>
+    /// Draws the whole batch with the shader variant every group needs.
+    /// Needs a material table. With a culler, the hidden objects are skipped, and the
+    /// others of every group are drawn with one multi-draw call.
+    /// </summary>
+    /// <param name="shaders">The variants of the main shader program.</param>
+    /// <param name="culler">The occlusion culler of the frame, if any.</param>
+    void Draw(ShaderVariants& shaders, const OcclusionCuller* culler = nullptr);
+
+    /// <summary>
+    /// Draws the positions of the objects that cast shadows into a cascade, with one call.
+    /// The depth shader must be in use, as it is while CascadedShadowMap::render() runs.
+    /// </summary>
+    void DrawDepth(CascadedShadowMap& shadows, int cascade);
+
+    /// <summary>
+    /// Returns the number of draw calls the batch is submitted with.
+    /// </summary>
+    size_t getDrawCount() const {
+        return m_batches.size();
+    }
+
+ private:
+    /// <summary>
+    /// Vertices of all instances that can be drawn with the same bindings: the same
+    /// textures, or the same texture arrays when there is a material table.
+    /// </summary>
+    /// <summary>
+    /// The indices of one added object inside a group, and its world-space bounds.
+    /// </summary>
+    struct Instance {
+        unsigned int firstIndex = 0; ///< Relative to the group, and to the arena once built.
+        unsigned int indexCount = 0;
+        int baseVertex = 0;          ///< The base vertex of the batch, once built.
+        BoundingSphere bounds;
+    };
+
+    struct Group {
+        std::vector<Instance> instances;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<unsigned int> materials; ///< Material table index of every vertex.
+        std::vector<Texture> textures;
+        unsigned int tableGroup = 0;
+    };
+
+    /// <summary>
+    /// A baked group: one range in the arena, drawn with one call.
+    /// </summary>
+    struct Batch {
+        ArenaRange range;
+        std::vector<Texture> textures;
+        unsigned int tableGroup;
+        size_t firstInstance = 0;            ///< Its objects in m_instances.
+        size_t instanceCount = 0;
+    };
+
+    std::shared_ptr<GeometryArena> m_arena;             ///< Storage of the baked geometry.
+    const MaterialTable* m_table;                       ///< Material table of the baked models, may be null.
+    std::map<std::vector<unsigned int>, Group> m_groups; ///< Groups being collected, keyed by their bindings.
+    std::vector<Batch> m_batches;                       ///< One baked range per group.
+    std::vector<Instance> m_instances;                  ///< Every object in every batch, for the depth passes.
+    std::vector<GLsizei> m_depthCounts;                 ///< Scratch arrays of DrawDepth(), and of Draw() with a culler.
+    std::vector<const void*> m_depthOffsets;
+    std::vector<GLint> m_depthBaseVertices;
+};
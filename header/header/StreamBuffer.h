@@ -0,0 +1,136 @@
+/*********************************************************************
+ * \file   StreamBuffer.h
+ * \brief  A ring of buffer memory for the data that changes every frame.
+ * The frame uniforms, the model matrix of every object and the instance
+ * matrices of the fleet used to be uploaded with glBufferData(),
+ * glBufferSubData() and glUniformMatrix4fv(), each of which may make
+ * the driver copy the data again or wait for the GPU to be done with
+ * the last frame. Here one buffer is split in three partitions, one
+ * per frame in flight. The partition of a frame is fenced at its end
+ * with glFenceSync(), and written again three frames later, once the
+ * fence says the GPU has read it. With OpenGL 4.4 or
+ * ARB_buffer_storage the buffer is mapped once, persistently, and the
+ * CPU writes into it directly: an upload is a memcpy. Without them,
+ * every write is a glBufferSubData() into the partition the fence has
+ * freed, which the driver never has to orphan or wait for.
+ * A frame that needs more than a partition moves to a buffer twice the
+ * size. The old buffer stays alive until the GPU is done with it, so
+ * the ranges written earlier in the frame stay valid.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+
+#include <Settings.h>
+
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// The size of the ring, read from the settings file.
+/// </summary>
+struct StreamSettings {
+    bool persistent = true;   ///< Map the buffer when the driver can. Off, every write is a glBufferSubData().
+    size_t partitionSize = 4 * 1024 * 1024;   ///< The bytes a frame can write before the ring grows.
+
+    /// <summary>
+    /// Reads the "stream.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static StreamSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// Where a write went: a range of a buffer, to bind or to draw from.
+/// </summary>
+struct StreamRange {
+    unsigned int buffer = 0;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+/// <summary>
+/// \class StreamBuffer
+/// Every frame: beginFrame(), any number of write(), then endFrame() after the last
+/// draw that reads them.
+/// </summary>
+class StreamBuffer {
+ public:
+    /// <summary>
+    /// The frames that can be in flight, each with its own partition.
+    /// </summary>
+    static const int PARTITIONS = 3;
+
+    explicit StreamBuffer(const StreamSettings& settings);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    /// <summary>
+    /// Moves to the next partition, waiting for the GPU to be done with it if it is not yet.
+    /// </summary>
+    void beginFrame();
+
+    /// <summary>
+    /// Fences the partition of the frame, after its last draw.
+    /// </summary>
+    void endFrame();
+
+    /// <summary>
+    /// Copies data into the partition of the frame. The range stays valid until the frame ends.
+    /// </summary>
+    /// <param name="alignment">The alignment of the offset: getUniformAlignment() for a
+    /// range bound to a uniform block.</param>
+    StreamRange write(const void* data, size_t size, size_t alignment = 16);
+
+    /// <summary>
+    /// Returns the alignment the offsets of the ranges bound to uniform blocks need.
+    /// </summary>
+    size_t getUniformAlignment() const { return m_uniformAlignment; }
+
+    /// <summary>
+    /// Returns whether the buffer is mapped persistently, or written with glBufferSubData().
+    /// </summary>
+    bool isPersistent() const { return m_persistent; }
+
+    size_t getPartitionSize() const { return m_partitionSize; }
+
+    /// <summary>
+    /// Returns the bytes written in the last frame, and the most written in one frame.
+    /// </summary>
+    size_t getLastFrameBytes() const { return m_lastFrameBytes; }
+    size_t getPeakBytes() const { return m_peakBytes; }
+
+    /// <summary>
+    /// Returns how many times beginFrame() had to wait for the GPU, since the start.
+    /// </summary>
+    size_t getWaitCount() const { return m_waits; }
+
+ private:
+    /// <summary>
+    /// A buffer the ring grew out of, deleted once the GPU is done with it.
+    /// </summary>
+    struct Retired {
+        unsigned int buffer;
+        GLsync fence;
+    };
+
+    void create(size_t partitionSize);
+    void grow(size_t needed);
+
+    unsigned int m_buffer = 0;
+    char* m_mapped = nullptr;             ///< The whole buffer, when it is mapped persistently.
+    bool m_persistent = false;
+    size_t m_partitionSize = 0;
+    size_t m_uniformAlignment = 256;
+    int m_partition = 0;                  ///< The partition of the frame.
+    size_t m_offset = 0;                  ///< The first free byte in it.
+    GLsync m_fences[PARTITIONS] = {};
+
+    std::vector<Retired> m_retired;
+    size_t m_retiring = 0;                ///< The retired buffers still waiting for a fence.
+    size_t m_frameBytes = 0;              ///< Written since beginFrame().
+    size_t m_lastFrameBytes = 0;
+    size_t m_peakBytes = 0;
+    size_t m_waits = 0;
+};
@@ -0,0 +1,127 @@
+/*********************************************************************
+ * \file   Systems.h
+ * \brief  The systems that move and draw the entities.
+ * Each system asks the Registry (see Ecs.h) for the entities with the
+ * components it needs and walks them chunk by chunk. The order within
+ * a frame is: the controllers and flocks move (GameObject::Ship), then
+ * follow() and orbit(), then the TransformHierarchy computes the model
+ * matrices that changed, collectLights() hands the lights to the
+ * LightClusters, and the RenderSystem draws with them.
+ *********************************************************************/
+#pragma once
+
+#include <CascadedShadowMap.h>
+#include <Components.h>
+#include <Ecs.h>
+#include <LightClusters.h>
+#include <MaterialTable.h>
+#include <Model.h>
+#include <OcclusionCuller.h>
+#include <ShaderVariants.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Systems {
+
+    /// <summary>
+    /// Moves the followers to the birds of their flocks, facing the way they fly.
+    /// </summary>
+    void follow(Ecs::Registry& registry);
+
+    /// <summary>
+    /// Moves the orbiting entities around the origins of their spaces, on all the cores.
+    /// </summary>
+    /// <param name="deltaTime">The time since the last frame.</param>
+    void orbit(Ecs::Registry& registry, float deltaTime);
+
+    /// <summary>
+    /// Adds the lights of the entities to the lights of the frame, where their model
+    /// matrices put them.
+    /// </summary>
+    void collectLights(Ecs::Registry& registry, LightClusters& lights);
+}
+
+/// <summary>
+/// \class TransformHierarchy
+/// Computes the model matrices of the entities, each in the space of its Parent. The entities
+/// that are not Static are kept in a flat array, breadth first, so every parent comes before
+/// its children: one pass computes the matrices of the dirty transforms, and of everything
+/// under them, and skips the rest. The array is only built again, and every matrix computed
+/// again, when entities come, go or change components. The static entities are not in it,
+/// so they cost nothing.
+/// </summary>
+class TransformHierarchy {
+ public:
+    /// <summary>
+    /// Computes the model matrices of the dirty transforms and of their subtrees.
+    /// </summary>
+    void update(Ecs::Registry& registry);
+
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    /// <summary>
+    /// Returns how many matrices the last update() computed.
+    /// </summary>
+    size_t getUpdatedCount() const { return m_updated; }
+
+ private:
+    static constexpr unsigned int NO_PARENT = 0xffffffffu;
+
+    /// <summary>
+    /// An entity, with the index of its parent in the array.
+    /// </summary>
+    struct Node {
+        Transform* transform;     ///< Good until the registry changes version.
+        unsigned int parent;
+    };
+
+    void build(Ecs::Registry& registry);
+
+    std::vector<Node> m_nodes;              ///< Breadth first.
+    std::vector<unsigned char> m_changed;   ///< The matrices computed by this update(), by node.
+    unsigned int m_version = 0;             ///< The version of the registry the array was built for.
+    bool m_built = false;
+    size_t m_updated = 0;
+
+    // the scratch of build(): the entities, the children of each, and the breadth first order
+    std::vector<Ecs::Entity> m_entities;
+    std::vector<unsigned int> m_slotOfIndex;  ///< By entity index, the place in m_entities.
+    std::vector<unsigned int> m_firstChild;
+    std::vector<unsigned int> m_nextSibling;
+    std::vector<unsigned int> m_order;
+    std::vector<unsigned int> m_nodeOfSlot;
+};
+
+/// <summary>
+/// \class RenderSystem
+/// Owns the models of the entities, each loaded once however many entities use it, and
+/// draws the entities with a Renderable.
+/// </summary>
+class RenderSystem {
+ public:
+    /// <summary>
+    /// Loads a model, or returns the one loaded before from the same path.
+    /// </summary>
+    /// <param name="path">The path of the 3D model.</param>
+    /// <param name="table">The material table its textures go to, if any.</param>
+    /// <returns>The index of the model, for Renderable::model.</returns>
+    unsigned int load(const std::string& path, MaterialTable* table = nullptr);
+
+    Model& getModel(unsigned int model) { return *m_models[model]; }
+
+    /// <summary>
+    /// Draws the renderable entities, skipping the hidden ones if there is a culler.
+    /// </summary>
+    void render(Ecs::Registry& registry, ShaderVariants& shaders, const OcclusionCuller* culler = nullptr);
+
+    /// <summary>
+    /// Draws the depth of the renderable entities that cast shadows and are in a shadow cascade.
+    /// </summary>
+    void renderShadow(Ecs::Registry& registry, CascadedShadowMap& shadows, int cascade);
+
+ private:
+    std::vector<std::unique_ptr<Model>> m_models;
+    std::vector<std::string> m_paths;  ///< The path of every model, to load it only once.
+};
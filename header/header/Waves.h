@@ -0,0 +1,120 @@
+/*********************************************************************
+ * \file   Waves.h
+ * \brief  The waves of the sea, as a sum of Gerstner waves.
+ * The same few numbers describe the sea everywhere: the ocean shader
+ * evaluates the waves for every vertex of the water, and the game can
+ * evaluate them on the CPU for the things that float on it. They reach
+ * the shaders through the Frame block, together with the time.
+ * The sea is moved sideways as well as up by Gerstner waves, so the
+ * height above a point is found by a few fixed-point steps back to the
+ * point of the flat sea that ends up there. sample() takes many points
+ * at once and does four at a time with SSE2, where it is available.
+ *********************************************************************/
+#pragma once
+
+#include <glm.hpp>
+
+#include <FrameUniforms.h>
+
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// One Gerstner wave. The speed follows from the wavelength, as for waves on deep water.
+/// </summary>
+struct GerstnerWave {
+    glm::vec2 direction;  ///< Direction of travel on the xz plane.
+    float steepness;      ///< 0 for a sine wave, 1 for sharp crests. The sum over all waves must stay below 1.
+    float wavelength;     ///< Distance between two crests.
+};
+
+/// <summary>
+/// The water surface above a point.
+/// </summary>
+struct WaveSample {
+    float height = 0.0f;
+    glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);
+};
+
+/// <summary>
+/// \class Waves
+/// The set of waves of the sea.
+/// </summary>
+class Waves {
+ public:
+    /// <summary>
+    /// The maximum number of waves. It must match the size of waves in the Frame block.
+    /// </summary>
+    static const int MAX_WAVES = 8;
+
+    /// <summary>
+    /// Creates a calm sea with a few waves from roughly the same direction.
+    /// </summary>
+    Waves() {
+        add({ glm::vec2(1.0f, 0.3f), 0.25f, 9.0f });
+        add({ glm::vec2(0.8f, 0.7f), 0.20f, 5.5f });
+        add({ glm::vec2(0.9f, -0.4f), 0.15f, 3.1f });
+        add({ glm::vec2(0.3f, 1.0f), 0.10f, 1.7f });
+    }
+
+    /// <summary>
+    /// Adds a wave. Waves beyond MAX_WAVES are ignored.
+    /// </summary>
+    void add(const GerstnerWave& wave) {
+        if (static_cast<int>(m_waves.size()) < MAX_WAVES)
+            m_waves.push_back({ glm::normalize(wave.direction), wave.steepness, wave.wavelength });
+        update(m_time, m_viewer);
+    }
+
+    const std::vector<GerstnerWave>& getWaves() const { return m_waves; }
+
+    /// <summary>
+    /// Moves the waves to a point in time. Call it once per frame, before sample().
+    /// </summary>
+    /// <param name="time">The time the waves are at, in seconds.</param>
+    /// <param name="viewer">Where the camera is on the xz plane. The short waves fade out
+    /// far from it, as they do on the GPU.</param>
+    void update(float time, const glm::vec2& viewer);
+
+    /// <summary>
+    /// Fills the wave part of the Frame block, at the time of the last update().
+    /// </summary>
+    void setUniforms(FrameUniforms& frame) const {
+        frame.time = glm::vec4(m_time, static_cast<float>(m_waves.size()), 0.0f, 0.0f);
+        for (size_t i = 0; i < m_waves.size(); i++)
+            frame.waves[i] = glm::vec4(m_waves[i].direction, m_waves[i].steepness, m_waves[i].wavelength);
+    }
+
+    /// <summary>
+    /// Returns the height and the normal of the water above a point of the xz plane.
+    /// </summary>
+    WaveSample sample(float x, float z) const;
+
+    /// <summary>
+    /// Returns the heights, and the normals if asked for, above many points at once.
+    /// </summary>
+    /// <param name="x">The x of every point.</param>
+    /// <param name="z">The z of every point.</param>
+    /// <param name="count">The number of points.</param>
+    /// <param name="heights">Receives count heights.</param>
+    /// <param name="normals">Receives count normals, may be null.</param>
+    void sample(const float* x, const float* z, size_t count, float* heights, glm::vec3* normals = nullptr) const;
+
+ private:
+    /// <summary>
+    /// The constants of a wave at the current time, shared by every point.
+    /// </summary>
+    struct Term {
+        float directionX, directionZ;
+        float k;            ///< Wave number, 2 pi over the wavelength.
+        float phase;        ///< k times the speed times the time.
+        float steepness;
+        float fadeStart;    ///< Distance from the viewer where the wave starts to fade out.
+        float fadeEnd;      ///< Distance from the viewer where it is gone.
+    };
+
+    std::vector<GerstnerWave> m_waves;
+    std::vector<Term> m_terms;
+    float m_time = 0.0f;
+    glm::vec2 m_viewer = glm::vec2(0.0f);
+};
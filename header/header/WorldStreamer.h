@@ -0,0 +1,303 @@
+/*********************************************************************
+ * \file   WorldStreamer.h
+ * \brief  The islands, loaded and unloaded in tiles as the ship sails.
+ * The sea is split into square tiles. A WorldMap says which islands
+ * are in every tile: the ones listed in a world file (or given by the
+ * game), and, when enabled, islands scattered over every tile from a
+ * seed, so the map has no end and never has to be held in memory.
+ * The WorldStreamer keeps the tiles around the ship resident, and the
+ * tiles ahead of it along its heading, nearest first. The slow part of
+ * loading a tile, importing the models and building their collision
+ * heightfields, runs on a loader thread. The main thread then only
+ * uploads the geometry: each tile is baked into its own StaticBatch,
+ * and its islands are added to the CollisionWorld. The tiles left
+ * behind are unloaded, and the models no resident tile uses are freed.
+ * Memory budgets for the CPU (models and heightfields) and the GPU
+ * (the baked tiles) bound the working set: the farthest tiles are the
+ * first to go, or are not loaded at all.
+ * Every island is also a static entity of the Registry (see Ecs.h)
+ * while its tile is resident.
+ * The textures stay in the MaterialTable, which is built once, so the
+ * materials of all the island models are registered at startup.
+ *********************************************************************/
+#pragma once
+
+#include <glad.h>
+#include <glm.hpp>
+
+#include <CascadedShadowMap.h>
+#include <Collision.h>
+#include <Ecs.h>
+#include <MaterialTable.h>
+#include <Model.h>
+#include <ModelImporter.h>
+#include <OcclusionCuller.h>
+#include <Settings.h>
+#include <ShaderVariants.h>
+#include <StaticBatch.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// The size of the tiles and how many of them are kept, read from the settings file.
+/// </summary>
+struct WorldSettings {
+    float tileSize = 32.0f;       ///< The side of a tile.
+    int loadRadius = 1;           ///< The tiles this many tiles around the ship's tile are loaded.
+    int unloadRadius = 2;         ///< Loaded tiles are unloaded beyond this many tiles, so a ship on a border does not thrash.
+    int prefetch = 3;             ///< The tiles up to this many tiles ahead of the ship are loaded too.
+    size_t cpuBudget = 256;       ///< The memory of the models and heightfields, in MB.
+    size_t gpuBudget = 256;       ///< The memory of the baked tiles, in MB.
+    int scatter = 0;              ///< The mean number of islands scattered over every tile. 0 for only the listed islands.
+    float clearRadius = 20.0f;    ///< No islands are scattered this close to the origin, where the ships start.
+    unsigned int seed = 1;        ///< The seed of the scattered islands.
+    std::string file;             ///< A world file listing islands, "island model x z" lines. Optional.
+
+    /// <summary>
+    /// Reads the "world.*" keys, keeping the defaults above for the missing ones.
+    /// </summary>
+    static WorldSettings load(const Settings& settings);
+};
+
+/// <summary>
+/// The index of a tile: the tile (x, z) covers [x, x + 1) * tileSize by [z, z + 1) * tileSize.
+/// </summary>
+struct TileCoord {
+    int x = 0;
+    int z = 0;
+
+    bool operator<(const TileCoord& other) const { return x < other.x || (x == other.x && z < other.z); }
+    bool operator==(const TileCoord& other) const { return x == other.x && z == other.z; }
+};
+
+/// <summary>
+/// An island of the world.
+/// </summary>
+struct IslandPlacement {
+    std::string model;            ///< The path of its 3D model.
+    glm::vec3 position;
+};
+
+/// <summary>
+/// \class WorldMap
+/// Where the islands are. Only the listed islands take memory; the scattered ones are
+/// made up again every time a tile is asked for.
+/// </summary>
+class WorldMap {
+ public:
+    explicit WorldMap(const WorldSettings& settings = WorldSettings()) : m_settings(settings) {}
+
+    /// <summary>
+    /// Adds an island to its tile.
+    /// </summary>
+    void addIsland(const IslandPlacement& island);
+
+    /// <summary>
+    /// Adds the islands of a world file, read through the Vfs. Returns false if it does not exist.
+    /// </summary>
+    bool load(const std::string& path);
+
+    /// <summary>
+    /// Sets the model of the scattered islands. Without one, nothing is scattered.
+    /// </summary>
+    void setScatterModel(const std::string& model) { m_scatterModel = model; }
+
+    /// <summary>
+    /// Returns the tile a point is in.
+    /// </summary>
+    TileCoord tileOf(const glm::vec2& position) const;
+
+    /// <summary>
+    /// Appends the islands of a tile. The same tile always gives the same islands.
+    /// </summary>
+    void islandsIn(const TileCoord& tile, std::vector<IslandPlacement>& islands) const;
+
+    /// <summary>
+    /// Returns the path of every model the islands may use, to register their materials.
+    /// </summary>
+    std::vector<std::string> getModels() const;
+
+    const WorldSettings& getSettings() const { return m_settings; }
+
+ private:
+    WorldSettings m_settings;
+    std::map<TileCoord, std::vector<IslandPlacement>> m_listed;
+    std::string m_scatterModel;
+};
+
+/// <summary>
+/// \class WorldStreamer
+/// Every frame: update() with the ship, then Draw() and DrawDepth() draw the resident tiles.
+/// The islands collide through getCollision().
+/// </summary>
+class WorldStreamer {
+ public:
+    /// <param name="map">The islands of the world.</param>
+    /// <param name="collision">The settings of the collision world, and of the heightfields.</param>
+    /// <param name="table">The material table of the island models. It must be built before
+    /// the first update(), with the materials registered by registerMaterials().</param>
+    /// <param name="registry">The entities the islands of the resident tiles are added to.</param>
+    WorldStreamer(const WorldMap& map, const CollisionSettings& collision, MaterialTable* table, Ecs::Registry& registry);
+    ~WorldStreamer();
+
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    /// <summary>
+    /// Imports every model of the map once, to register its materials in the table, and
+    /// drops the geometry again. Call it before MaterialTable::build().
+    /// </summary>
+    void registerMaterials();
+
+    /// <summary>
+    /// Installs the tiles the loader finished, unloads the ones left behind and asks for the
+    /// ones around and ahead of the ship, within the budgets.
+    /// </summary>
+    /// <param name="position">Where the ship is.</param>
+    /// <param name="front">Where it is heading.</param>
+    void update(const glm::vec3& position, const glm::vec3& front);
+
+    /// <summary>
+    /// Waits for the tiles asked for so far and installs them. For the start of the game,
+    /// so the ship does not start in an empty sea.
+    /// </summary>
+    void finishLoading();
+
+    /// <summary>
+    /// Draws the islands of the resident tiles, skipping the hidden ones if there is a culler.
+    /// </summary>
+    void Draw(ShaderVariants& shaders, const OcclusionCuller* culler = nullptr);
+
+    /// <summary>
+    /// Adds the islands of the resident tiles to the occluders of the frame.
+    /// </summary>
+    void DrawOccluders(OcclusionCuller& culler);
+
+    /// <summary>
+    /// Draws the depth of the islands of the resident tiles into a shadow cascade.
+    /// </summary>
+    void DrawDepth(CascadedShadowMap& shadows, int cascade);
+
+    const CollisionWorld& getCollision() const { return m_collision; }
+
+    size_t getResidentTileCount() const { return m_tiles.size(); }
+    size_t getPendingTileCount() const { return m_pending.size(); }
+    size_t getCpuBytes() const { return m_cpuBytes; }
+    size_t getGpuBytes() const { return m_gpuBytes; }
+
+ private:
+    /// <summary>
+    /// A tile for the loader: its islands, and the models the main thread did not have
+    /// when it asked for it.
+    /// </summary>
+    struct LoadJob {
+        TileCoord tile;
+        std::vector<IslandPlacement> islands;
+        std::vector<std::string> models;
+    };
+
+    /// <summary>
+    /// A tile the loader finished: the models it imported, with their heightfields.
+    /// </summary>
+    struct LoadedTile {
+        TileCoord tile;
+        std::vector<IslandPlacement> islands;
+        std::vector<std::string> models;
+        std::vector<ModelData> data;
+        std::vector<std::shared_ptr<const Heightfield>> heightfields;
+        std::vector<std::shared_ptr<const OccluderMesh>> occluders;
+    };
+
+    /// <summary>
+    /// A tile asked for and not installed yet.
+    /// </summary>
+    struct PendingTile {
+        std::vector<std::string> held;        ///< The cached models it holds on to meanwhile.
+        std::vector<std::string> importing;   ///< The models the loader imports for it.
+    };
+
+    /// <summary>
+    /// A model used by the resident tiles.
+    /// </summary>
+    struct CachedModel {
+        std::shared_ptr<Model> model;
+        std::shared_ptr<const Heightfield> heightfield;
+        std::shared_ptr<const OccluderMesh> occluder;
+        unsigned int users = 0;       ///< Resident and pending tiles using it.
+    };
+
+    /// <summary>
+    /// What a model costs, remembered after it is first loaded, for the estimates.
+    /// </summary>
+    struct ModelCost {
+        size_t cpuBytes = 0;          ///< The model and its heightfield.
+        size_t bakedBytes = 0;        ///< One instance of it in a baked tile.
+    };
+
+    /// <summary>
+    /// An island as an occluder: the proxy of its model, and where it is.
+    /// </summary>
+    struct Occluder {
+        std::shared_ptr<const OccluderMesh> mesh;
+        glm::mat4 model;
+    };
+
+    /// <summary>
+    /// A resident tile.
+    /// </summary>
+    struct Tile {
+        std::unique_ptr<StaticBatch> batch;
+        std::vector<std::string> models;       ///< The models it uses, once each.
+        std::vector<unsigned int> colliders;
+        std::vector<Ecs::Entity> islands;      ///< The entities of its islands.
+        std::vector<Occluder> occluders;       ///< Its islands, as occluders.
+        size_t gpuBytes = 0;
+    };
+
+    void loaderThread();
+    void request(const TileCoord& tile, std::vector<IslandPlacement>&& islands);
+    void install(LoadedTile& loaded);
+    void unload(const TileCoord& tile);
+    void release(const std::string& model);
+    void collectLoaded();
+    static std::vector<std::string> distinctModels(const std::vector<IslandPlacement>& islands);
+
+    const WorldMap& m_map;
+    Ecs::Registry& m_registry;
+    WorldSettings m_settings;
+    CollisionSettings m_collisionSettings;
+    MaterialTable* m_table;
+    CollisionWorld m_collision;
+    bool m_collisionDirty = false;
+
+    std::map<TileCoord, Tile> m_tiles;
+    std::map<TileCoord, PendingTile> m_pending;
+    std::set<TileCoord> m_wanted;                ///< The tiles the last update() asked to be resident.
+    std::map<std::string, CachedModel> m_models;
+    std::map<std::string, ModelCost> m_costs;
+    glm::vec3 m_shipPosition = glm::vec3(0.0f);  ///< Where the last update() saw the ship.
+    glm::vec3 m_shipFront = glm::vec3(0.0f);
+    TileCoord m_lastCenter;                      ///< The tile of the ship at the last full update().
+    std::vector<TileCoord> m_lastAhead;          ///< The tiles ahead of it then.
+    bool m_stale = true;                         ///< Tiles came in, or waited, since the last full update().
+    size_t m_cpuBytes = 0;
+    size_t m_gpuBytes = 0;
+
+    // the loader thread and the two queues it shares with the main thread
+    std::thread m_loader;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<LoadJob> m_jobs;
+    std::deque<LoadedTile> m_loaded;
+    std::deque<LoadedTile> m_collected;          ///< The tiles taken from m_loaded, swapped with it.
+    bool m_stop = false;
+};
@@ -0,0 +1,140 @@
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace FileSystem {
+
+    namespace {
+        const char PACK_MAGIC[4] = { 'S', 'S', 'P', 'K' };
+        const uint32_t PACK_VERSION = 1;
+    }
+
+    uint64_t hashPath(const std::string& path)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : path) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    AssetPack::AssetPack(const std::string& path) : m_file(std::make_shared<MappedFile>(path))
+    {
+        // a missing pack is not an error, the game then runs from the loose files
+        if (!m_file->isValid())
+            return;
+
+        PackHeader header = {};
+        if (m_file->size() >= sizeof(header))
+            std::memcpy(&header, m_file->data(), sizeof(header));
+        uint64_t tocSize = static_cast<uint64_t>(header.entryCount) * sizeof(PackEntry);
+        if (m_file->size() < sizeof(header) ||
+            std::memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != PACK_VERSION ||
+            header.tocOffset % alignof(PackEntry) != 0 ||
+            header.tocOffset + tocSize > m_file->size() ||
+            header.pathsOffset > m_file->size()) {
+            std::cout << "ERROR::ASSET_PACK:: " << path << " is not a valid asset pack" << std::endl;
+            return;
+        }
+
+        m_entries = reinterpret_cast<const PackEntry*>(m_file->data() + header.tocOffset);
+        m_paths = m_file->data() + header.pathsOffset;
+        m_entryCount = header.entryCount;
+    }
+
+    FileView AssetPack::open(const std::string& path)
+    {
+        if (m_entries == nullptr)
+            return FileView();
+
+        uint64_t hash = hashPath(path);
+        const PackEntry* end = m_entries + m_entryCount;
+        const PackEntry* entry = std::lower_bound(m_entries, end, hash, [](const PackEntry& entry, uint64_t hash) {
+            return entry.hash < hash;
+        });
+
+        size_t pathsSize = m_file->size() - static_cast<size_t>(m_paths - m_file->data());
+        for (; entry != end && entry->hash == hash; ++entry) {
+            if (static_cast<uint64_t>(entry->pathOffset) + entry->pathLength > pathsSize ||
+                entry->offset + entry->size > m_file->size())
+                continue;
+            if (path.size() == entry->pathLength && std::memcmp(m_paths + entry->pathOffset, path.data(), path.size()) == 0)
+                return FileView(m_file->data() + entry->offset, static_cast<size_t>(entry->size), m_file);
+        }
+        return FileView();
+    }
+
+    AssetPackWriter::AssetPackWriter(const std::string& path, uint32_t alignment) :
+        m_out(path, std::ios::binary | std::ios::trunc),
+        m_alignment(alignment)
+    {
+        // room for the header, it is written last
+        PackHeader header = {};
+        m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_position = sizeof(header);
+    }
+
+    bool AssetPackWriter::add(const std::string& path, const char* data, size_t size)
+    {
+        std::string normalized = Vfs::normalize(path);
+        uint64_t hash = hashPath(normalized);
+        // a repeated path replaces the older entry, its data simply stays unreferenced
+        m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [&](const PackEntry& entry) {
+            return entry.hash == hash && m_paths.compare(entry.pathOffset, entry.pathLength, normalized) == 0;
+        }), m_entries.end());
+
+        pad(m_alignment);
+
+        PackEntry entry;
+        entry.hash = hash;
+        entry.offset = m_position;
+        entry.size = size;
+        entry.pathOffset = static_cast<uint32_t>(m_paths.size());
+        entry.pathLength = static_cast<uint32_t>(normalized.size());
+        m_entries.push_back(entry);
+        m_paths.append(normalized);
+
+        m_out.write(data, size);
+        m_position += size;
+        return static_cast<bool>(m_out);
+    }
+
+    bool AssetPackWriter::finish()
+    {
+        std::sort(m_entries.begin(), m_entries.end(), [](const PackEntry& a, const PackEntry& b) {
+            return a.hash < b.hash;
+        });
+
+        pad(alignof(PackEntry));
+        PackHeader header;
+        std::memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+        header.version = PACK_VERSION;
+        header.entryCount = static_cast<uint32_t>(m_entries.size());
+        header.alignment = m_alignment;
+        header.tocOffset = m_position;
+        header.pathsOffset = m_position + m_entries.size() * sizeof(PackEntry);
+
+        m_out.write(reinterpret_cast<const char*>(m_entries.data()), m_entries.size() * sizeof(PackEntry));
+        m_out.write(m_paths.data(), m_paths.size());
+        m_out.seekp(0);
+        m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_out.close();
+        return !m_out.fail();
+    }
+
+    void AssetPackWriter::pad(uint64_t alignment)
+    {
+        static const char zeros[64] = {};
+        uint64_t padding = (alignment - m_position % alignment) % alignment;
+        while (padding > 0) {
+            uint64_t chunk = padding < sizeof(zeros) ? padding : sizeof(zeros);
+            m_out.write(zeros, chunk);
+            m_position += chunk;
+            padding -= chunk;
+        }
+    }
+}
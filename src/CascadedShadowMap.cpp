@@ -0,0 +1,183 @@
+#include "CascadedShadowMap.h"
+
+#include <matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    const std::string depthVertexShader{ "shaders\\vShaderDepth.txt" };
+    const std::string depthFragmentShader{ "shaders\\fShaderDepth.txt" };
+}
+
+ShadowSettings ShadowSettings::load(const Settings& settings)
+{
+    ShadowSettings shadows;
+    shadows.enabled = settings.getBool("shadow.enabled", shadows.enabled);
+    shadows.cascadeCount = std::clamp(settings.getInt("shadow.cascades", shadows.cascadeCount), 1, CascadedShadowMap::MAX_CASCADES);
+    shadows.resolution = std::clamp(settings.getInt("shadow.resolution", shadows.resolution), 256, 8192);
+    shadows.distance = settings.getFloat("shadow.distance", shadows.distance);
+    shadows.splitLambda = std::clamp(settings.getFloat("shadow.split_lambda", shadows.splitLambda), 0.0f, 1.0f);
+    shadows.bias = settings.getFloat("shadow.bias", shadows.bias);
+    return shadows;
+}
+
+CascadedShadowMap::CascadedShadowMap(const ShadowSettings& settings, StreamBuffer& stream) :
+    m_settings(settings),
+    m_objects(stream)
+{
+    // the depth is compared by the sampler (sampler2DArrayShadow), which also filters the result
+    glGenTextures(1, &m_depthArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthArray);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, m_settings.resolution, m_settings.resolution, m_settings.cascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &m_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthArray, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SHADOW_MAP:: the shadow framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    m_depthShader = std::make_unique<Shader>(depthVertexShader, depthFragmentShader, "");
+    m_lightSpaceLocation = glGetUniformLocation(m_depthShader->ID, "lightSpace");
+    GLuint objectBlock = glGetUniformBlockIndex(m_depthShader->ID, "Object");
+    if (objectBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_depthShader->ID, objectBlock, ObjectUniformBuffer::BINDING);
+    m_instancedShader = std::make_unique<Shader>(depthVertexShader, depthFragmentShader, "#define INSTANCED\n");
+    m_instancedLightSpaceLocation = glGetUniformLocation(m_instancedShader->ID, "lightSpace");
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    glDeleteFramebuffers(1, &m_FBO);
+    glDeleteTextures(1, &m_depthArray);
+}
+
+void CascadedShadowMap::update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection)
+{
+    // the light view only rotates, the cascades are placed by their projections
+    glm::vec3 direction = glm::normalize(lightDirection);
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    m_lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+    glm::mat4 inverseView = glm::inverse(view);
+    float tanHalfFov = std::tan(fovY * 0.5f);
+    // the squared distance of a frustum corner from the view axis, per unit of depth
+    float k2 = tanHalfFov * tanHalfFov * (1.0f + aspect * aspect);
+    float farPlane = m_settings.distance;
+    int count = m_settings.cascadeCount;
+
+    float splitNear = nearPlane;
+    for (int i = 0; i < count; i++) {
+        // the practical split scheme: a blend of logarithmic and uniform splits
+        float t = static_cast<float>(i + 1) / static_cast<float>(count);
+        float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+        float uniform = nearPlane + (farPlane - nearPlane) * t;
+        float splitFar = m_settings.splitLambda * logarithmic + (1.0f - m_settings.splitLambda) * uniform;
+
+        // the smallest sphere around the slice [splitNear, splitFar]. It only depends on the
+        // depths and the field of view, so it keeps its size however the camera turns
+        float centerDepth = std::min(0.5f * (splitFar + splitNear) * (1.0f + k2), splitFar);
+        float farOffset = splitFar - centerDepth;
+        float radius = std::sqrt(farOffset * farOffset + splitFar * splitFar * k2);
+        float nearOffset = centerDepth - splitNear;
+        radius = std::max(radius, std::sqrt(nearOffset * nearOffset + splitNear * splitNear * k2));
+
+        Cascade& cascade = m_cascades[i];
+        glm::vec3 center = glm::vec3(inverseView * glm::vec4(0.0f, 0.0f, -centerDepth, 1.0f));
+        cascade.center = glm::vec3(m_lightView * glm::vec4(center, 1.0f));
+        cascade.radius = radius;
+        cascade.splitFar = splitFar;
+
+        // snap the center to whole texels, so the same world points land on the same texels
+        float texel = 2.0f * radius / static_cast<float>(m_settings.resolution);
+        cascade.center.x = std::floor(cascade.center.x / texel) * texel;
+        cascade.center.y = std::floor(cascade.center.y / texel) * texel;
+
+        // depth clamping keeps the casters in front of the near plane, so it can stay tight
+        glm::mat4 projection = glm::ortho(cascade.center.x - radius, cascade.center.x + radius,
+                                          cascade.center.y - radius, cascade.center.y + radius,
+                                          -(cascade.center.z + radius), -(cascade.center.z - radius));
+        cascade.lightSpace = projection * m_lightView;
+        splitNear = splitFar;
+    }
+}
+
+void CascadedShadowMap::render(const std::function<void(int cascade)>& drawCasters)
+{
+    // the frame may be rendered offscreen (see DynamicResolution.h)
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glViewport(0, 0, m_settings.resolution, m_settings.resolution);
+    glEnable(GL_DEPTH_CLAMP);
+    // slope-scaled bias, so surfaces at grazing angles to the light do not shadow themselves
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    for (int i = 0; i < m_settings.cascadeCount; i++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthArray, 0, i);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        m_instancedShader->use();
+        glUniformMatrix4fv(m_instancedLightSpaceLocation, 1, GL_FALSE, &m_cascades[i].lightSpace[0][0]);
+        m_depthShader->use();
+        glUniformMatrix4fv(m_lightSpaceLocation, 1, GL_FALSE, &m_cascades[i].lightSpace[0][0]);
+        drawCasters(i);
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+bool CascadedShadowMap::isVisible(int cascade, const BoundingSphere& sphere) const
+{
+    const Cascade& c = m_cascades[cascade];
+    glm::vec3 center = glm::vec3(m_lightView * glm::vec4(sphere.center, 1.0f));
+    float reach = c.radius + sphere.radius;
+    // beside the cascade, or entirely behind it as seen from the light
+    if (std::abs(center.x - c.center.x) > reach || std::abs(center.y - c.center.y) > reach)
+        return false;
+    return center.z + sphere.radius >= c.center.z - c.radius;
+}
+
+void CascadedShadowMap::setModel(const glm::mat4& model)
+{
+    m_depthShader->use();
+    m_objects.update(model);
+}
+
+void CascadedShadowMap::useInstanced()
+{
+    m_instancedShader->use();
+}
+
+void CascadedShadowMap::setUniforms(FrameUniforms& frame) const
+{
+    for (int i = 0; i < m_settings.cascadeCount; i++) {
+        frame.lightSpace[i] = m_cascades[i].lightSpace;
+        frame.cascadeSplits[i] = m_cascades[i].splitFar;
+    }
+    frame.shadowParams = glm::vec4(static_cast<float>(m_settings.cascadeCount), m_settings.bias, 1.0f / static_cast<float>(m_settings.resolution), 0.0f);
+}
+
+void CascadedShadowMap::bindTexture(unsigned int unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthArray);
+    glActiveTexture(GL_TEXTURE0);
+}
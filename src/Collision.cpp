@@ -0,0 +1,314 @@
+#include "Collision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // the height of the cells no triangle covers
+    const float NO_GROUND = -1e30f;
+
+    // a sweep is cut into no more steps than this, however long it is
+    const int MAX_STEPS = 256;
+
+    // the points of a round hull that are tested: the center, and two rings of eight
+    const int RING_POINTS = 8;
+}
+
+CollisionSettings CollisionSettings::load(const Settings& settings)
+{
+    CollisionSettings collision;
+    collision.cellSize = std::max(settings.getFloat("collision.cell_size", collision.cellSize), 0.5f);
+    collision.resolution = std::clamp(settings.getInt("collision.resolution", collision.resolution), 4, 1024);
+    collision.draft = settings.getFloat("collision.draft", collision.draft);
+    return collision;
+}
+
+Heightfield::Heightfield(const Model& model, int resolution)
+{
+    build(model.meshes, resolution);
+}
+
+Heightfield::Heightfield(const ModelData& model, int resolution)
+{
+    build(model.meshes, resolution);
+}
+
+// the meshes of a Model and of a ModelData both have their vertices and indices
+template <typename Meshes>
+void Heightfield::build(const Meshes& meshes, int resolution)
+{
+    BoundingBox box;
+    for (const auto& mesh : meshes)
+        for (const Vertex& vertex : mesh.vertices)
+            box.add(vertex.Position);
+    if (box.isEmpty())
+        return;
+
+    m_min = box.min;
+    m_max = box.max;
+    m_cellSize = std::max(std::max(m_max.x - m_min.x, m_max.z - m_min.z) / static_cast<float>(std::max(resolution, 1)), 1e-4f);
+    m_width = static_cast<int>(std::ceil((m_max.x - m_min.x) / m_cellSize)) + 1;
+    m_depth = static_cast<int>(std::ceil((m_max.z - m_min.z) / m_cellSize)) + 1;
+    m_heights.assign(static_cast<size_t>(m_width) * m_depth, NO_GROUND);
+
+    for (const auto& mesh : meshes)
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+            rasterize(mesh.vertices[mesh.indices[i]].Position, mesh.vertices[mesh.indices[i + 1]].Position, mesh.vertices[mesh.indices[i + 2]].Position);
+}
+
+// raises the cells whose centers the triangle covers, seen from above, to its height there.
+// The corners raise their own cells too, so the triangles smaller than a cell and the steep
+// ones, which cover few centers, are not lost
+void Heightfield::rasterize(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    auto raise = [this](int x, int z, float height) {
+        if (x < 0 || z < 0 || x >= m_width || z >= m_depth)
+            return;
+        float& cell = m_heights[static_cast<size_t>(z) * m_width + x];
+        cell = std::max(cell, height);
+    };
+    for (const glm::vec3* corner : { &a, &b, &c })
+        raise(static_cast<int>((corner->x - m_min.x) / m_cellSize), static_cast<int>((corner->z - m_min.z) / m_cellSize), corner->y);
+
+    float area = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+    if (std::fabs(area) < 1e-12f)
+        return;
+
+    int x0 = std::max(static_cast<int>(std::floor((std::min({ a.x, b.x, c.x }) - m_min.x) / m_cellSize)), 0);
+    int x1 = std::min(static_cast<int>(std::floor((std::max({ a.x, b.x, c.x }) - m_min.x) / m_cellSize)), m_width - 1);
+    int z0 = std::max(static_cast<int>(std::floor((std::min({ a.z, b.z, c.z }) - m_min.z) / m_cellSize)), 0);
+    int z1 = std::min(static_cast<int>(std::floor((std::max({ a.z, b.z, c.z }) - m_min.z) / m_cellSize)), m_depth - 1);
+    for (int z = z0; z <= z1; z++) {
+        float pz = m_min.z + (static_cast<float>(z) + 0.5f) * m_cellSize;
+        for (int x = x0; x <= x1; x++) {
+            float px = m_min.x + (static_cast<float>(x) + 0.5f) * m_cellSize;
+            // barycentric coordinates of the center of the cell
+            float u = ((b.x - px) * (c.z - pz) - (c.x - px) * (b.z - pz)) / area;
+            float v = ((c.x - px) * (a.z - pz) - (a.x - px) * (c.z - pz)) / area;
+            float w = 1.0f - u - v;
+            if (u < 0.0f || v < 0.0f || w < 0.0f)
+                continue;
+            raise(x, z, u * a.y + v * b.y + w * c.y);
+        }
+    }
+}
+
+float Heightfield::cell(int x, int z) const
+{
+    if (x < 0 || z < 0 || x >= m_width || z >= m_depth)
+        return NO_GROUND;
+    return m_heights[static_cast<size_t>(z) * m_width + x];
+}
+
+float Heightfield::height(float x, float z) const
+{
+    return cell(static_cast<int>(std::floor((x - m_min.x) / m_cellSize)), static_cast<int>(std::floor((z - m_min.z) / m_cellSize)));
+}
+
+glm::vec2 Heightfield::downhill(float x, float z) const
+{
+    int cx = static_cast<int>(std::floor((x - m_min.x) / m_cellSize));
+    int cz = static_cast<int>(std::floor((z - m_min.z) / m_cellSize));
+    // the cells without ground count as the bottom of the model, so the slope points off the shore
+    auto at = [this](int x, int z) { return std::max(cell(x, z), m_min.y); };
+    glm::vec2 slope(at(cx - 1, cz) - at(cx + 1, cz), at(cx, cz - 1) - at(cx, cz + 1));
+    float length = glm::length(slope);
+    return length > 1e-6f ? slope / length : glm::vec2(0.0f);
+}
+
+unsigned int CollisionWorld::add(std::shared_ptr<const Heightfield> heightfield, const glm::mat4& model)
+{
+    Collider collider;
+    collider.model = model;
+    collider.inverse = glm::inverse(model);
+    collider.min = glm::vec2(std::numeric_limits<float>::max());
+    collider.max = glm::vec2(-std::numeric_limits<float>::max());
+    const glm::vec3& low = heightfield->getMin();
+    const glm::vec3& high = heightfield->getMax();
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point((corner & 1) ? high.x : low.x, (corner & 2) ? high.y : low.y, (corner & 4) ? high.z : low.z);
+        glm::vec3 world = glm::vec3(model * glm::vec4(point, 1.0f));
+        collider.min = glm::min(collider.min, glm::vec2(world.x, world.z));
+        collider.max = glm::max(collider.max, glm::vec2(world.x, world.z));
+    }
+    collider.heightfield = std::move(heightfield);
+
+    if (m_freeHandles.empty()) {
+        m_colliders.push_back(std::move(collider));
+        return static_cast<unsigned int>(m_colliders.size() - 1);
+    }
+    unsigned int handle = m_freeHandles.back();
+    m_freeHandles.pop_back();
+    m_colliders[handle] = std::move(collider);
+    return handle;
+}
+
+void CollisionWorld::remove(unsigned int handle)
+{
+    if (handle >= m_colliders.size() || !m_colliders[handle].active)
+        return;
+    m_colliders[handle].active = false;
+    m_colliders[handle].heightfield.reset();
+    m_freeHandles.push_back(handle);
+}
+
+unsigned int CollisionWorld::hashCell(int x, int z) const
+{
+    unsigned int hash = static_cast<unsigned int>(x) * 73856093u ^ static_cast<unsigned int>(z) * 83492791u;
+    return hash & m_bucketMask;
+}
+
+// a counting sort of the (cell, collider) pairs by bucket, as for the birds of a Flock
+void CollisionWorld::build()
+{
+    // one entry per cell covered by every collider
+    struct Entry {
+        int x;
+        int z;
+        unsigned int collider;
+    };
+    std::vector<Entry> covered;
+    for (unsigned int i = 0; i < m_colliders.size(); i++) {
+        const Collider& collider = m_colliders[i];
+        if (!collider.active)
+            continue;
+        int x0 = static_cast<int>(std::floor(collider.min.x / m_settings.cellSize));
+        int x1 = static_cast<int>(std::floor(collider.max.x / m_settings.cellSize));
+        int z0 = static_cast<int>(std::floor(collider.min.y / m_settings.cellSize));
+        int z1 = static_cast<int>(std::floor(collider.max.y / m_settings.cellSize));
+        for (int z = z0; z <= z1; z++)
+            for (int x = x0; x <= x1; x++)
+                covered.push_back({ x, z, i });
+    }
+
+    unsigned int buckets = 1;
+    while (buckets < 2 * covered.size())
+        buckets <<= 1;
+    m_bucketMask = buckets - 1;
+
+    m_bucketStart.assign(buckets + 1, 0);
+    for (const Entry& entry : covered)
+        m_bucketStart[hashCell(entry.x, entry.z) + 1]++;
+    for (unsigned int b = 0; b < buckets; b++)
+        m_bucketStart[b + 1] += m_bucketStart[b];
+
+    m_entries.resize(covered.size());
+    std::vector<unsigned int> next(m_bucketStart.begin(), m_bucketStart.end() - 1);
+    for (const Entry& entry : covered)
+        m_entries[next[hashCell(entry.x, entry.z)]++] = entry.collider;
+}
+
+// the colliders whose boxes overlap a box. A collider covering several cells, or sharing a
+// bucket with another cell, is found more than once, so the duplicates are dropped
+void CollisionWorld::gather(const glm::vec2& min, const glm::vec2& max, std::vector<unsigned int>& found) const
+{
+    found.clear();
+    if (m_entries.empty())
+        return;
+    int x0 = static_cast<int>(std::floor(min.x / m_settings.cellSize));
+    int x1 = static_cast<int>(std::floor(max.x / m_settings.cellSize));
+    int z0 = static_cast<int>(std::floor(min.y / m_settings.cellSize));
+    int z1 = static_cast<int>(std::floor(max.y / m_settings.cellSize));
+    for (int z = z0; z <= z1; z++)
+        for (int x = x0; x <= x1; x++) {
+            unsigned int bucket = hashCell(x, z);
+            for (unsigned int e = m_bucketStart[bucket]; e < m_bucketStart[bucket + 1]; e++) {
+                unsigned int index = m_entries[e];
+                const Collider& collider = m_colliders[index];
+                if (!collider.active || collider.max.x < min.x || collider.min.x > max.x || collider.max.y < min.y || collider.min.y > max.y)
+                    continue;
+                if (std::find(found.begin(), found.end(), index) == found.end())
+                    found.push_back(index);
+            }
+        }
+}
+
+// tests the center of the hull and two rings of points around it against the heightfield.
+// The normal is the way down the slope under the first point that touches
+bool CollisionWorld::touches(const Collider& collider, const glm::vec2& center, float radius, glm::vec2* normal) const
+{
+    for (int i = 0; i <= 2 * RING_POINTS; i++) {
+        glm::vec2 point = center;
+        if (i > 0) {
+            float ring = i <= RING_POINTS ? radius : radius * 0.5f;
+            float around = 6.2831853f * (static_cast<float>(i % RING_POINTS) + (i <= RING_POINTS ? 0.0f : 0.5f)) / RING_POINTS;
+            point += glm::vec2(std::sin(around), std::cos(around)) * ring;
+        }
+
+        glm::vec4 local = collider.inverse * glm::vec4(point.x, 0.0f, point.y, 1.0f);
+        float height = collider.heightfield->height(local.x, local.z);
+        if (height == NO_GROUND)
+            continue;
+        float worldHeight = (collider.model * glm::vec4(local.x, height, local.z, 1.0f)).y;
+        if (worldHeight <= -m_settings.draft)
+            continue;
+
+        if (normal != nullptr) {
+            glm::vec2 downhill = collider.heightfield->downhill(local.x, local.z);
+            glm::vec4 direction = collider.model * glm::vec4(downhill.x, 0.0f, downhill.y, 0.0f);
+            glm::vec2 out(direction.x, direction.z);
+            if (glm::length(out) < 1e-6f)
+                out = center - point;
+            *normal = glm::length(out) > 1e-6f ? glm::normalize(out) : glm::vec2(0.0f);
+        }
+        return true;
+    }
+    return false;
+}
+
+SweepResult CollisionWorld::sweep(const glm::vec2& from, const glm::vec2& to, float radius) const
+{
+    SweepResult result;
+    result.position = to;
+    glm::vec2 move = to - from;
+    float distance = glm::length(move);
+    if (distance < 1e-6f)
+        return result;
+
+    // the list is kept by every thread from one sweep to the next, so a sweep does not allocate
+    thread_local std::vector<unsigned int> found;
+    gather(glm::min(from, to) - glm::vec2(radius), glm::max(from, to) + glm::vec2(radius), found);
+    // a hull already aground on an island (it was placed there) is let off it, or it
+    // could never move again
+    found.erase(std::remove_if(found.begin(), found.end(), [&](unsigned int index) {
+        return touches(m_colliders[index], from, radius, nullptr);
+    }), found.end());
+    if (found.empty())
+        return result;
+
+    // steps of half a heightfield cell, in the world, so no cell is skipped over
+    float step = radius;
+    for (unsigned int index : found) {
+        const Collider& collider = m_colliders[index];
+        float scale = glm::length(glm::vec3(collider.model[0]));
+        step = std::min(step, 0.5f * collider.heightfield->getCellSize() * scale);
+    }
+    int steps = std::clamp(static_cast<int>(std::ceil(distance / std::max(step, 1e-4f))), 1, MAX_STEPS);
+
+    for (int i = 1; i <= steps; i++) {
+        float fraction = static_cast<float>(i) / static_cast<float>(steps);
+        glm::vec2 center = from + move * fraction;
+        for (unsigned int index : found) {
+            glm::vec2 normal;
+            if (!touches(m_colliders[index], center, radius, &normal))
+                continue;
+            result.hit = true;
+            result.fraction = static_cast<float>(i - 1) / static_cast<float>(steps);
+            result.position = from + move * result.fraction;
+            result.normal = normal;
+            return result;
+        }
+    }
+    return result;
+}
+
+bool CollisionWorld::overlaps(const glm::vec2& center, float radius) const
+{
+    thread_local std::vector<unsigned int> found;
+    gather(center - glm::vec2(radius), center + glm::vec2(radius), found);
+    for (unsigned int index : found)
+        if (touches(m_colliders[index], center, radius, nullptr))
+            return true;
+    return false;
+}
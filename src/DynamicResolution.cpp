@@ -0,0 +1,130 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    // how much of the way to the wanted scale a frame goes, when it is lower and higher
+    const float SCALE_DOWN_RATE = 0.5f;
+    const float SCALE_UP_RATE = 0.05f;
+
+    // smaller changes of the scale are not worth the blur of another resolution
+    const float SCALE_STEP = 0.02f;
+
+    // the sizes of the frame are kept to multiples of this, in pixels
+    const int SIZE_ALIGNMENT = 8;
+}
+
+ResolutionSettings ResolutionSettings::load(const Settings& settings)
+{
+    ResolutionSettings resolution;
+    resolution.enabled = settings.getBool("resolution.enabled", resolution.enabled);
+    resolution.targetMs = std::max(settings.getFloat("resolution.target_ms", resolution.targetMs), 1.0f);
+    resolution.maxScale = std::clamp(settings.getFloat("resolution.max_scale", resolution.maxScale), 0.25f, 1.0f);
+    resolution.minScale = std::clamp(settings.getFloat("resolution.min_scale", resolution.minScale), 0.25f, resolution.maxScale);
+    return resolution;
+}
+
+DynamicResolution::DynamicResolution(const ResolutionSettings& settings) :
+    m_settings(settings),
+    m_scale(settings.maxScale)
+{
+    glGenFramebuffers(1, &m_FBO);
+    glGenRenderbuffers(1, &m_colorBuffer);
+    glGenRenderbuffers(1, &m_depthBuffer);
+    glGenQueries(QUERIES, m_queries);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    glDeleteQueries(QUERIES, m_queries);
+    glDeleteRenderbuffers(1, &m_depthBuffer);
+    glDeleteRenderbuffers(1, &m_colorBuffer);
+    glDeleteFramebuffers(1, &m_FBO);
+}
+
+void DynamicResolution::resize(int width, int height)
+{
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (width == m_width && height == m_height)
+        return;
+    m_width = width;
+    m_height = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::RESOLUTION:: the offscreen framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// the results come in the order the queries were issued, so the oldest is read first, and
+// only once it is available: reading it earlier would wait for the GPU
+void DynamicResolution::collectQueries()
+{
+    while (m_pendingQueries > 0) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_queries[m_firstQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(m_queries[m_firstQuery], GL_QUERY_RESULT, &nanoseconds);
+        m_firstQuery = (m_firstQuery + 1) % QUERIES;
+        m_pendingQueries--;
+        adapt(static_cast<float>(nanoseconds) / 1000000.0f);
+    }
+}
+
+// the time of a frame grows about with its area, so the scale that fits the budget is the
+// current one times the square root of the budget over the time
+void DynamicResolution::adapt(float frameMs)
+{
+    // a single stall, e.g. a shader compiled in the middle of a frame, counts as a few budgets
+    // at most, so it does not hold the average up for long
+    frameMs = std::min(frameMs, 4.0f * m_settings.targetMs);
+    m_gpuMs = m_gpuMs == 0.0f ? frameMs : m_gpuMs + (frameMs - m_gpuMs) * 0.25f;
+    if (m_gpuMs <= 0.0f)
+        return;
+    float wanted = std::clamp(m_scale * std::sqrt(m_settings.targetMs / m_gpuMs), m_settings.minScale, m_settings.maxScale);
+    float scale = m_scale + (wanted - m_scale) * (wanted < m_scale ? SCALE_DOWN_RATE : SCALE_UP_RATE);
+    if (std::abs(scale - m_scale) >= SCALE_STEP || wanted == m_settings.minScale || wanted == m_settings.maxScale)
+        m_scale = scale;
+}
+
+void DynamicResolution::begin()
+{
+    collectQueries();
+
+    m_renderWidth = std::clamp((static_cast<int>(m_width * m_scale) + SIZE_ALIGNMENT / 2) / SIZE_ALIGNMENT * SIZE_ALIGNMENT, std::min(m_width, SIZE_ALIGNMENT), m_width);
+    m_renderHeight = std::clamp((static_cast<int>(m_height * m_scale) + SIZE_ALIGNMENT / 2) / SIZE_ALIGNMENT * SIZE_ALIGNMENT, std::min(m_height, SIZE_ALIGNMENT), m_height);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glViewport(0, 0, m_renderWidth, m_renderHeight);
+
+    // with every query still in flight, this frame goes untimed rather than waiting
+    m_timing = m_pendingQueries < QUERIES;
+    if (m_timing)
+        glBeginQuery(GL_TIME_ELAPSED, m_queries[(m_firstQuery + m_pendingQueries) % QUERIES]);
+}
+
+void DynamicResolution::end()
+{
+    if (m_timing) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_pendingQueries++;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, m_renderWidth, m_renderHeight, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, m_width, m_height);
+}
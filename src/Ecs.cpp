@@ -0,0 +1,150 @@
+#include <Ecs.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+namespace Ecs {
+
+    namespace detail {
+        static std::atomic<unsigned int> s_componentCount{ 0 };
+        static size_t s_componentSizes[MAX_COMPONENTS] = {};
+
+        unsigned int registerComponent(size_t size) {
+            unsigned int id = s_componentCount++;
+            if (id >= MAX_COMPONENTS) {
+                std::cout << "ERROR::ECS::TOO_MANY_COMPONENT_TYPES" << std::endl;
+                std::abort();
+            }
+            s_componentSizes[id] = size;
+            return id;
+        }
+
+        size_t componentSize(unsigned int id) {
+            return s_componentSizes[id];
+        }
+    }
+
+    Entity Registry::allocate() {
+        Entity entity;
+        if (!m_free.empty()) {
+            entity.index = m_free.back();
+            m_free.pop_back();
+        } else {
+            entity.index = static_cast<unsigned int>(m_generations.size());
+            m_generations.push_back(0);
+            m_locations.emplace_back();
+        }
+        entity.generation = m_generations[entity.index];
+        return entity;
+    }
+
+    Registry::Archetype& Registry::archetypeFor(Mask mask) {
+        auto found = m_archetypeOfMask.find(mask);
+        if (found != m_archetypeOfMask.end())
+            return *m_archetypes[found->second];
+
+        // lay the chunk out: the entities, then one array per component, each aligned
+        // to 16 bytes, with as many rows as fit
+        auto archetype = std::make_unique<Archetype>();
+        archetype->mask = mask;
+        size_t rowBytes = sizeof(Entity);
+        for (unsigned int id = 0; id < MAX_COMPONENTS; id++) {
+            if (mask & (Mask(1) << id))
+                rowBytes += detail::componentSize(id);
+        }
+        size_t capacity = CHUNK_BYTES / rowBytes;
+        for (;; capacity--) {
+            size_t offset = (sizeof(Entity) * capacity + 15) & ~size_t(15);
+            for (unsigned int id = 0; id < MAX_COMPONENTS; id++) {
+                if (mask & (Mask(1) << id)) {
+                    archetype->offsets[id] = offset;
+                    offset = (offset + detail::componentSize(id) * capacity + 15) & ~size_t(15);
+                }
+            }
+            if (offset <= CHUNK_BYTES || capacity == 1)
+                break;
+        }
+        archetype->capacity = static_cast<unsigned int>(capacity);
+
+        m_archetypeOfMask[mask] = static_cast<unsigned int>(m_archetypes.size());
+        m_archetypes.push_back(std::move(archetype));
+        return *m_archetypes.back();
+    }
+
+    Registry::Location Registry::insert(Archetype& archetype, Entity entity) {
+        m_version++;
+        if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity) {
+            Chunk chunk;
+            chunk.data = m_chunkPool.acquire();
+            archetype.chunks.push_back(chunk);
+        }
+        Chunk& chunk = archetype.chunks.back();
+
+        Location location;
+        location.archetype = m_archetypeOfMask[archetype.mask];
+        location.chunk = static_cast<unsigned int>(archetype.chunks.size() - 1);
+        location.row = chunk.count++;
+        entities(archetype, chunk)[location.row] = entity;
+        m_locations[entity.index] = location;
+        return location;
+    }
+
+    void Registry::erase(const Location& location) {
+        m_version++;
+        // the last entity of the archetype fills the hole, so the chunks stay dense
+        Archetype& archetype = *m_archetypes[location.archetype];
+        Chunk& last = archetype.chunks.back();
+        unsigned int lastRow = last.count - 1;
+        Chunk& chunk = archetype.chunks[location.chunk];
+        if (&chunk != &last || location.row != lastRow) {
+            Entity moved = entities(archetype, last)[lastRow];
+            entities(archetype, chunk)[location.row] = moved;
+            for (unsigned int id = 0; id < MAX_COMPONENTS; id++) {
+                if (archetype.mask & (Mask(1) << id)) {
+                    size_t size = detail::componentSize(id);
+                    std::memcpy(static_cast<unsigned char*>(column(archetype, chunk, id)) + location.row * size,
+                                static_cast<unsigned char*>(column(archetype, last, id)) + lastRow * size, size);
+                }
+            }
+            m_locations[moved.index] = location;
+        }
+        if (--last.count == 0) {
+            m_chunkPool.release(last.data);
+            archetype.chunks.pop_back();
+        }
+    }
+
+    void Registry::destroy(Entity entity) {
+        if (!isAlive(entity))
+            return;
+        erase(m_locations[entity.index]);
+        m_locations[entity.index] = Location();
+        m_generations[entity.index]++;
+        m_free.push_back(entity.index);
+    }
+
+    void Registry::move(Entity entity, Mask mask) {
+        Location from = m_locations[entity.index];
+        Mask common = m_archetypes[from.archetype]->mask & mask;
+        // the archetype may be created here, which may move the vector of archetypes,
+        // but not the archetypes themselves
+        Archetype& target = archetypeFor(mask);
+        Location to = insert(target, entity);
+        Archetype& source = *m_archetypes[from.archetype];
+        for (unsigned int id = 0; id < MAX_COMPONENTS; id++) {
+            if (common & (Mask(1) << id)) {
+                size_t size = detail::componentSize(id);
+                std::memcpy(static_cast<unsigned char*>(column(target, target.chunks[to.chunk], id)) + to.row * size,
+                            static_cast<unsigned char*>(column(source, source.chunks[from.chunk], id)) + from.row * size, size);
+            }
+        }
+        erase(from);
+        // erase() may have moved another entity into the old place, but never this one
+        m_locations[entity.index] = to;
+    }
+
+    void Registry::write(const Location& location, unsigned int id, const void* component) {
+        std::memcpy(column(location, id), component, detail::componentSize(id));
+    }
+}
@@ -0,0 +1,156 @@
+#include "FileSystem.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace FileSystem {
+
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& path)
+    {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_valid = true;
+
+        // a mapping of an empty file cannot be created, but an empty file is still a file
+        if (m_size > 0) {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping != NULL) {
+                m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                // the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+            if (m_data == nullptr) {
+                m_size = 0;
+                m_valid = false;
+            }
+        }
+        CloseHandle(file);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data != nullptr)
+            UnmapViewOfFile(m_data);
+    }
+#else
+    MappedFile::MappedFile(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            ::close(fd);
+            return;
+        }
+        m_size = static_cast<size_t>(info.st_size);
+        m_valid = true;
+
+        if (m_size > 0) {
+            void* mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                m_size = 0;
+                m_valid = false;
+            }
+            else {
+                // the loaders read the files front to back, once
+                madvise(mapping, m_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(mapping);
+            }
+        }
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data != nullptr)
+            munmap(const_cast<char*>(m_data), m_size);
+    }
+#endif
+
+    FileView DirectoryMount::open(const std::string& path)
+    {
+        std::string fullPath = m_root.empty() ? path : m_root + '/' + path;
+        auto file = std::make_shared<MappedFile>(fullPath);
+        if (!file->isValid())
+            return FileView();
+        return FileView(file->data(), file->size(), file);
+    }
+
+    void Vfs::mount(std::shared_ptr<Mount> mount)
+    {
+        m_mounts.push_back(mount);
+    }
+
+    FileView Vfs::open(const std::string& path)
+    {
+        if (m_mounts.empty())
+            m_mounts.push_back(std::make_shared<DirectoryMount>());
+
+        std::string normalized = normalize(path);
+        for (auto mount = m_mounts.rbegin(); mount != m_mounts.rend(); ++mount) {
+            FileView view = (*mount)->open(normalized);
+            if (view)
+                return view;
+        }
+        return FileView();
+    }
+
+    std::string Vfs::normalize(const std::string& path)
+    {
+        std::vector<std::string> parts;
+        std::string part;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+        for (size_t i = 0; i <= path.size(); i++) {
+            if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+                if (part == "..") {
+                    if (!parts.empty() && parts.back() != "..")
+                        parts.pop_back();
+                    else
+                        parts.push_back(part);
+                }
+                else if (!part.empty() && part != ".") {
+                    parts.push_back(part);
+                }
+                part.clear();
+            }
+            else {
+                part.push_back(path[i]);
+            }
+        }
+
+        std::string normalized = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (i > 0)
+                normalized.push_back('/');
+            normalized.append(parts[i]);
+        }
+        return normalized;
+    }
+
+    Vfs& vfs()
+    {
+        static Vfs instance;
+        return instance;
+    }
+}
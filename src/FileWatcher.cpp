@@ -0,0 +1,113 @@
+#include "FileWatcher.h"
+
+#include <FileSystem.h>
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+    std::string directoryOf(const std::string& path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "" : path.substr(0, slash);
+    }
+}
+
+FileWatcher::FileWatcher()
+{
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+        std::cout << "ERROR::FILE_WATCHER:: inotify is not available" << std::endl;
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_inotify >= 0)
+        close(m_inotify);
+}
+
+void FileWatcher::watch(const std::string& path)
+{
+    std::string file = FileSystem::Vfs::normalize(path);
+    if (!m_files.insert(file).second || m_inotify < 0)
+        return;
+
+    // the directory is watched rather than the file, because most editors save by
+    // writing a new file and renaming it over the old one
+    std::string directory = directoryOf(file);
+    for (const auto& watched : m_directories)
+        if (watched.second == directory)
+            return;
+    int watch = inotify_add_watch(m_inotify, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (watch < 0) {
+        std::cout << "ERROR::FILE_WATCHER:: cannot watch " << directory << std::endl;
+        return;
+    }
+    m_directories[watch] = directory;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::set<std::string> changed;
+    if (m_inotify >= 0) {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+            for (char* event = buffer; event < buffer + length; ) {
+                const inotify_event* info = reinterpret_cast<const inotify_event*>(event);
+                auto directory = m_directories.find(info->wd);
+                if (directory != m_directories.end() && info->len > 0) {
+                    std::string file = directory->second.empty() ? info->name : directory->second + '/' + info->name;
+                    if (m_files.count(file))
+                        changed.insert(file);
+                }
+                event += sizeof(inotify_event) + info->len;
+            }
+        }
+    }
+    return std::vector<std::string>(changed.begin(), changed.end());
+}
+
+#else
+
+FileWatcher::FileWatcher()
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+void FileWatcher::watch(const std::string& path)
+{
+    std::string file = FileSystem::Vfs::normalize(path);
+    if (!m_files.insert(file).second)
+        return;
+    std::error_code error;
+    m_times[file] = std::filesystem::last_write_time(file, error);
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+    // asking for the times on every frame would cost more than it is worth
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastCheck < std::chrono::milliseconds(250))
+        return changed;
+    m_lastCheck = now;
+
+    for (auto& file : m_times) {
+        std::error_code error;
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(file.first, error);
+        if (!error && time != file.second) {
+            file.second = time;
+            changed.push_back(file.first);
+        }
+    }
+    return changed;
+}
+
+#endif
@@ -0,0 +1,331 @@
+#include "Fleet.h"
+
+#include <Components.h>
+#include <FileSystem.h>
+
+#include <matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    const float SHIP_SCALE = 0.03f;
+    const float SEAGULL_SCALE = 0.03f;
+    const float BUG_SCALE = 0.0003f;
+
+    const float SHIP_SPEED = 2.5f;    // units per second, the default speed of the player's ship
+    const float TURN_RATE = 30.0f;    // degrees per second
+    const float BUG_SPEED = 0.6f;     // radians per second
+
+    // returns the angle from one heading to another, in degrees, the short way round
+    float headingDifference(float from, float to) {
+        float difference = std::fmod(to - from, 360.0f);
+        if (difference > 180.0f)
+            difference -= 360.0f;
+        else if (difference < -180.0f)
+            difference += 360.0f;
+        return difference;
+    }
+}
+
+FleetSettings FleetSettings::load(const Settings& settings)
+{
+    FleetSettings fleet;
+    fleet.ships = std::max(settings.getInt("fleet.ships", fleet.ships), 0);
+    fleet.followers = std::max(settings.getInt("fleet.followers", fleet.followers), 0);
+    fleet.bugs = std::max(settings.getInt("fleet.bugs", fleet.bugs), 0);
+    fleet.radius = std::max(settings.getFloat("fleet.radius", fleet.radius), 10.0f);
+    fleet.replay = settings.getString("fleet.replay", fleet.replay);
+    fleet.replayShips = std::max(settings.getInt("fleet.replay_ships", fleet.replayShips), 0);
+    return fleet;
+}
+
+bool ReplayTrack::load(const std::string& path)
+{
+    FileSystem::FileView file = FileSystem::vfs().open(path);
+    if (!file)
+        return false;
+
+    m_keys.clear();
+    std::istringstream lines(std::string(file.data(), file.size()));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        Key key;
+        if (words >> key.time >> key.position.x >> key.position.y >> key.angle)
+            m_keys.push_back(key);
+    }
+    if (m_keys.empty())
+        std::cout << "ERROR::REPLAY:: no track in " << path << std::endl;
+    return !m_keys.empty();
+}
+
+bool ReplayTrack::save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::REPLAY:: could not write " << path << std::endl;
+        return false;
+    }
+    for (const Key& key : m_keys)
+        file << key.time << ' ' << key.position.x << ' ' << key.position.y << ' ' << key.angle << '\n';
+    return true;
+}
+
+void ReplayTrack::record(float time, const glm::vec2& position, float angle)
+{
+    m_keys.push_back({ time, position, angle });
+}
+
+ReplayTrack::Key ReplayTrack::sample(float time) const
+{
+    if (m_keys.size() < 2)
+        return m_keys.empty() ? Key{ time, glm::vec2(0.0f), 0.0f } : m_keys.front();
+
+    float duration = m_keys.back().time - m_keys.front().time;
+    if (duration <= 0.0f)
+        return m_keys.front();
+    float t = m_keys.front().time + std::fmod(std::max(time, 0.0f), duration);
+
+    auto next = std::upper_bound(m_keys.begin(), m_keys.end(), t, [](float value, const Key& key) { return value < key.time; });
+    if (next == m_keys.end())
+        return m_keys.back();
+    auto previous = next - 1;
+    float blend = (t - previous->time) / std::max(next->time - previous->time, 1e-6f);
+
+    Key key;
+    key.time = time;
+    key.position = previous->position + (next->position - previous->position) * blend;
+    key.angle = previous->angle + headingDifference(previous->angle, next->angle) * blend;
+    return key;
+}
+
+Fleet::Fleet(const std::string& shipModel, const std::string& seagullModel, const std::string& bugModel, StreamBuffer& stream, MaterialTable* table) :
+    m_shipModel(shipModel, false, nullptr, table),
+    m_seagullModel(seagullModel, false, nullptr, table),
+    m_bugModel(bugModel, false, nullptr, table),
+    m_hull(m_shipModel.bounds.radius * SHIP_SCALE * 0.6f, m_shipModel.bounds.radius * SHIP_SCALE * 0.18f),
+    m_hullRadius(m_shipModel.bounds.radius * SHIP_SCALE * 0.3f),
+    m_stream(stream),
+    m_shipInstances(stream),
+    m_seagullInstances(stream),
+    m_bugInstances(stream),
+    m_random(1234)
+{
+}
+
+void Fleet::useGpuCulling(const GpuCullingSettings& settings)
+{
+    m_gpuCuller = std::make_unique<GpuCuller>(m_stream);
+    m_gpuShips = m_gpuCuller->addModel(m_shipModel);
+    m_gpuSeagulls = m_gpuCuller->addModel(m_seagullModel, settings.seagullDistance);
+    m_gpuBugs = m_gpuCuller->addModel(m_bugModel, settings.bugDistance);
+
+    // the instances are read from the buffer of the culler instead of the instance buffers
+    m_shipModel.arena->setInstanceBuffer(m_gpuCuller->getBuffer());
+    m_seagullModel.arena->setInstanceBuffer(m_gpuCuller->getBuffer());
+    m_bugModel.arena->setInstanceBuffer(m_gpuCuller->getBuffer());
+}
+
+void Fleet::addShip(const glm::vec2& position, float angle, int followers, int bugs, Controller controller)
+{
+    unsigned int ship = static_cast<unsigned int>(m_positions.size());
+    m_positions.push_back(position);
+    m_angles.push_back(angle);
+    m_poses.emplace_back();
+    m_controllers.push_back(controller);
+    m_origins.push_back(position);
+    m_targets.push_back(randomPoint());
+
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    m_flock.setTarget(ship, glm::vec3(position.x, 1.0f, position.y));
+    for (int i = 0; i < followers; i++) {
+        glm::vec3 start(position.x + unit(m_random), 1.0f + 0.3f * unit(m_random), position.y + unit(m_random));
+        unsigned int follower = m_flock.addBird(start, ship);
+        for (int j = 0; j < bugs; j++)
+            m_bugs.push_back({ follower, 0.2f * (1.0f + 0.5f * (j / 2)), 3.14159265f * j });
+    }
+
+    m_sampleX.resize(m_positions.size() * Buoyancy::POINTS);
+    m_sampleZ.resize(m_positions.size() * Buoyancy::POINTS);
+    m_sampleHeights.resize(m_positions.size() * Buoyancy::POINTS);
+}
+
+void Fleet::spawn(const FleetSettings& settings)
+{
+    m_radius = settings.radius;
+    if (!settings.replay.empty())
+        m_replay.load(settings.replay);
+
+    // rings of ships, 5 units apart, starting clear of the islands around the origin
+    int placed = 0;
+    for (float ring = 12.0f; placed < settings.ships; ring += 5.0f) {
+        int onRing = std::max(static_cast<int>(6.2831853f * ring / 5.0f), 1);
+        for (int i = 0; i < onRing && placed < settings.ships; i++, placed++) {
+            float around = 6.2831853f * static_cast<float>(i) / static_cast<float>(onRing);
+            glm::vec2 position(ring * std::sin(around), ring * std::cos(around));
+            Controller controller = !m_replay.empty() && placed < settings.replayShips ? Controller::REPLAY : Controller::AI;
+            addShip(position, glm::degrees(around) + 90.0f, settings.followers, settings.bugs, controller);
+        }
+    }
+}
+
+glm::vec2 Fleet::randomPoint()
+{
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float distance = m_radius * std::sqrt(unit(m_random));
+    float around = 6.2831853f * unit(m_random);
+    return glm::vec2(distance * std::sin(around), distance * std::cos(around));
+}
+
+void Fleet::steer(size_t ship, float time, float deltaTime)
+{
+    if (m_controllers[ship] == Controller::REPLAY) {
+        // the replayed ships are spread over the track, so they do not sail on top of each other
+        ReplayTrack::Key start = m_replay.sample(0.0f);
+        ReplayTrack::Key key = m_replay.sample(time + 7.0f * static_cast<float>(ship));
+        m_positions[ship] = m_origins[ship] + key.position - start.position;
+        m_angles[ship] = key.angle;
+        return;
+    }
+
+    // the AI turns towards its target at a limited rate and picks another one on arrival
+    glm::vec2 toTarget = m_targets[ship] - m_positions[ship];
+    if (glm::dot(toTarget, toTarget) < 9.0f)
+        m_targets[ship] = randomPoint();
+    float wanted = glm::degrees(std::atan2(toTarget.x, toTarget.y));
+    float turn = std::clamp(headingDifference(m_angles[ship], wanted), -TURN_RATE * deltaTime, TURN_RATE * deltaTime);
+    m_angles[ship] += turn;
+
+    float heading = glm::radians(m_angles[ship]);
+    glm::vec2 to = m_positions[ship] + glm::vec2(std::sin(heading), std::cos(heading)) * SHIP_SPEED * deltaTime;
+    if (m_collision != nullptr) {
+        // a ship that runs into an island stops at the shore and heads away from it,
+        // until it reaches open water and picks another target
+        SweepResult result = m_collision->sweep(m_positions[ship], to, m_hullRadius);
+        if (result.hit)
+            m_targets[ship] = result.position + result.normal * 10.0f;
+        to = result.position;
+    }
+    m_positions[ship] = to;
+}
+
+void Fleet::update(const Waves& waves, float time, float deltaTime)
+{
+    size_t shipCount = m_positions.size();
+    for (size_t i = 0; i < shipCount; i++) {
+        steer(i, time, deltaTime);
+        m_hull.samplePoints(m_positions[i], m_angles[i], &m_sampleX[i * Buoyancy::POINTS], &m_sampleZ[i * Buoyancy::POINTS]);
+    }
+
+    // all the hulls at once, so the waves are evaluated four points at a time
+    waves.sample(m_sampleX.data(), m_sampleZ.data(), m_sampleX.size(), m_sampleHeights.data());
+
+    m_shipMatrices.resize(shipCount);
+    for (size_t i = 0; i < shipCount; i++) {
+        HullPose& pose = m_poses[i];
+        m_hull.settle(&m_sampleHeights[i * Buoyancy::POINTS], deltaTime, pose);
+
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(m_positions[i].x, pose.heave, m_positions[i].y));
+        model = glm::rotate(model, glm::radians(m_angles[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::rotate(model, pose.pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::rotate(model, pose.roll, glm::vec3(0.0f, 0.0f, 1.0f));
+        m_shipMatrices[i] = glm::scale(model, glm::vec3(SHIP_SCALE));
+    }
+
+    for (size_t i = 0; i < shipCount; i++)
+        m_flock.setTarget(static_cast<unsigned int>(i), glm::vec3(m_positions[i].x, 1.0f, m_positions[i].y));
+    m_flock.update(deltaTime);
+
+    m_seagullMatrices.resize(m_flock.getBirdCount());
+    for (unsigned int i = 0; i < m_flock.getBirdCount(); i++) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), m_flock.getPosition(i));
+        model = glm::rotate(model, glm::radians(m_flock.getHeading(i)), glm::vec3(0.0f, 1.0f, 0.0f));
+        m_seagullMatrices[i] = glm::scale(model, glm::vec3(SEAGULL_SCALE));
+    }
+
+    m_bugMatrices.resize(m_bugs.size());
+    for (size_t i = 0; i < m_bugs.size(); i++) {
+        Bug& bug = m_bugs[i];
+        bug.angle = std::fmod(bug.angle + BUG_SPEED * deltaTime, 6.2831853f);
+        glm::vec3 position = m_flock.getPosition(bug.follower) + glm::vec3(std::sin(bug.angle), 0.0f, std::cos(bug.angle)) * bug.radius;
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        m_bugMatrices[i] = glm::scale(model, glm::vec3(BUG_SCALE));
+    }
+
+    if (m_gpuCuller) {
+        m_gpuCuller->setInstances(m_gpuShips, m_shipMatrices);
+        m_gpuCuller->setInstances(m_gpuSeagulls, m_seagullMatrices);
+        m_gpuCuller->setInstances(m_gpuBugs, m_bugMatrices);
+        m_gpuCuller->upload();
+        return;
+    }
+    uploadInstances(m_shipModel, m_shipMatrices, m_shipInstances);
+    uploadInstances(m_seagullModel, m_seagullMatrices, m_seagullInstances);
+    uploadInstances(m_bugModel, m_bugMatrices, m_bugInstances);
+}
+
+// the matrices go to a new range of the stream every time, which the arena then reads
+void Fleet::uploadInstances(Model& model, const std::vector<glm::mat4>& matrices, InstanceBuffer& instances)
+{
+    instances.update(matrices);
+    model.arena->setInstanceBuffer(instances.getBuffer(), instances.getOffset());
+}
+
+void Fleet::cull(const glm::mat4& view, const glm::mat4& projection, const OcclusionCuller* culler)
+{
+    if (m_gpuCuller) {
+        m_gpuCuller->cull(view, projection, culler);
+        return;
+    }
+    if (culler == nullptr)
+        return;
+
+    auto upload = [this, culler](Model& model, const std::vector<glm::mat4>& matrices, InstanceBuffer& instances) {
+        m_visibleMatrices.clear();
+        for (const glm::mat4& matrix : matrices)
+            if (culler->isVisible(model.bounds.transformed(matrix)))
+                m_visibleMatrices.push_back(matrix);
+        uploadInstances(model, m_visibleMatrices, instances);
+    };
+    upload(m_shipModel, m_shipMatrices, m_shipInstances);
+    upload(m_seagullModel, m_seagullMatrices, m_seagullInstances);
+    upload(m_bugModel, m_bugMatrices, m_bugInstances);
+}
+
+void Fleet::render(ShaderVariants& shaders)
+{
+    if (m_gpuCuller) {
+        m_gpuCuller->draw(shaders);
+        return;
+    }
+    m_shipModel.DrawInstanced(shaders, m_shipInstances.getCount());
+    m_seagullModel.DrawInstanced(shaders, m_seagullInstances.getCount());
+    m_bugModel.DrawInstanced(shaders, m_bugInstances.getCount());
+}
+
+void Fleet::addLights(LightClusters& lights) const
+{
+    PointLight lantern = shipLantern(m_shipModel.bounds);
+    for (const glm::mat4& matrix : m_shipMatrices)
+        lights.add(glm::vec3(matrix * glm::vec4(lantern.offset, 1.0f)), lantern.radius, lantern.color);
+}
+
+// every instance goes into every cascade: the depth shader is cheap, and culling per
+// instance would mean one instance buffer per cascade. The bugs are too small to show up
+void Fleet::renderShadow(CascadedShadowMap& shadows, int cascade)
+{
+    (void)cascade;
+    shadows.useInstanced();
+    if (m_gpuCuller) {
+        m_gpuCuller->drawDepth(m_gpuShips);
+        m_gpuCuller->drawDepth(m_gpuSeagulls);
+        return;
+    }
+    m_shipModel.DrawDepthInstanced(m_shipInstances.getCount());
+    m_seagullModel.DrawDepthInstanced(m_seagullInstances.getCount());
+}
@@ -0,0 +1,189 @@
+#include "Flock.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // birds per chunk of the parallel steering
+    const size_t STEER_GRAIN = 256;
+}
+
+FlockSettings FlockSettings::load(const Settings& settings)
+{
+    FlockSettings flock;
+    flock.neighbourRadius = std::max(settings.getFloat("flock.neighbour_radius", flock.neighbourRadius), 0.05f);
+    flock.separationRadius = std::clamp(settings.getFloat("flock.separation_radius", flock.separationRadius), 0.0f, flock.neighbourRadius);
+    flock.maxNeighbours = std::max(settings.getInt("flock.max_neighbours", flock.maxNeighbours), 1);
+    flock.separation = settings.getFloat("flock.separation", flock.separation);
+    flock.alignment = settings.getFloat("flock.alignment", flock.alignment);
+    flock.cohesion = settings.getFloat("flock.cohesion", flock.cohesion);
+    flock.attraction = settings.getFloat("flock.attraction", flock.attraction);
+    flock.orbit = settings.getFloat("flock.orbit", flock.orbit);
+    flock.maxSpeed = std::max(settings.getFloat("flock.max_speed", flock.maxSpeed), 0.1f);
+    flock.maxForce = std::max(settings.getFloat("flock.max_force", flock.maxForce), 0.1f);
+    flock.minHeight = settings.getFloat("flock.min_height", flock.minHeight);
+    return flock;
+}
+
+unsigned int Flock::addBird(const glm::vec3& position, unsigned int target)
+{
+    m_positions.push_back(position);
+    m_velocities.push_back(glm::vec3(0.0f));
+    m_birdTargets.push_back(target);
+    if (target >= m_targets.size())
+        m_targets.resize(target + 1, position);
+    return static_cast<unsigned int>(m_positions.size() - 1);
+}
+
+void Flock::setTarget(unsigned int target, const glm::vec3& position)
+{
+    if (target >= m_targets.size())
+        m_targets.resize(target + 1, position);
+    m_targets[target] = position;
+}
+
+float Flock::getHeading(unsigned int bird) const
+{
+    const glm::vec3& velocity = m_velocities[bird];
+    return glm::degrees(std::atan2(velocity.x, velocity.z));
+}
+
+unsigned int Flock::hashCell(int x, int y, int z) const
+{
+    unsigned int hash = static_cast<unsigned int>(x) * 73856093u ^ static_cast<unsigned int>(y) * 19349663u ^ static_cast<unsigned int>(z) * 83492791u;
+    return hash & m_bucketMask;
+}
+
+unsigned int Flock::cellOf(const glm::vec3& position) const
+{
+    glm::vec3 cell = position / m_settings.neighbourRadius;
+    return hashCell(static_cast<int>(std::floor(cell.x)), static_cast<int>(std::floor(cell.y)), static_cast<int>(std::floor(cell.z)));
+}
+
+// a counting sort of the birds by bucket: count, prefix sum, scatter
+void Flock::buildGrid()
+{
+    size_t count = m_positions.size();
+    // about two buckets per bird keeps the unrelated cells sharing a bucket rare
+    unsigned int buckets = 1;
+    while (buckets < 2 * count)
+        buckets <<= 1;
+    m_bucketMask = buckets - 1;
+
+    m_bucketStart.assign(buckets + 1, 0);
+    m_birdBuckets.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        m_birdBuckets[i] = cellOf(m_positions[i]);
+        m_bucketStart[m_birdBuckets[i] + 1]++;
+    }
+    for (unsigned int b = 0; b < buckets; b++)
+        m_bucketStart[b + 1] += m_bucketStart[b];
+
+    m_sortedBirds.resize(count);
+    m_sortedPositions.resize(count);
+    m_sortedVelocities.resize(count);
+    m_bucketNext.assign(m_bucketStart.begin(), m_bucketStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        unsigned int slot = m_bucketNext[m_birdBuckets[i]]++;
+        m_sortedBirds[slot] = static_cast<unsigned int>(i);
+        m_sortedPositions[slot] = m_positions[i];
+        m_sortedVelocities[slot] = m_velocities[i];
+    }
+}
+
+// steers the sorted birds [begin, end), so a chunk is birds close to each other. It reads the
+// sorted copies only and writes the new velocities of its own birds, so the chunks can run at
+// the same time
+void Flock::steer(size_t begin, size_t end, float deltaTime)
+{
+    const float neighbourRadius2 = m_settings.neighbourRadius * m_settings.neighbourRadius;
+    const float separationRadius2 = m_settings.separationRadius * m_settings.separationRadius;
+
+    for (size_t slot = begin; slot < end; slot++) {
+        unsigned int bird = m_sortedBirds[slot];
+        const glm::vec3& position = m_sortedPositions[slot];
+        const glm::vec3& velocity = m_sortedVelocities[slot];
+        glm::vec3 cell = position / m_settings.neighbourRadius;
+        int cx = static_cast<int>(std::floor(cell.x));
+        int cy = static_cast<int>(std::floor(cell.y));
+        int cz = static_cast<int>(std::floor(cell.z));
+
+        // the buckets of the 27 cells around, each once even if two cells share one
+        unsigned int buckets[27];
+        int bucketCount = 0;
+        for (int dx = -1; dx <= 1; dx++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dz = -1; dz <= 1; dz++) {
+                    unsigned int bucket = hashCell(cx + dx, cy + dy, cz + dz);
+                    if (std::find(buckets, buckets + bucketCount, bucket) == buckets + bucketCount)
+                        buckets[bucketCount++] = bucket;
+                }
+
+        glm::vec3 separation(0.0f), meanVelocity(0.0f), center(0.0f);
+        int neighbours = 0;
+        for (int b = 0; b < bucketCount && neighbours < m_settings.maxNeighbours; b++) {
+            for (unsigned int s = m_bucketStart[buckets[b]]; s < m_bucketStart[buckets[b] + 1]; s++) {
+                glm::vec3 away = position - m_sortedPositions[s];
+                float distance2 = glm::dot(away, away);
+                if (distance2 >= neighbourRadius2 || s == slot)
+                    continue;
+                meanVelocity += m_sortedVelocities[s];
+                center += m_sortedPositions[s];
+                if (distance2 < separationRadius2)
+                    separation += away / std::max(distance2, 1e-4f);
+                if (++neighbours == m_settings.maxNeighbours)
+                    break;
+            }
+        }
+
+        glm::vec3 force = m_settings.separation * separation;
+        if (neighbours > 0) {
+            float inverse = 1.0f / static_cast<float>(neighbours);
+            force += m_settings.alignment * (meanVelocity * inverse - velocity);
+            force += m_settings.cohesion * (center * inverse - position);
+        }
+
+        // towards the target, slowing down near it, and around it
+        glm::vec3 toTarget = m_targets[m_birdTargets[bird]] - position;
+        float distance = glm::length(toTarget);
+        if (distance > 1e-4f) {
+            glm::vec3 direction = toTarget / distance;
+            glm::vec3 desired = direction * m_settings.maxSpeed * std::min(distance / 2.0f, 1.0f);
+            force += m_settings.attraction * (desired - velocity);
+            glm::vec3 around(-toTarget.z, 0.0f, toTarget.x);
+            float aroundLength = glm::length(around);
+            if (aroundLength > 1e-3f)
+                force += m_settings.orbit * m_settings.maxSpeed / aroundLength * around;
+        }
+        if (position.y < m_settings.minHeight)
+            force.y += (m_settings.minHeight - position.y) * m_settings.maxForce;
+
+        float forceLength = glm::length(force);
+        if (forceLength > m_settings.maxForce)
+            force *= m_settings.maxForce / forceLength;
+        glm::vec3 newVelocity = velocity + force * deltaTime;
+        float speed = glm::length(newVelocity);
+        if (speed > m_settings.maxSpeed)
+            newVelocity *= m_settings.maxSpeed / speed;
+        m_newVelocities[bird] = newVelocity;
+    }
+}
+
+void Flock::update(float deltaTime)
+{
+    size_t count = m_positions.size();
+    if (count == 0 || deltaTime <= 0.0f)
+        return;
+
+    buildGrid();
+    m_newVelocities.resize(count);
+    Parallel::forRange(count, STEER_GRAIN, [this, deltaTime](size_t begin, size_t end) {
+        steer(begin, end, deltaTime);
+    });
+
+    m_velocities.swap(m_newVelocities);
+    for (size_t i = 0; i < count; i++)
+        m_positions[i] += m_velocities[i] * deltaTime;
+}
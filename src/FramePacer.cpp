@@ -0,0 +1,180 @@
+#include "FramePacer.h"
+
+#include <glfw3.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+
+PacingSettings PacingSettings::load(const Settings& settings)
+{
+    PacingSettings pacing;
+    std::string mode = settings.getString("pacing.mode", FramePacer::modeName(pacing.mode));
+    if (mode == "vsync")
+        pacing.mode = Mode::VSYNC;
+    else if (mode == "adaptive")
+        pacing.mode = Mode::ADAPTIVE;
+    else if (mode == "capped")
+        pacing.mode = Mode::CAPPED;
+    else if (mode == "uncapped")
+        pacing.mode = Mode::UNCAPPED;
+    else
+        std::cout << "ERROR::PACING:: unknown mode " << mode << ", the frames wait for the vertical blank" << std::endl;
+    pacing.fps = std::clamp(settings.getInt("pacing.fps", pacing.fps), 10, 1000);
+    pacing.spinMs = std::clamp(settings.getFloat("pacing.spin_ms", pacing.spinMs), 0.0f, 10.0f);
+    return pacing;
+}
+
+const char* FramePacer::modeName(PacingSettings::Mode mode)
+{
+    switch (mode) {
+    case PacingSettings::Mode::ADAPTIVE:
+        return "adaptive";
+    case PacingSettings::Mode::CAPPED:
+        return "capped";
+    case PacingSettings::Mode::UNCAPPED:
+        return "uncapped";
+    default:
+        return "vsync";
+    }
+}
+
+FramePacer::FramePacer(const PacingSettings& settings) :
+    m_settings(settings),
+    m_period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / settings.fps)))
+{
+#ifdef _WIN32
+    // the sleeps of Windows last a whole tick of the scheduler, 15.6 ms, unless asked for 1 ms
+    if (m_settings.mode == PacingSettings::Mode::CAPPED)
+        timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+    if (m_settings.mode == PacingSettings::Mode::CAPPED)
+        timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::apply()
+{
+    if (m_settings.mode == PacingSettings::Mode::ADAPTIVE
+        && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        std::cout << "ERROR::PACING:: adaptive vsync is not supported, the frames wait for the vertical blank" << std::endl;
+        m_settings.mode = PacingSettings::Mode::VSYNC;
+    }
+
+    switch (m_settings.mode) {
+    case PacingSettings::Mode::VSYNC:
+        glfwSwapInterval(1);
+        break;
+    case PacingSettings::Mode::ADAPTIVE:
+        glfwSwapInterval(-1);
+        break;
+    default:
+        glfwSwapInterval(0);
+        break;
+    }
+}
+
+void FramePacer::endFrame()
+{
+    if (m_settings.mode == PacingSettings::Mode::CAPPED)
+        wait();
+    measure(Clock::now());
+}
+
+// every frame is due one period after the one before was due, not after the end of its wait,
+// so the few microseconds the spin overshoots by are not added to every frame
+void FramePacer::wait()
+{
+    Clock::time_point now = Clock::now();
+    Clock::time_point deadline = m_deadline + m_period;
+    // a late frame starts the schedule again from now, rather than rushing the next one
+    // to catch up: a short frame after a long one is a second stutter
+    if (!m_started || now >= deadline) {
+        m_deadline = now;
+        return;
+    }
+
+    Clock::time_point wake = deadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(m_settings.spinMs));
+    if (now < wake) {
+        std::this_thread::sleep_until(wake);
+        Clock::time_point woken = Clock::now();
+        m_slept += std::chrono::duration<double, std::milli>(woken - now).count();
+        now = woken;
+        // the sleep overslept the spin: the frame is late all the same
+        if (now >= deadline) {
+            m_deadline = now;
+            return;
+        }
+    }
+    Clock::time_point spinStart = now;
+    while (now < deadline) {
+        std::this_thread::yield();
+        now = Clock::now();
+    }
+    m_spun += std::chrono::duration<double, std::milli>(now - spinStart).count();
+    m_deadline = deadline;
+}
+
+void FramePacer::measure(Clock::time_point now)
+{
+    if (!m_started) {
+        m_started = true;
+        m_lastFrame = now;
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(now - m_lastFrame).count();
+    m_lastFrame = now;
+
+    // a frame much longer than the ones before is a hitch, whatever the mode
+    if (m_frames > 0 && ms > 1.5 * m_mean)
+        m_hitches++;
+    m_frames++;
+    double delta = ms - m_mean;
+    m_mean += delta / static_cast<double>(m_frames);
+    m_squares += delta * (ms - m_mean);
+    m_min = m_frames == 1 ? ms : std::min(m_min, ms);
+    m_max = m_frames == 1 ? ms : std::max(m_max, ms);
+}
+
+FrameStats FramePacer::getStats() const
+{
+    FrameStats stats;
+    stats.frames = m_frames;
+    if (m_frames == 0)
+        return stats;
+    stats.meanMs = m_mean;
+    stats.deviationMs = m_frames > 1 ? std::sqrt(m_squares / static_cast<double>(m_frames - 1)) : 0.0;
+    stats.minMs = m_min;
+    stats.maxMs = m_max;
+    stats.hitches = m_hitches;
+    stats.sleptMs = m_slept / static_cast<double>(m_frames);
+    stats.spunMs = m_spun / static_cast<double>(m_frames);
+    return stats;
+}
+
+void FramePacer::resetStats()
+{
+    m_frames = 0;
+    m_mean = 0.0;
+    m_squares = 0.0;
+    m_min = 0.0;
+    m_max = 0.0;
+    m_hitches = 0;
+    m_slept = 0.0;
+    m_spun = 0.0;
+}
@@ -13,16 +13,42 @@
 #include <string_cast.hpp>
 
 #include <Shader.h>
+#include <ShaderVariants.h>
+#include <FrameUniforms.h>
+#include <CascadedShadowMap.h>
+#include <LightClusters.h>
+#include <OcclusionCuller.h>
+#include <Ocean.h>
+#include <Fleet.h>
+#include <GpuCuller.h>
+#include <StreamBuffer.h>
+#include <FramePacer.h>
+#include <DynamicResolution.h>
+#include <Collision.h>
+#include <Waves.h>
+#include <Settings.h>
 #include <Model.h>
+#include <Ecs.h>
+#include <Systems.h>
 #include <GameObject.h>
+#include <WorldStreamer.h>
+#include <MaterialTable.h>
+#include <Memory.h>
+#include <FileSystem.h>
+#include <AssetPack.h>
 #include <C:\Users\billaros\source\repos\SailingShip\header\header\Camera.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 
-void processInput(GLFWwindow* window, GameObject::Ship& ship);
+void processInput(GLFWwindow* window, GameObject::Ship& ship, ShaderVariants& shaders);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -33,9 +59,10 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 const unsigned int windowWidth = 1024;
 const unsigned int windowHeight = 768;
 
-// paths to the shaders
-std::string vShader{ "shaders\\vShader.txt" };
-std::string fShader{ "shaders\\fshader.txt" };
+// paths to the shaders. They sample the texture arrays of the MaterialTable and are
+// compiled into one variant per combination of features (see ShaderVariants.h)
+std::string vShader{ "shaders\\vShaderLit.txt" };
+std::string fShader{ "shaders\\fShaderLit.txt" };
 
 // paths to the 3D models
 std::string shipModel{ "textures\\galleon-16th-century-ship\\GALEON.obj" };
@@ -43,6 +70,13 @@ std::string islandModel{ "textures\\TropicalIsland_extras\\TropicalIsland.obj" }
 std::string seagullModel{ "textures\\3DLowPoly-Seagull\\Seagull.obj" };
 std::string bugModel{ "textures\\Dragonfly\\Dragonfly.obj" };
 
+// the asset pack built by tools/AssetPacker. When present, the assets are read from it
+// and the loose files are only the fallback for whatever the pack does not contain
+std::string assetPack{ "assets.pack" };
+
+// the settings that tune the cost of the rendering to the machine
+std::string settingsFile{ "settings.txt" };
+
 Camera::Camera camera{ glm::vec3(0.0f, 1.0f, 3.0f) };
 
 float lastX = windowWidth / 2.0f;
@@ -52,7 +86,7 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-// the positions of the islands in the world
+// the positions of the islands in the world, when the settings name no world file
 std::vector<glm::vec3> islandPositions{
         glm::vec3(2.0f, 0.0f, 0.0f),
         glm::vec3(-2.0f, 0.0f, 0.0f),
@@ -63,17 +97,47 @@ std::vector<glm::vec3> islandPositions{
         glm::vec3(-5.0f, 0.0f, -6.0f)
 };
 
-int main() {
+/// <summary>
+/// Starts the game. With "--stress N" the fleet has N ships, whatever the settings say,
+/// and the time the fleet takes is printed every few seconds.
+/// </summary>
+int main(int argc, char** argv) {
+    int stressShips = -1;
+    for (int i = 1; i + 1 < argc; i++)
+        if (std::strcmp(argv[i], "--stress") == 0)
+            stressShips = std::max(std::atoi(argv[i + 1]), 0);
+
+    // Mount the loose files first and the pack on top of them, so the pack wins
+    FileSystem::vfs().mount(std::make_shared<FileSystem::DirectoryMount>());
+    auto pack = std::make_shared<FileSystem::AssetPack>(assetPack);
+    if (pack->isValid())
+        FileSystem::vfs().mount(pack);
+
+    // The settings come before the window, as they choose the version of OpenGL
+    Settings settings;
+    settings.load(settingsFile);
+    GpuCullingSettings gpuCullingSettings = GpuCullingSettings::load(settings);
+
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "Let's sail!", NULL, NULL);
+    // The culling on the GPU needs OpenGL 4.3. Everything else runs on 3.3, which the
+    // game falls back to when the driver has nothing newer
+    GLFWwindow* window = NULL;
+    if (gpuCullingSettings.enabled) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(windowWidth, windowHeight, "Let's sail!", NULL, NULL);
+    }
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(windowWidth, windowHeight, "Let's sail!", NULL, NULL);
+    }
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -81,81 +145,335 @@ int main() {
     }
 
     glfwMakeContextCurrent(window);
+
+    // The frames wait for the vertical blank, or for a capped rate, as the pacing.* settings say,
+    // so the loop does not render frames the screen never shows
+    FramePacer pacer{ PacingSettings::load(settings) };
+    pacer.apply();
+
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     //glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
         return -1;
     }
 
     glEnable(GL_DEPTH_TEST);
 
-    Shader shader(vShader, fShader);
+    if (gpuCullingSettings.enabled && !GpuCuller::isSupported()) {
+        std::cout << "ERROR::GPU_CULLING:: OpenGL 4.3 is not supported, the fleet is culled on the CPU" << std::endl;
+        gpuCullingSettings.enabled = false;
+    }
 
-    // Create the islands
-    std::vector<GameObject::Island> islands;
-    for(auto& position : islandPositions)
-         islands.emplace_back(islandModel, position);
+    // Everything that owns OpenGL objects lives in this scope, so it is destroyed while the
+    // context still exists, before glfwTerminate()
+    {
+        // The data that changes every frame (the uniforms of the frame, the model matrix of every
+        // object, the instances of the fleet) is written into one ring of three partitions,
+        // mapped persistently when the driver can, and fenced so no frame waits on the GPU
+        StreamBuffer stream{ StreamSettings::load(settings) };
+
+        ShaderVariants shaders(vShader, fShader);
+        shaders.setStream(stream);
+
+        // The shadows of the sun. Their cost is set by the shadow.* settings
+        std::unique_ptr<CascadedShadowMap> shadows;
+        ShadowSettings shadowSettings = ShadowSettings::load(settings);
+        if (shadowSettings.enabled) {
+            shadows = std::make_unique<CascadedShadowMap>(shadowSettings, stream);
+            shaders.setGlobalFeatures(SHADER_SHADOWS);
+        }
 
-    // Create the ship and generate the seagulls
-    GameObject::Ship ship{ shipModel, seagullModel };
-    ship.populate(seagullModel);
-    std::vector<GameObject::Seagull>& seagulls = ship.getSeagulls();
-    
-    // For each seagull, generate its bugs
-    for (auto& seagull : seagulls)
-        seagull.populate(bugModel);
-
-    // Set the projection matrix once outside the main loop, as it will remain the
-    // same throughout the execution of the program
-    shader.use();
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
-    shader.setMat4("projection", projection);
-    
-    // Light properties
-    shader.setVec3("light.direction", -0.2f, -1.0f, -0.3f);
-    shader.setVec3("light.ambient", 1.0f, 1.0f, 1.0f);
-    shader.setVec3("light.diffuse", 1.0f, 1.0f, 1.0f);
-    shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
+        // The lanterns of the ships and the harbour lights, binned into the clusters of the
+        // view on the CPU every frame. Their cost is set by the lights.* settings
+        std::unique_ptr<LightClusters> lights;
+        LightSettings lightSettings = LightSettings::load(settings);
+        if (lightSettings.enabled) {
+            lights = std::make_unique<LightClusters>(lightSettings);
+            shaders.setGlobalFeatures(shaders.getGlobalFeatures() | SHADER_POINT_LIGHTS);
+        }
 
-    // Material properties
-    shader.setFloat("material.shininess", 32.0f);
+        // The islands near the camera hide what is behind them: they are rasterized on the CPU
+        // into a small depth buffer, which the objects are tested against before they are drawn
+        std::unique_ptr<OcclusionCuller> occlusion;
+        OcclusionSettings occlusionSettings = OcclusionSettings::load(settings);
+        if (occlusionSettings.enabled)
+            occlusion = std::make_unique<OcclusionCuller>(occlusionSettings);
+
+        // The frame is rendered offscreen, at the resolution that keeps the GPU within the budget
+        // of the resolution.* settings, and blitted up to the window
+        std::unique_ptr<DynamicResolution> resolution;
+        ResolutionSettings resolutionSettings = ResolutionSettings::load(settings);
+        if (resolutionSettings.enabled)
+            resolution = std::make_unique<DynamicResolution>(resolutionSettings);
+
+        // The sea, animated by the waves on the GPU. Its size is set by the ocean.* settings
+        Waves waves;
+        std::unique_ptr<Ocean> ocean;
+        OceanSettings oceanSettings = OceanSettings::load(settings);
+        if (oceanSettings.enabled) {
+            ocean = std::make_unique<Ocean>(oceanSettings, glm::vec3(0.0f, 0.1f, 0.858824f));
+            if (!pack->isValid())
+                ocean->getShaders().enableHotReload();
+        }
 
-    // View matrix. It is initialized with the camera position
-    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+        // All the textures of all the models are packed into the texture arrays of one
+        // material table, so most draws do not need to bind anything
+        MaterialTable materials;
+
+        // The islands are streamed in tiles around the ship (see WorldStreamer.h), from a
+        // world file or from the positions above, with more scattered over the open sea
+        // when the world.* settings ask for it
+        WorldSettings worldSettings = WorldSettings::load(settings);
+        WorldMap worldMap{ worldSettings };
+        if (worldSettings.file.empty() || !worldMap.load(worldSettings.file)) {
+            for (auto& position : islandPositions)
+                worldMap.addIsland({ islandModel, position });
+        }
+        worldMap.setScatterModel(islandModel);
+
+        // The ships cannot sail through the islands. Every island model is turned into a
+        // heightfield as it loads, and the resident islands are hashed into a grid
+        CollisionSettings collisionSettings = CollisionSettings::load(settings);
+        // The objects of the game are entities made of components (see Ecs.h), moved and drawn
+        // by the systems. Every model is loaded once, however many entities use it
+        Ecs::Registry registry;
+        RenderSystem renderer;
+        TransformHierarchy hierarchy;
+
+        WorldStreamer world{ worldMap, collisionSettings, &materials, registry };
+        world.registerMaterials();
+
+        // Create the ship, the seagulls following it and the bugs circling them
+        GameObject::Ship ship{ registry, renderer, renderer.load(shipModel, &materials), glm::vec3(0.0f, 0.0f, 0.0f) };
+        ship.setCollision(&world.getCollision());
+        ship.populate(renderer.load(seagullModel, &materials));
+        ship.populateBugs(renderer.load(bugModel, &materials));
+
+        // The other ships, drawn with instancing. Their number is set by the fleet.* settings
+        FleetSettings fleetSettings = FleetSettings::load(settings);
+        if (stressShips >= 0)
+            fleetSettings.ships = stressShips;
+        Fleet fleet{ shipModel, seagullModel, bugModel, stream, &materials };
+        fleet.setCollision(&world.getCollision());
+        fleet.spawn(fleetSettings);
+        if (gpuCullingSettings.enabled)
+            fleet.useGpuCulling(gpuCullingSettings);
+
+        // The seagulls of all the ships fly as flocks, tuned by the flock.* settings
+        FlockSettings flockSettings = FlockSettings::load(settings);
+        ship.getFlock().setSettings(flockSettings);
+        fleet.getFlock().setSettings(flockSettings);
+
+        // The course of the player's ship can be recorded, to be replayed by the fleet later
+        std::string recordFile = settings.getString("fleet.record", "");
+        ReplayTrack recording;
+
+        // Every model is loaded, so the texture arrays can be filled
+        materials.build();
+
+        // Every variant gets the material table and the constant uniforms when it is compiled.
+        // The variants the materials need, with and without fog, are compiled now rather than
+        // in the middle of a frame
+        shaders.setOnCreate([&materials](Shader& shader) {
+            materials.apply(shader);
+            shader.setFloat("material.shininess", 32.0f);
+            shader.setInt("shadowMap", 2);
+            shader.setInt("lightClusters", 3);
+            shader.setInt("lightIndices", 4);
+            shader.setInt("lightData", 5);
+        });
+        for (unsigned int group = 0; group < materials.getGroupCount(); group++) {
+            shaders.get(materials.getFeatures(group));
+            shaders.get(materials.getFeatures(group) | SHADER_FOG);
+            if (fleet.getShipCount() > 0) {
+                shaders.get(materials.getFeatures(group) | SHADER_INSTANCED);
+                shaders.get(materials.getFeatures(group) | SHADER_INSTANCED | SHADER_FOG);
+            }
+        }
 
-    while (!glfwWindowShouldClose(window)) {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // Edits to the shader sources are picked up while the game runs. The sources in the
+        // asset pack never change, so there is nothing to watch when it is used
+        if (!pack->isValid())
+            shaders.enableHotReload();
 
-        shader.use();
-        processInput(window, ship);
+        // The tiles around the ship are loaded before the first frame
+        world.update(ship.getPosition(), ship.getFront());
+        world.finishLoading();
 
-        glClearColor(0.0f, 0.1f, 0.858824f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        view = camera.GetViewMatrix(ship);
+        // The uniforms shared by all the variants, uploaded once per frame
+        FrameUniformBuffer frameBuffer{ stream };
+        FrameUniforms frame;
+
+        // Set the projection matrix once outside the main loop, as it will remain the
+        // same throughout the execution of the program
+        frame.projection = glm::perspective(glm::radians(camera.Zoom), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
+    
+        // Light properties
+        frame.lightDirection = glm::vec4(-0.2f, -1.0f, -0.3f, 0.0f);
+        // a full ambient term would wash the shadows out
+        float ambient = shadows ? 0.4f : 1.0f;
+        frame.lightAmbient = glm::vec4(ambient, ambient, ambient, 0.0f);
+        frame.lightDiffuse = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+        frame.lightSpecular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+
+        // Fog in the color of the sky, toggled with F
+        frame.fog = glm::vec4(0.0f, 0.1f, 0.858824f, 0.08f);
+
+        // View matrix. It is initialized with the camera position
+        glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+
+        // The time the fleet takes on the CPU, printed in stress mode
+        using Clock = std::chrono::steady_clock;
+        double fleetUpdateTime = 0.0;
+        double fleetRenderTime = 0.0;
+        double statsFrameTime = 0.0;
+        int statsFrames = 0;
+        size_t statsAllocations = Memory::counters().allocations;
+
+        while (!glfwWindowShouldClose(window)) {
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            // the temporaries of the last frame are taken back all at once
+            Memory::beginFrame();
+            stream.beginFrame();
+
+            processInput(window, ship, shaders);
+            world.update(ship.getPosition(), ship.getFront());
+            waves.update(currentFrame, glm::vec2(camera.Position.x, camera.Position.z));
+            ship.updateBuoyancy(waves, deltaTime);
+            ship.updateSeagulls(deltaTime);
+            Systems::follow(registry);
+            Systems::orbit(registry, deltaTime);
+            hierarchy.update(registry);
+            if (!recordFile.empty())
+                recording.record(currentFrame, glm::vec2(ship.getPosition().x, ship.getPosition().z), ship.getAngle());
+
+            Clock::time_point fleetStart = Clock::now();
+            fleet.update(waves, currentFrame, deltaTime);
+            fleetUpdateTime += std::chrono::duration<double, std::milli>(Clock::now() - fleetStart).count();
+            if (lights) {
+                lights->clear();
+                Systems::collectLights(registry, *lights);
+                fleet.addLights(*lights);
+            }
+            shaders.update();
+            if (ocean) {
+                ocean->getShaders().setGlobalFeatures(shaders.getGlobalFeatures() & SHADER_FOG);
+                ocean->getShaders().update();
+            }
+
+            // the size of the window in pixels, and the part of it the frame is rendered at
+            int renderWidth = 0;
+            int renderHeight = 0;
+            glfwGetFramebufferSize(window, &renderWidth, &renderHeight);
+            if (resolution) {
+                resolution->resize(renderWidth, renderHeight);
+                resolution->begin();
+                renderWidth = resolution->getRenderWidth();
+                renderHeight = resolution->getRenderHeight();
+            }
+
+            glClearColor(0.0f, 0.1f, 0.858824f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
-        shader.use();
-        shader.setVec3("viewPos", camera.Position);
-        shader.setMat4("view", view);
+            view = camera.GetViewMatrix(ship);
         
-        // Render the ship, the islands, the seagulls and the bugs
-        ship.render(shader);
-        for (auto& island : islands)
-            island.render(shader);
+            // Render the shadow cascades. The bugs are too small to show up in them
+            if (shadows) {
+                shadows->update(view, glm::radians(camera.Zoom), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, glm::vec3(frame.lightDirection));
+                shadows->render([&](int cascade) {
+                    world.DrawDepth(*shadows, cascade);
+                    renderer.renderShadow(registry, *shadows, cascade);
+                    fleet.renderShadow(*shadows, cascade);
+                });
+                shadows->setUniforms(frame);
+                shadows->bindTexture(2);
+            }
+
+            frame.viewPos = glm::vec4(camera.Position, 1.0f);
+            frame.view = view;
+            if (lights) {
+                lights->update(view, frame.projection, 0.1f, renderWidth, renderHeight);
+                lights->setUniforms(frame);
+                lights->bindTextures(3);
+            }
+            waves.setUniforms(frame);
+            frameBuffer.update(frame);
         
-        for (auto& seagull : seagulls) {
-            seagull.render(ship.getPosition(), shader);
-            for (auto& bug : seagull.getBugs())
-                bug.render(seagull.getPosition(), shader);
+            // The islands are the occluders. The fleet only keeps the instances left visible,
+            // on the CPU or with the GPU culling
+            if (occlusion) {
+                occlusion->begin(view, frame.projection);
+                world.DrawOccluders(*occlusion);
+                occlusion->finish();
+            }
+            fleet.cull(view, frame.projection, occlusion.get());
+
+            // Render the ship, the seagulls and the bugs, then the islands
+            renderer.render(registry, shaders, occlusion.get());
+            world.Draw(shaders, occlusion.get());
+
+            Clock::time_point renderStart = Clock::now();
+            fleet.render(shaders);
+            fleetRenderTime += std::chrono::duration<double, std::milli>(Clock::now() - renderStart).count();
+
+            // The sea goes last, so the depth test skips the water behind the ship and the islands
+            if (ocean)
+                ocean->Draw();
+            if (resolution)
+                resolution->end();
+
+            // the partition of the frame is free again once the GPU is past this point
+            stream.endFrame();
+            pacer.endFrame();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            statsFrameTime += deltaTime * 1000.0;
+            statsFrames++;
+            if (stressShips >= 0 && statsFrameTime >= 5000.0) {
+                std::cout << "Fleet: " << fleet.getShipCount() << " ships, " << fleet.getFollowerCount() << " seagulls, " << fleet.getBugCount() << " bugs. "
+                          << "Frame " << statsFrameTime / statsFrames << " ms, update " << fleetUpdateTime / statsFrames
+                          << " ms, render " << fleetRenderTime / statsFrames << " ms" << std::endl;
+                std::cout << "World: " << world.getResidentTileCount() << " tiles, " << world.getPendingTileCount() << " loading, "
+                          << world.getCpuBytes() / (1024 * 1024) << " MB on the CPU, " << world.getGpuBytes() / (1024 * 1024) << " MB on the GPU" << std::endl;
+                size_t allocations = Memory::counters().allocations;
+                std::cout << "Memory: " << (allocations - statsAllocations) / statsFrames << " heap allocations per frame, "
+                          << Memory::frameArena().getPeakBytes() / 1024 << " KB of frame arena at most" << std::endl;
+                if (lights)
+                    std::cout << "Lights: " << lights->getLightCount() << " lights, " << lights->getReferenceCount() << " in the clusters, "
+                              << lights->getBusiestCluster() << " in the busiest cluster" << std::endl;
+                if (occlusion)
+                    std::cout << "Occlusion: " << occlusion->getOccluderCount() << " occluders, " << occlusion->getTriangleCount() << " triangles, "
+                              << occlusion->getCulledCount() << " of " << occlusion->getTestedCount() << " objects culled in the last frame" << std::endl;
+                if (const GpuCuller* gpuCuller = fleet.getGpuCuller())
+                    std::cout << "GPU culling: " << gpuCuller->getInstanceCount() << " instances, " << gpuCuller->getDrawCount() << " indirect draws per frame" << std::endl;
+                std::cout << "Stream: " << stream.getLastFrameBytes() / 1024 << " KB in the last frame, " << stream.getPeakBytes() / 1024 << " KB at most, "
+                          << stream.getPartitionSize() / 1024 << " KB per partition, " << (stream.isPersistent() ? "mapped" : "glBufferSubData")
+                          << ", " << stream.getWaitCount() << " waits for the GPU" << std::endl;
+                FrameStats pacing = pacer.getStats();
+                std::cout << "Pacing: " << FramePacer::modeName(pacer.getMode()) << ", " << pacing.meanMs << " ms per frame, deviation " << pacing.deviationMs
+                          << " ms, " << pacing.minMs << " to " << pacing.maxMs << " ms, " << pacing.hitches << " hitches, "
+                          << pacing.sleptMs << " ms slept and " << pacing.spunMs << " ms spun per frame" << std::endl;
+                pacer.resetStats();
+                if (resolution)
+                    std::cout << "Resolution: " << resolution->getRenderWidth() << "x" << resolution->getRenderHeight() << ", scale " << resolution->getScale()
+                              << ", " << resolution->getGpuMs() << " ms on the GPU for a budget of " << resolutionSettings.targetMs << " ms" << std::endl;
+                std::cout << "Transforms: " << hierarchy.getUpdatedCount() << " of " << hierarchy.getNodeCount() << " updated in the last frame" << std::endl;
+                fleetUpdateTime = fleetRenderTime = statsFrameTime = 0.0;
+                statsFrames = 0;
+                statsAllocations = allocations;
+            }
         }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!recordFile.empty())
+            recording.save(recordFile);
     }
 
     glfwTerminate();
@@ -166,12 +484,19 @@ int main() {
 /// Process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 /// </summary>
 /// <param name="window">Pointer to the OpenGL active window.</param>
-/// <param name="shader">Reference to the active shader program.</param>
 /// <param name="ship">Reference to the ship.</param>
-void processInput(GLFWwindow* window, GameObject::Ship& ship) {
+/// <param name="shaders">The variants of the main shader program, to toggle the fog.</param>
+void processInput(GLFWwindow* window, GameObject::Ship& ship, ShaderVariants& shaders) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    // F toggles the fog once per press
+    static bool fogKeyDown = false;
+    bool fogKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (fogKey && !fogKeyDown)
+        shaders.setGlobalFeatures(shaders.getGlobalFeatures() ^ SHADER_FOG);
+    fogKeyDown = fogKey;
+
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
         ship.move(GameObject::Ship_Movement::SPEED_UP, deltaTime);
         camera.ProcessKeyboard(Camera::Camera_Movement::SPEED_UP, deltaTime, ship);
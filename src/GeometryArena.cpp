@@ -0,0 +1,231 @@
+#include "GeometryArena.h"
+
+#include <Memory.h>
+
+#include <cstddef>
+
+unsigned int GeometryArena::s_boundVAO = 0;
+
+GeometryArena::~GeometryArena()
+{
+    if (m_VAO != 0) {
+        if (s_boundVAO == m_VAO || s_boundVAO == m_depthVAO)
+            s_boundVAO = 0;
+        glDeleteVertexArrays(1, &m_VAO);
+        glDeleteVertexArrays(1, &m_depthVAO);
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteBuffers(1, &m_MBO);
+        glDeleteBuffers(1, &m_EBO);
+        glDeleteBuffers(1, &m_PBO);
+    }
+}
+
+ArenaRange GeometryArena::append(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int material)
+{
+    m_stagedMaterials.insert(m_stagedMaterials.end(), vertices.size(), material);
+    return appendGeometry(vertices, indices);
+}
+
+ArenaRange GeometryArena::append(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<unsigned int>& materials)
+{
+    m_stagedMaterials.insert(m_stagedMaterials.end(), materials.begin(), materials.end());
+    // the staged materials run parallel to the staged vertices
+    m_stagedMaterials.resize(m_stagedVertices.size() + vertices.size(), 0);
+    return appendGeometry(vertices, indices);
+}
+
+ArenaRange GeometryArena::appendGeometry(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    ArenaRange range;
+    range.firstIndex = m_indexCount;
+    range.indexCount = static_cast<unsigned int>(indices.size());
+    range.baseVertex = static_cast<int>(m_vertexCount);
+    range.vertexCount = static_cast<unsigned int>(vertices.size());
+
+    m_stagedVertices.insert(m_stagedVertices.end(), vertices.begin(), vertices.end());
+    m_stagedIndices.insert(m_stagedIndices.end(), indices.begin(), indices.end());
+    m_vertexCount += range.vertexCount;
+    m_indexCount += range.indexCount;
+
+    return range;
+}
+
+void GeometryArena::upload()
+{
+    if (m_stagedVertices.empty() && m_stagedIndices.empty())
+        return;
+
+    if (m_VAO == 0)
+        createVertexArray();
+
+    size_t vertexBytes = m_stagedVertices.size() * sizeof(Vertex);
+    size_t materialBytes = m_stagedMaterials.size() * sizeof(unsigned int);
+    size_t indexBytes = m_stagedIndices.size() * sizeof(unsigned int);
+    size_t vertexOffset = m_uploadedVertices * sizeof(Vertex);
+    size_t materialOffset = m_uploadedVertices * sizeof(unsigned int);
+    size_t indexOffset = m_uploadedIndices * sizeof(unsigned int);
+    size_t positionBytes = m_stagedVertices.size() * sizeof(glm::vec3);
+    size_t positionOffset = m_uploadedVertices * sizeof(glm::vec3);
+
+    grow(m_VBO, m_vertexCapacity, vertexOffset, vertexOffset + vertexBytes);
+    grow(m_MBO, m_materialCapacity, materialOffset, materialOffset + materialBytes);
+    grow(m_EBO, m_indexCapacity, indexOffset, indexOffset + indexBytes);
+    grow(m_PBO, m_positionCapacity, positionOffset, positionOffset + positionBytes);
+
+    // the buffers may have been replaced, so point the VAO at the current ones.
+    // The element buffer binding is VAO state, so the VAO has to be bound while touching it
+    glBindVertexArray(m_depthVAO);
+    setDepthAttributes();
+    glBindVertexArray(m_VAO);
+    s_boundVAO = m_VAO;
+    setVertexAttributes();
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    if (vertexBytes > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, vertexOffset, vertexBytes, m_stagedVertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, m_MBO);
+    if (materialBytes > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, materialOffset, materialBytes, m_stagedMaterials.data());
+    if (indexBytes > 0)
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexBytes, m_stagedIndices.data());
+    if (positionBytes > 0) {
+        // staged in the load arena, which takes the memory back at the end of the scope
+        Memory::ScopedArena scope(Memory::loadArena());
+        Memory::ArenaVector<glm::vec3> positions{ Memory::ArenaAllocator<glm::vec3>(scope.arena()) };
+        positions.reserve(m_stagedVertices.size());
+        for (const Vertex& vertex : m_stagedVertices)
+            positions.push_back(vertex.Position);
+        glBindBuffer(GL_ARRAY_BUFFER, m_PBO);
+        glBufferSubData(GL_ARRAY_BUFFER, positionOffset, positionBytes, positions.data());
+    }
+
+    m_uploadedVertices = m_vertexCount;
+    m_uploadedIndices = m_indexCount;
+
+    // the staging copies are not needed anymore, the meshes keep their own data
+    std::vector<Vertex>().swap(m_stagedVertices);
+    std::vector<unsigned int>().swap(m_stagedMaterials);
+    std::vector<unsigned int>().swap(m_stagedIndices);
+}
+
+void GeometryArena::bind() const
+{
+    if (s_boundVAO != m_VAO) {
+        glBindVertexArray(m_VAO);
+        s_boundVAO = m_VAO;
+    }
+}
+
+void GeometryArena::bindDepth() const
+{
+    if (s_boundVAO != m_depthVAO) {
+        glBindVertexArray(m_depthVAO);
+        s_boundVAO = m_depthVAO;
+    }
+}
+
+void GeometryArena::invalidateBinding()
+{
+    s_boundVAO = 0;
+}
+
+void GeometryArena::createVertexArray()
+{
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glGenBuffers(1, &m_MBO);
+    glGenBuffers(1, &m_EBO);
+    glGenVertexArrays(1, &m_depthVAO);
+    glGenBuffers(1, &m_PBO);
+}
+
+void GeometryArena::setVertexAttributes()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    // same layout as Mesh::setupMesh()
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+
+    // material index, one per vertex, from its own buffer so that Vertex stays the same
+    glBindBuffer(GL_ARRAY_BUFFER, m_MBO);
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+}
+
+void GeometryArena::setDepthAttributes()
+{
+    // only the positions, tightly packed, sharing the index buffer of the full VAO
+    glBindBuffer(GL_ARRAY_BUFFER, m_PBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+}
+
+void GeometryArena::setInstanceBuffer(unsigned int buffer, size_t offset)
+{
+    if (buffer == m_instanceBuffer && offset == m_instanceOffset)
+        return;
+    m_instanceBuffer = buffer;
+    m_instanceOffset = offset;
+
+    glBindVertexArray(m_VAO);
+    setInstanceAttributes(buffer, offset);
+    glBindVertexArray(m_depthVAO);
+    setInstanceAttributes(buffer, offset);
+    glBindVertexArray(0);
+    s_boundVAO = 0;
+}
+
+void GeometryArena::setInstanceAttributes(unsigned int buffer, size_t offset)
+{
+    // a mat4 takes four attribute locations, one column each, advanced once per instance
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(6 + column);
+        glVertexAttribPointer(6 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(6 + column, 1);
+    }
+}
+
+/// <summary>
+/// Makes sure that the buffer can hold at least the needed bytes. When it has to grow,
+/// a new buffer of twice the size is created and the used part of the old one is copied
+/// over on the GPU, so the geometry already uploaded never travels through the CPU again.
+/// </summary>
+void GeometryArena::grow(unsigned int& buffer, size_t& capacity, size_t used, size_t needed)
+{
+    if (needed <= capacity)
+        return;
+
+    size_t newCapacity = capacity * 2;
+    if (newCapacity < needed)
+        newCapacity = needed;
+
+    unsigned int newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+    if (used > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = newBuffer;
+    capacity = newCapacity;
+}
@@ -0,0 +1,268 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    const std::string cullComputeShader{ "shaders\\cShaderCull.txt" };
+
+    // the size of a work group of the compute shader
+    const GLuint GROUP_SIZE = 64;
+
+    // the texture unit of the occlusion pyramid, after those of the lit shaders
+    const int PYRAMID_UNIT = 6;
+}
+
+GpuCullingSettings GpuCullingSettings::load(const Settings& settings)
+{
+    GpuCullingSettings culling;
+    culling.enabled = settings.getBool("gpu_culling.enabled", culling.enabled);
+    culling.seagullDistance = std::max(settings.getFloat("gpu_culling.seagull_distance", culling.seagullDistance), 0.0f);
+    culling.bugDistance = std::max(settings.getFloat("gpu_culling.bug_distance", culling.bugDistance), 0.0f);
+    return culling;
+}
+
+// the compute shaders, the storage buffers and the indirect draws are only in a glad loader
+// generated for OpenGL 4.3. A 3.3 loader builds the culler without them, and the fleet is
+// culled on the CPU
+bool GpuCuller::isSupported()
+{
+#ifdef GL_VERSION_4_3
+    return GLAD_GL_VERSION_4_3 != 0;
+#else
+    return false;
+#endif
+}
+
+GpuCuller::GpuCuller(StreamBuffer& stream) :
+    m_stream(stream),
+    m_shader(std::make_unique<Shader>(cullComputeShader))
+{
+    glGenBuffers(1, &m_matrixBuffer);
+    glGenBuffers(1, &m_modelBuffer);
+    glGenBuffers(1, &m_commandBuffer);
+    m_shader->use();
+    m_shader->setInt("pyramid", PYRAMID_UNIT);
+}
+
+GpuCuller::~GpuCuller()
+{
+    glDeleteBuffers(1, &m_matrixBuffer);
+    glDeleteBuffers(1, &m_modelBuffer);
+    glDeleteBuffers(1, &m_commandBuffer);
+    if (m_pyramid != 0)
+        glDeleteTextures(1, &m_pyramid);
+}
+
+unsigned int GpuCuller::addModel(Model& model, float maxDistance)
+{
+    Entry entry;
+    entry.model = &model;
+    entry.maxDistance = maxDistance;
+    m_entries.push_back(std::move(entry));
+    m_commandsBuilt = false;
+    return static_cast<unsigned int>(m_entries.size() - 1);
+}
+
+void GpuCuller::setInstances(unsigned int model, const std::vector<glm::mat4>& matrices)
+{
+    m_entries[model].matrices.assign(matrices.begin(), matrices.end());
+}
+
+// one command per mesh range of every batch of every model, then the depth ranges. The
+// batches need the groups of the material table, so this waits for the first upload()
+void GpuCuller::buildCommands()
+{
+    m_commands.clear();
+    m_models.clear();
+    for (Entry& entry : m_entries) {
+        const Model& model = *entry.model;
+        CullModel data = {};
+        data.sphere = glm::vec4(model.bounds.center, model.bounds.radius);
+        data.firstCommand = static_cast<GLuint>(m_commands.size());
+        data.maxDistance = entry.maxDistance;
+
+        entry.groups.clear();
+        const std::vector<Model::DrawBatch>& batches = entry.model->getBatches();
+        for (unsigned int b = 0; b < batches.size(); b++) {
+            const Model::DrawBatch& batch = batches[b];
+            entry.groups.push_back({ b, static_cast<GLuint>(m_commands.size()), static_cast<GLsizei>(batch.counts.size()) });
+            for (size_t i = 0; i < batch.counts.size(); i++) {
+                GLuint firstIndex = static_cast<GLuint>(reinterpret_cast<size_t>(batch.offsets[i]) / sizeof(unsigned int));
+                m_commands.push_back({ static_cast<GLuint>(batch.counts[i]), 0, firstIndex, batch.baseVertices[i], 0 });
+            }
+        }
+        data.commandCount = static_cast<GLuint>(m_commands.size()) - data.firstCommand;
+        m_models.push_back(data);
+    }
+
+    for (Entry& entry : m_entries) {
+        const Model::DrawBatch& depth = entry.model->getDepthBatch();
+        entry.firstDepthCommand = static_cast<GLuint>(m_commands.size());
+        entry.depthCommandCount = static_cast<GLsizei>(depth.counts.size());
+        for (size_t i = 0; i < depth.counts.size(); i++) {
+            GLuint firstIndex = static_cast<GLuint>(reinterpret_cast<size_t>(depth.offsets[i]) / sizeof(unsigned int));
+            m_commands.push_back({ static_cast<GLuint>(depth.counts[i]), 0, firstIndex, depth.baseVertices[i], 0 });
+        }
+    }
+
+    // the commands and the models keep their number until the models change, so their
+    // buffers are only allocated here, and filled from the stream by upload()
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, m_commands.size() * sizeof(Command), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_modelBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, m_models.size() * sizeof(CullModel), NULL, GL_DYNAMIC_DRAW);
+    m_commandsBuilt = true;
+}
+
+// a copy on the GPU, queued after the draws of the last frame that still read the target
+void GpuCuller::copyFromStream(const StreamRange& range, unsigned int buffer, size_t offset)
+{
+    if (range.size == 0)
+        return;
+    glBindBuffer(GL_COPY_READ_BUFFER, range.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.offset, offset, range.size);
+}
+
+void GpuCuller::upload()
+{
+    if (!m_commandsBuilt)
+        buildCommands();
+
+    m_instanceCount = 0;
+    for (size_t m = 0; m < m_entries.size(); m++) {
+        m_models[m].firstInstance = static_cast<GLuint>(m_instanceCount);
+        m_models[m].instanceCount = static_cast<GLuint>(m_entries[m].matrices.size());
+        m_instanceCount += m_entries[m].matrices.size();
+    }
+
+    // the buffer is only reallocated to grow. The matrices are written into the stream and
+    // copied into the first half on the GPU, so the CPU never waits for the last frame
+    if (m_instanceCount > m_matrixCapacity) {
+        m_matrixCapacity = std::max(m_instanceCount, 2 * m_matrixCapacity);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_matrixBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, 2 * m_matrixCapacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    }
+    for (size_t m = 0; m < m_entries.size(); m++) {
+        const std::vector<glm::mat4>& matrices = m_entries[m].matrices;
+        StreamRange range = m_stream.write(matrices.data(), matrices.size() * sizeof(glm::mat4), sizeof(glm::mat4));
+        copyFromStream(range, m_matrixBuffer, m_models[m].firstInstance * sizeof(glm::mat4));
+    }
+
+    // the draws read the visible instances of their model from the second half, and count
+    // them up from zero in cull(). The depth draws read all of them from the first half
+    for (size_t m = 0; m < m_entries.size(); m++) {
+        const CullModel& model = m_models[m];
+        for (GLuint c = model.firstCommand; c < model.firstCommand + model.commandCount; c++) {
+            m_commands[c].instanceCount = 0;
+            m_commands[c].baseInstance = static_cast<GLuint>(m_matrixCapacity) + model.firstInstance;
+        }
+        const Entry& entry = m_entries[m];
+        for (GLuint c = entry.firstDepthCommand; c < entry.firstDepthCommand + static_cast<GLuint>(entry.depthCommandCount); c++) {
+            m_commands[c].instanceCount = model.instanceCount;
+            m_commands[c].baseInstance = model.firstInstance;
+        }
+    }
+    copyFromStream(m_stream.write(m_commands.data(), m_commands.size() * sizeof(Command)), m_commandBuffer, 0);
+    copyFromStream(m_stream.write(m_models.data(), m_models.size() * sizeof(CullModel)), m_modelBuffer, 0);
+}
+
+#ifdef GL_VERSION_4_3
+// a texture with the size of the buffer of the culler and one mipmap per level of its pyramid,
+// filled again every frame. It is small: 170 KB at the default 256x128
+void GpuCuller::uploadPyramid(const OcclusionCuller& occlusion)
+{
+    const std::vector<OcclusionCuller::Level>& levels = occlusion.getLevels();
+    if (m_pyramid == 0 || m_pyramidWidth != levels[0].width || m_pyramidHeight != levels[0].height) {
+        if (m_pyramid != 0)
+            glDeleteTextures(1, &m_pyramid);
+        m_pyramidWidth = levels[0].width;
+        m_pyramidHeight = levels[0].height;
+        glGenTextures(1, &m_pyramid);
+        glBindTexture(GL_TEXTURE_2D, m_pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(levels.size()), GL_R32F, m_pyramidWidth, m_pyramidHeight);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glActiveTexture(GL_TEXTURE0 + PYRAMID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_pyramid);
+    for (size_t l = 0; l < levels.size(); l++)
+        glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(l), 0, 0, levels[l].width, levels[l].height, GL_RED, GL_FLOAT, levels[l].depth.data());
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GpuCuller::cull(const glm::mat4& view, const glm::mat4& projection, const OcclusionCuller* occlusion)
+{
+    if (m_instanceCount == 0)
+        return;
+
+    bool occluded = occlusion != nullptr && occlusion->getTriangleCount() > 0;
+    if (occluded)
+        uploadPyramid(*occlusion);
+
+    m_shader->use();
+    m_shader->setMat4("view", view);
+    m_shader->setMat4("projection", projection);
+    m_shader->setInt("instanceTotal", static_cast<int>(m_instanceCount));
+    m_shader->setInt("modelCount", static_cast<int>(m_models.size()));
+    m_shader->setInt("visibleBase", static_cast<int>(m_matrixCapacity));
+    m_shader->setBool("occlusion", occluded);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_matrixBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_modelBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_commandBuffer);
+    glDispatchCompute((static_cast<GLuint>(m_instanceCount) + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+    // the draws read the commands and the matrices the shader wrote, and the copies of the
+    // next upload() overwrite them
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void GpuCuller::draw(ShaderVariants& shaders)
+{
+    m_drawCount = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    for (Entry& entry : m_entries) {
+        if (entry.matrices.empty())
+            continue;
+        Model& model = *entry.model;
+        const std::vector<Model::DrawBatch>& batches = model.getBatches();
+        model.arena->bind();
+        for (const Entry::Group& group : entry.groups) {
+            const Model::DrawBatch& batch = batches[group.batch];
+            if (model.materialTable != nullptr) {
+                shaders.use(model.materialTable->getFeatures(batch.group) | SHADER_INSTANCED);
+                model.materialTable->bind(batch.group);
+            }
+            else
+                model.meshes[batch.meshIndex].BindTextures(shaders.use(SHADER_INSTANCED));
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(group.firstCommand * sizeof(Command)), group.commandCount, 0);
+            m_drawCount++;
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GpuCuller::drawDepth(unsigned int model)
+{
+    Entry& entry = m_entries[model];
+    if (entry.matrices.empty() || entry.depthCommandCount == 0)
+        return;
+    entry.model->arena->bindDepth();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(entry.firstDepthCommand * sizeof(Command)), entry.depthCommandCount, 0);
+}
+#else
+// there is never a culler to call these on without OpenGL 4.3 (see isSupported())
+void GpuCuller::cull(const glm::mat4&, const glm::mat4&, const OcclusionCuller*)
+{
+}
+
+void GpuCuller::draw(ShaderVariants&)
+{
+}
+
+void GpuCuller::drawDepth(unsigned int)
+{
+}
+#endif
@@ -0,0 +1,227 @@
+#include "LightClusters.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+LightSettings LightSettings::load(const Settings& settings)
+{
+    LightSettings lights;
+    lights.enabled = settings.getBool("lights.enabled", lights.enabled);
+    lights.tilesX = std::clamp(settings.getInt("lights.tiles_x", lights.tilesX), 1, 64);
+    lights.tilesY = std::clamp(settings.getInt("lights.tiles_y", lights.tilesY), 1, 64);
+    lights.slices = std::clamp(settings.getInt("lights.slices", lights.slices), 1, 64);
+    lights.maxLights = std::clamp(settings.getInt("lights.max_lights", lights.maxLights), 1, 65536);
+    lights.maxPerCluster = std::clamp(settings.getInt("lights.max_per_cluster", lights.maxPerCluster), 1, 1024);
+    lights.distance = std::max(settings.getFloat("lights.distance", lights.distance), 1.0f);
+    return lights;
+}
+
+LightClusters::LightClusters(const LightSettings& settings) : m_settings(settings)
+{
+    fitTextureBuffers();
+    size_t clusters = static_cast<size_t>(m_settings.tilesX) * m_settings.tilesY * m_settings.slices;
+    size_t references = clusters * m_settings.maxPerCluster;
+
+    // everything is as big as it can get up front, so a frame never allocates
+    m_lights.reserve(m_settings.maxLights);
+    m_extents.resize(m_settings.maxLights);
+    m_order.reserve(m_settings.maxLights);
+    m_slots.resize(references);
+    m_counts.resize(clusters);
+    m_ranges.resize(clusters);
+    m_indices.reserve(references);
+
+    m_clusterBuffer = createTextureBuffer(GL_RG32UI, clusters * sizeof(glm::uvec2));
+    m_indexBuffer = createTextureBuffer(GL_R32UI, references * sizeof(unsigned int));
+    m_lightBuffer = createTextureBuffer(GL_RGBA32F, m_settings.maxLights * sizeof(Light));
+}
+
+// OpenGL only guarantees 65536 texels in a texture buffer, and the default grid with its lists
+// takes more than three times as many: the settings shrink to what the driver allows
+void LightClusters::fitTextureBuffers()
+{
+    GLint limit = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+    size_t texels = static_cast<size_t>(std::max(limit, 65536));
+
+    // the slices go first if even one light per cluster does not fit, the tiles keep the screen resolution
+    size_t tiles = static_cast<size_t>(m_settings.tilesX) * m_settings.tilesY;
+    if (tiles * m_settings.slices > texels) {
+        int slices = static_cast<int>(std::max<size_t>(texels / tiles, 1));
+        std::cout << "ERROR::LIGHTS:: " << m_settings.slices << " slices do not fit in a texture buffer of " << texels << " texels, using " << slices << std::endl;
+        m_settings.slices = slices;
+    }
+    size_t clusters = tiles * m_settings.slices;
+    if (clusters * m_settings.maxPerCluster > texels) {
+        int maxPerCluster = static_cast<int>(std::max<size_t>(texels / clusters, 1));
+        std::cout << "ERROR::LIGHTS:: " << m_settings.maxPerCluster << " lights per cluster do not fit in a texture buffer of " << texels << " texels, using " << maxPerCluster << std::endl;
+        m_settings.maxPerCluster = maxPerCluster;
+    }
+    // a light takes a texel for its position and radius and one for its color
+    size_t texelsPerLight = sizeof(Light) / sizeof(glm::vec4);
+    if (m_settings.maxLights * texelsPerLight > texels) {
+        int maxLights = static_cast<int>(texels / texelsPerLight);
+        std::cout << "ERROR::LIGHTS:: " << m_settings.maxLights << " lights do not fit in a texture buffer of " << texels << " texels, using " << maxLights << std::endl;
+        m_settings.maxLights = maxLights;
+    }
+}
+
+LightClusters::~LightClusters()
+{
+    for (TextureBuffer* buffer : { &m_clusterBuffer, &m_indexBuffer, &m_lightBuffer }) {
+        glDeleteTextures(1, &buffer->texture);
+        glDeleteBuffers(1, &buffer->buffer);
+    }
+}
+
+LightClusters::TextureBuffer LightClusters::createTextureBuffer(GLenum format, size_t bytes)
+{
+    TextureBuffer buffer;
+    glGenBuffers(1, &buffer.buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glGenTextures(1, &buffer.texture);
+    glBindTexture(GL_TEXTURE_BUFFER, buffer.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer.buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return buffer;
+}
+
+void LightClusters::add(const glm::vec3& position, float radius, const glm::vec3& color)
+{
+    if (m_lights.size() < static_cast<size_t>(m_settings.maxLights))
+        m_lights.push_back({ glm::vec4(position, radius), glm::vec4(color, 0.0f) });
+}
+
+int LightClusters::sliceOf(float depth) const
+{
+    // the slices are spaced evenly in log(depth), so they are about as deep as they are wide
+    int slice = static_cast<int>(std::floor(std::log(depth) * m_sliceScale + m_sliceBias));
+    return std::clamp(slice, 0, m_settings.slices - 1);
+}
+
+LightClusters::Extent LightClusters::extentOf(const Light& light, const glm::mat4& view, const glm::mat4& projection) const
+{
+    Extent extent = { 0, m_settings.tilesX - 1, 0, m_settings.tilesY - 1, 1, 0, 0.0f };
+    glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRadius), 1.0f));
+    float radius = light.positionRadius.w;
+    float depth = -center.z;
+    extent.depth = depth;
+    if (depth + radius < m_near || depth - radius > m_settings.distance)
+        return extent;
+
+    // a light around the near plane may cover any tile. Otherwise the box around the
+    // sphere is projected: its corners bound the sphere on the screen
+    if (depth - radius > m_near) {
+        float nearDepth = depth - radius;
+        float farDepth = depth + radius;
+        float left = std::min((center.x - radius) / nearDepth, (center.x - radius) / farDepth) * projection[0][0];
+        float right = std::max((center.x + radius) / nearDepth, (center.x + radius) / farDepth) * projection[0][0];
+        float bottom = std::min((center.y - radius) / nearDepth, (center.y - radius) / farDepth) * projection[1][1];
+        float top = std::max((center.y + radius) / nearDepth, (center.y + radius) / farDepth) * projection[1][1];
+        if (right < -1.0f || left > 1.0f || top < -1.0f || bottom > 1.0f)
+            return extent;
+
+        auto tile = [](float ndc, int tiles) {
+            return std::clamp(static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+        };
+        extent.minX = tile(left, m_settings.tilesX);
+        extent.maxX = tile(right, m_settings.tilesX);
+        extent.minY = tile(bottom, m_settings.tilesY);
+        extent.maxY = tile(top, m_settings.tilesY);
+    }
+    extent.minSlice = sliceOf(std::max(depth - radius, m_near));
+    extent.maxSlice = sliceOf(std::min(depth + radius, m_settings.distance));
+    return extent;
+}
+
+// every worker owns a range of slices, and so the clusters in them: no two write the same list
+void LightClusters::binSlices(int begin, int end)
+{
+    const unsigned int capacity = static_cast<unsigned int>(m_settings.maxPerCluster);
+    const int tilesX = m_settings.tilesX;
+    const int tilesY = m_settings.tilesY;
+    for (unsigned int light : m_order) {
+        const Extent& extent = m_extents[light];
+        int first = std::max(extent.minSlice, begin);
+        int last = std::min(extent.maxSlice, end - 1);
+        for (int slice = first; slice <= last; slice++)
+            for (int y = extent.minY; y <= extent.maxY; y++)
+                for (int x = extent.minX; x <= extent.maxX; x++) {
+                    size_t cluster = (static_cast<size_t>(slice) * tilesY + y) * tilesX + x;
+                    // the lights come nearest first, so a full cluster keeps the ones that matter most
+                    if (m_counts[cluster] < capacity)
+                        m_slots[cluster * capacity + m_counts[cluster]++] = light;
+                }
+    }
+}
+
+void LightClusters::update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, int width, int height)
+{
+    m_near = nearPlane;
+    float logRange = std::log(m_settings.distance / nearPlane);
+    m_sliceScale = static_cast<float>(m_settings.slices) / logRange;
+    m_sliceBias = -static_cast<float>(m_settings.slices) * std::log(nearPlane) / logRange;
+    m_tileScale = glm::vec2(static_cast<float>(m_settings.tilesX) / std::max(width, 1), static_cast<float>(m_settings.tilesY) / std::max(height, 1));
+
+    // where every light falls, then the lights from the nearest
+    Parallel::forRange(m_lights.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            m_extents[i] = extentOf(m_lights[i], view, projection);
+    });
+    m_order.clear();
+    for (unsigned int i = 0; i < m_lights.size(); i++)
+        if (m_extents[i].minSlice <= m_extents[i].maxSlice)
+            m_order.push_back(i);
+    std::sort(m_order.begin(), m_order.end(), [this](unsigned int a, unsigned int b) {
+        return m_extents[a].depth < m_extents[b].depth;
+    });
+
+    std::fill(m_counts.begin(), m_counts.end(), 0u);
+    Parallel::forRange(static_cast<size_t>(m_settings.slices), 1, [this](size_t begin, size_t end) {
+        binSlices(static_cast<int>(begin), static_cast<int>(end));
+    });
+
+    // the lists one after another, each cluster with its offset and count
+    const unsigned int capacity = static_cast<unsigned int>(m_settings.maxPerCluster);
+    m_indices.clear();
+    m_busiest = 0;
+    for (size_t cluster = 0; cluster < m_counts.size(); cluster++) {
+        unsigned int count = m_counts[cluster];
+        m_ranges[cluster] = glm::uvec2(static_cast<unsigned int>(m_indices.size()), count);
+        m_indices.insert(m_indices.end(), m_slots.begin() + cluster * capacity, m_slots.begin() + cluster * capacity + count);
+        m_busiest = std::max(m_busiest, count);
+    }
+
+    // the old storage is orphaned, so the driver does not wait for the draws of the last frame
+    auto upload = [](const TextureBuffer& buffer, const void* data, size_t bytes, size_t capacity) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    };
+    upload(m_clusterBuffer, m_ranges.data(), m_ranges.size() * sizeof(glm::uvec2), m_ranges.size() * sizeof(glm::uvec2));
+    upload(m_indexBuffer, m_indices.data(), m_indices.size() * sizeof(unsigned int), m_slots.size() * sizeof(unsigned int));
+    upload(m_lightBuffer, m_lights.data(), m_lights.size() * sizeof(Light), m_settings.maxLights * sizeof(Light));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::setUniforms(FrameUniforms& frame) const
+{
+    frame.clusterScale = glm::vec4(m_tileScale, m_sliceScale, m_sliceBias);
+    frame.clusterGrid = glm::vec4(static_cast<float>(m_settings.tilesX), static_cast<float>(m_settings.tilesY), static_cast<float>(m_settings.slices), static_cast<float>(m_lights.size()));
+}
+
+void LightClusters::bindTextures(unsigned int firstUnit) const
+{
+    const TextureBuffer* buffers[] = { &m_clusterBuffer, &m_indexBuffer, &m_lightBuffer };
+    for (unsigned int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, buffers[i]->texture);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,163 @@
+#include "MaterialTable.h"
+
+#include <FileSystem.h>
+#include <stb_image.h>
+
+#include <iostream>
+
+MaterialTable::~MaterialTable()
+{
+    for (Array& array : m_arrays)
+        glDeleteTextures(1, &array.id);
+}
+
+unsigned int MaterialTable::addMaterial(const std::vector<Texture>& textures, const std::string& directory)
+{
+    std::string diffuse, specular;
+    for (const Texture& texture : textures) {
+        if (texture.type == "texture_diffuse" && diffuse.empty())
+            diffuse = FileSystem::Vfs::normalize(directory + '/' + texture.path);
+        else if (texture.type == "texture_specular" && specular.empty())
+            specular = FileSystem::Vfs::normalize(directory + '/' + texture.path);
+    }
+
+    auto key = std::make_pair(diffuse, specular);
+    auto found = m_materialOfPaths.find(key);
+    if (found != m_materialOfPaths.end())
+        return found->second;
+
+    if (m_materials.size() == MAX_MATERIALS) {
+        std::cout << "ERROR::MATERIAL_TABLE:: more than " << MAX_MATERIALS << " materials, reusing material 0" << std::endl;
+        return 0;
+    }
+
+    Material material;
+    material.diffusePath = diffuse;
+    material.specularPath = specular;
+    m_materials.push_back(material);
+
+    unsigned int index = static_cast<unsigned int>(m_materials.size() - 1);
+    m_materialOfPaths.emplace(key, index);
+    return index;
+}
+
+/// <summary>
+/// Finds the array an image belongs to by reading only the size from its header, and
+/// reserves a layer for it. The pixels are decoded later, one image at a time.
+/// </summary>
+MaterialTable::Slot MaterialTable::place(const std::string& path, std::map<std::pair<int, int>, int>& arrayOfSize)
+{
+    Slot slot;
+    if (path.empty())
+        return slot;
+
+    int width, height, nrComponents;
+    FileSystem::FileView file = FileSystem::vfs().open(path);
+    if (!file || !stbi_info_from_memory(file.bytes(), static_cast<int>(file.size()), &width, &height, &nrComponents)) {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return slot;
+    }
+
+    auto found = arrayOfSize.find(std::make_pair(width, height));
+    if (found == arrayOfSize.end()) {
+        Array array;
+        array.width = width;
+        array.height = height;
+        m_arrays.push_back(array);
+        found = arrayOfSize.emplace(std::make_pair(width, height), static_cast<int>(m_arrays.size() - 1)).first;
+    }
+
+    Array& array = m_arrays[found->second];
+    for (size_t i = 0; i < array.layers.size(); i++) {
+        if (array.layers[i] == path) {
+            slot.array = found->second;
+            slot.layer = static_cast<int>(i);
+            return slot;
+        }
+    }
+    array.layers.push_back(path);
+    slot.array = found->second;
+    slot.layer = static_cast<int>(array.layers.size() - 1);
+    return slot;
+}
+
+void MaterialTable::build()
+{
+    // 1. decide the array and layer of every image
+    std::map<std::pair<int, int>, int> arrayOfSize;
+    std::map<std::pair<int, int>, unsigned int> groupOfArrays;
+    for (Material& material : m_materials) {
+        Slot diffuse = place(material.diffusePath, arrayOfSize);
+        Slot specular = place(material.specularPath, arrayOfSize);
+        material.diffuseLayer = diffuse.layer;
+        material.specularLayer = specular.layer;
+
+        auto arrays = std::make_pair(diffuse.array, specular.array);
+        auto found = groupOfArrays.find(arrays);
+        if (found == groupOfArrays.end()) {
+            m_groups.push_back(arrays);
+            found = groupOfArrays.emplace(arrays, static_cast<unsigned int>(m_groups.size() - 1)).first;
+        }
+        material.group = found->second;
+    }
+
+    // 2. fill the arrays. Every image is expanded to RGBA so that all layers of an array share one format
+    for (Array& array : m_arrays) {
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, array.width, array.height, static_cast<GLsizei>(array.layers.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        for (size_t layer = 0; layer < array.layers.size(); layer++) {
+            int width, height, nrComponents;
+            unsigned char* data = nullptr;
+            FileSystem::FileView file = FileSystem::vfs().open(array.layers[layer]);
+            if (file)
+                data = stbi_load_from_memory(file.bytes(), static_cast<int>(file.size()), &width, &height, &nrComponents, 4);
+            if (data) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            }
+            else {
+                std::cout << "Texture failed to load at path: " << array.layers[layer] << std::endl;
+            }
+            stbi_image_free(data);
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_built = true;
+    m_boundGroup = NO_GROUP;
+}
+
+void MaterialTable::apply(Shader& shader) const
+{
+    std::vector<int> layers(2 * MAX_MATERIALS, -1);
+    for (size_t i = 0; i < m_materials.size(); i++) {
+        layers[2 * i] = m_materials[i].diffuseLayer;
+        layers[2 * i + 1] = m_materials[i].specularLayer;
+    }
+
+    shader.use();
+    glUniform2iv(glGetUniformLocation(shader.ID, "materialLayers"), MAX_MATERIALS, layers.data());
+    shader.setInt("diffuseArray", 0);
+    shader.setInt("specularArray", 1);
+}
+
+void MaterialTable::bind(unsigned int group) const
+{
+    if (group == m_boundGroup)
+        return;
+
+    const std::pair<int, int>& arrays = m_groups[group];
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays.first >= 0 ? m_arrays[arrays.first].id : 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays.second >= 0 ? m_arrays[arrays.second].id : 0);
+    glActiveTexture(GL_TEXTURE0);
+    m_boundGroup = group;
+}
@@ -0,0 +1,140 @@
+#include <Memory.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<size_t> s_allocations{ 0 };
+    std::atomic<size_t> s_frees{ 0 };
+    std::atomic<size_t> s_bytes{ 0 };
+}
+
+// every allocation of the game goes through here, to be counted. The nothrow forms end up
+// in these by default; the array and sized forms are replaced too, so they cannot be paired
+// with a delete of the runtime that would not know the memory came from malloc
+void* operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    s_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (memory != nullptr)
+        s_frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+namespace Memory {
+
+    Counters counters()
+    {
+        Counters counted;
+        counted.allocations = s_allocations.load(std::memory_order_relaxed);
+        counted.frees = s_frees.load(std::memory_order_relaxed);
+        counted.bytes = s_bytes.load(std::memory_order_relaxed);
+        return counted;
+    }
+
+    void* LinearArena::allocate(size_t size, size_t alignment)
+    {
+        for (;; m_block++, m_offset = 0) {
+            if (m_block == m_blocks.size()) {
+                // the next block, big enough for this allocation at least
+                Block block;
+                block.size = std::max(m_blockSize, size + alignment);
+                block.data.reset(new std::max_align_t[(block.size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+                m_blocks.push_back(std::move(block));
+            }
+            Block& block = m_blocks[m_block];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t offset = ((base + m_offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base;
+            if (offset + size <= block.size) {
+                m_offset = offset + size;
+                m_peak = std::max(m_peak, getUsedBytes());
+                return reinterpret_cast<unsigned char*>(block.data.get()) + offset;
+            }
+        }
+    }
+
+    void LinearArena::rewind(const Marker& marker)
+    {
+        m_block = marker.block;
+        m_offset = marker.offset;
+    }
+
+    size_t LinearArena::getUsedBytes() const
+    {
+        size_t used = m_offset;
+        for (size_t i = 0; i < m_block && i < m_blocks.size(); i++)
+            used += m_blocks[i].size;
+        return used;
+    }
+
+    size_t LinearArena::getCapacity() const
+    {
+        size_t capacity = 0;
+        for (const Block& block : m_blocks)
+            capacity += block.size;
+        return capacity;
+    }
+
+    LinearArena& frameArena()
+    {
+        static LinearArena arena;
+        return arena;
+    }
+
+    LinearArena& loadArena()
+    {
+        // the staging buffers of a load can be big, so the blocks are too
+        thread_local LinearArena arena(16 * 1024 * 1024);
+        return arena;
+    }
+
+    void beginFrame()
+    {
+        frameArena().reset();
+    }
+
+    void* BlockPool::acquire()
+    {
+        if (m_free.empty()) {
+            m_blocks.emplace_back(new std::max_align_t[(m_blockSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+            // room for every block to come back, so release() never allocates. It grows by
+            // doubling, like the blocks, so a new block does not copy the whole list every time
+            if (m_free.capacity() < m_blocks.size())
+                m_free.reserve(2 * m_blocks.size());
+            return m_blocks.back().get();
+        }
+        void* block = m_free.back();
+        m_free.pop_back();
+        return block;
+    }
+}
@@ -0,0 +1,364 @@
+#include "ModelImporter.h"
+
+#include <Importer.hpp>
+#include <scene.h>
+#include <postprocess.h>
+#include <AssimpFileSystem.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace {
+
+    const char MESH_FILE_MAGIC[4] = { 'S', 'S', 'M', 'H' };
+    // version 2: the node transforms are baked in and the meshes merged by material
+    const uint32_t MESH_FILE_VERSION = 2;
+
+    /// <summary>
+    /// Header at the start of a .mesh file. The vertex size is stored so that a file written
+    /// with a different Vertex layout is rejected instead of being read as garbage.
+    /// </summary>
+    struct MeshFileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t meshCount;
+        uint32_t vertexSize;
+    };
+
+    /// <summary>
+    /// Header of every mesh inside a .mesh file.
+    /// </summary>
+    struct MeshHeader {
+        uint32_t materialIndex;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+    };
+
+    /// <summary>
+    /// Reads consecutive values out of a FileView, failing once the end is passed.
+    /// </summary>
+    class Reader {
+     public:
+        explicit Reader(const FileSystem::FileView& file) : m_file(file) {}
+
+        bool read(void* destination, size_t size) {
+            if (size > m_file.size() - m_position)
+                return false;
+            if (size > 0)
+                std::memcpy(destination, m_file.data() + m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        bool readString(std::string& string) {
+            uint32_t length;
+            if (!read(&length, sizeof(length)) || length > m_file.size() - m_position)
+                return false;
+            string.assign(m_file.data() + m_position, length);
+            m_position += length;
+            return true;
+        }
+
+        /// <summary>
+        /// Returns the bytes not read yet.
+        /// </summary>
+        size_t remaining() const { return m_file.size() - m_position; }
+
+     private:
+        const FileSystem::FileView& m_file;
+        size_t m_position = 0;
+    };
+
+    void writeString(std::ostream& out, const std::string& string)
+    {
+        uint32_t length = static_cast<uint32_t>(string.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(string.data(), length);
+    }
+
+    // checks all material textures of a given type and stores their paths. The textures themselves are loaded by the Model.
+    void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const char* typeName, std::vector<Texture>& textures)
+    {
+        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+    }
+
+    // assimp's matrices are row-major, glm's are column-major
+    glm::mat4 toGlm(const aiMatrix4x4& matrix)
+    {
+        glm::mat4 result;
+        for (int row = 0; row < 4; row++)
+            for (int column = 0; column < 4; column++)
+                result[column][row] = matrix[row][column];
+        return result;
+    }
+
+    // moves the vertices of a mesh from the space of its node to the space of the model
+    void bakeTransform(MeshData& data, const glm::mat4& transform)
+    {
+        if (transform == glm::mat4(1.0f))
+            return;
+
+        glm::mat3 linear(transform);
+        // the normals go through the inverse transpose, so they stay perpendicular under a non-uniform scale
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+        for (Vertex& vertex : data.vertices)
+        {
+            vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+            if (glm::length(vertex.Normal) > 0.0f)
+                vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+            if (glm::length(vertex.Tangent) > 0.0f)
+                vertex.Tangent = glm::normalize(linear * vertex.Tangent);
+            if (glm::length(vertex.Bitangent) > 0.0f)
+                vertex.Bitangent = glm::normalize(linear * vertex.Bitangent);
+        }
+        // a mirroring transform turns the triangles inside out, so their winding is flipped back
+        if (glm::determinant(linear) < 0.0f)
+            for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+                std::swap(data.indices[i + 1], data.indices[i + 2]);
+    }
+
+    MeshData processMesh(aiMesh* mesh, const aiScene* scene)
+    {
+        MeshData data;
+        data.vertices.reserve(mesh->mNumVertices);
+        data.indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
+        data.materialIndex = mesh->mMaterialIndex;
+
+        // walk through each of the mesh's vertices
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex vertex = {};
+            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+            // positions
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            // normals
+            if (mesh->HasNormals())
+            {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+            // texture coordinates
+            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            {
+                glm::vec2 vec;
+                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+                // tangent
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+                // bitangent
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+            data.vertices.push_back(vertex);
+        }
+        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];
+            // retrieve all indices of the face and store them in the indices vector
+            for (unsigned int j = 0; j < face.mNumIndices; j++)
+                data.indices.push_back(face.mIndices[j]);
+        }
+        // process materials
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+        // Same applies to other texture as the following list summarizes:
+        // diffuse: texture_diffuseN
+        // specular: texture_specularN
+        // normal: texture_normalN
+
+        // 1. diffuse maps
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+        // 2. specular maps
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
+        // 3. normal maps
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
+        // 4. height maps
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
+
+        return data;
+    }
+
+    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+    // the transforms of the node and of all its parents are baked into the vertices, so the model comes out flat
+    void processNode(aiNode* node, const aiScene* scene, const aiMatrix4x4& parentTransform, ModelData& model)
+    {
+        aiMatrix4x4 transform = parentTransform * node->mTransformation;
+        // process each mesh located at the current node
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            // the node object only contains indices to index the actual objects in the scene.
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            model.meshes.push_back(processMesh(mesh, scene));
+            bakeTransform(model.meshes.back(), toGlm(transform));
+        }
+        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            processNode(node->mChildren[i], scene, transform, model);
+        }
+    }
+}
+
+namespace ModelImporter {
+
+    bool import(const std::string& path, ModelData& model)
+    {
+        FileSystem::FileView preprocessed = FileSystem::vfs().open(meshFilePath(path));
+        if (preprocessed && readMeshFile(preprocessed, model))
+            return true;
+        return importWithAssimp(path, model);
+    }
+
+    bool importWithAssimp(const std::string& path, ModelData& model)
+    {
+        // read file via ASSIMP. The files are memory-mapped by the Vfs and Assimp reads them from there
+        Assimp::Importer importer;
+        importer.SetIOHandler(new FileSystem::AssimpIOSystem());
+        // the path is normalized to '/' separators, the ones the IOSystem reports, so the .mtl of the model is found next to it
+        const aiScene* scene = importer.ReadFile(FileSystem::Vfs::normalize(path), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        // check for errors
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        {
+            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        // process ASSIMP's root node recursively, then make one mesh of every material
+        processNode(scene->mRootNode, scene, aiMatrix4x4(), model);
+        mergeByMaterial(model);
+        return true;
+    }
+
+    void mergeByMaterial(ModelData& model)
+    {
+        std::vector<MeshData> merged;
+        std::map<unsigned int, size_t> meshOfMaterial;
+        for (MeshData& mesh : model.meshes)
+        {
+            auto found = meshOfMaterial.find(mesh.materialIndex);
+            if (found == meshOfMaterial.end())
+            {
+                // the first mesh of a material is kept whole, with its textures
+                meshOfMaterial.emplace(mesh.materialIndex, merged.size());
+                merged.push_back(std::move(mesh));
+                continue;
+            }
+
+            MeshData& target = merged[found->second];
+            unsigned int baseVertex = static_cast<unsigned int>(target.vertices.size());
+            target.vertices.insert(target.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            target.indices.reserve(target.indices.size() + mesh.indices.size());
+            for (unsigned int index : mesh.indices)
+                target.indices.push_back(baseVertex + index);
+        }
+        model.meshes = std::move(merged);
+    }
+
+    bool readMeshFile(const FileSystem::FileView& file, ModelData& model)
+    {
+        Reader reader(file);
+        MeshFileHeader header;
+        if (!reader.read(&header, sizeof(header)) ||
+            std::memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MESH_FILE_VERSION ||
+            header.vertexSize != sizeof(Vertex)) {
+            std::cout << "ERROR::MESH_FILE:: unsupported .mesh file" << std::endl;
+            return false;
+        }
+
+        // the counts come from the file, so they are checked against its size before allocating anything:
+        // every mesh takes a header at least, and every texture two string lengths
+        if (header.meshCount > reader.remaining() / sizeof(MeshHeader))
+            return false;
+        std::vector<MeshData> meshes(header.meshCount);
+        for (MeshData& mesh : meshes) {
+            MeshHeader meshHeader;
+            if (!reader.read(&meshHeader, sizeof(meshHeader)))
+                return false;
+            mesh.materialIndex = meshHeader.materialIndex;
+
+            if (meshHeader.textureCount > reader.remaining() / (2 * sizeof(uint32_t)))
+                return false;
+            mesh.textures.resize(meshHeader.textureCount);
+            for (Texture& texture : mesh.textures) {
+                texture.id = 0;
+                if (!reader.readString(texture.type) || !reader.readString(texture.path))
+                    return false;
+            }
+
+            if (meshHeader.vertexCount > file.size() / sizeof(Vertex) || meshHeader.indexCount > file.size() / sizeof(unsigned int))
+                return false;
+            mesh.vertices.resize(meshHeader.vertexCount);
+            mesh.indices.resize(meshHeader.indexCount);
+            if (!reader.read(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex)) ||
+                !reader.read(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int)))
+                return false;
+        }
+
+        model.meshes = std::move(meshes);
+        return true;
+    }
+
+    bool writeMeshFile(const ModelData& model, std::ostream& out)
+    {
+        MeshFileHeader header;
+        std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+        header.version = MESH_FILE_VERSION;
+        header.meshCount = static_cast<uint32_t>(model.meshes.size());
+        header.vertexSize = sizeof(Vertex);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const MeshData& mesh : model.meshes) {
+            MeshHeader meshHeader;
+            meshHeader.materialIndex = mesh.materialIndex;
+            meshHeader.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            meshHeader.indexCount = static_cast<uint32_t>(mesh.indices.size());
+            meshHeader.textureCount = static_cast<uint32_t>(mesh.textures.size());
+            out.write(reinterpret_cast<const char*>(&meshHeader), sizeof(meshHeader));
+
+            for (const Texture& texture : mesh.textures) {
+                writeString(out, texture.type);
+                writeString(out, texture.path);
+            }
+            out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        }
+        return static_cast<bool>(out);
+    }
+
+    std::string meshFilePath(const std::string& path)
+    {
+        return FileSystem::Vfs::normalize(path) + ".mesh";
+    }
+}
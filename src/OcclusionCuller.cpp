@@ -0,0 +1,298 @@
+#include "OcclusionCuller.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    int powerOfTwo(int value, int least, int most)
+    {
+        int power = least;
+        while (power < value && power < most)
+            power *= 2;
+        return power;
+    }
+
+    // twice the signed area of abp: which side of the edge ab the point p is on
+    float edge(const glm::vec3& a, const glm::vec3& b, float x, float y)
+    {
+        return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    }
+}
+
+OcclusionSettings OcclusionSettings::load(const Settings& settings)
+{
+    OcclusionSettings occlusion;
+    occlusion.enabled = settings.getBool("occlusion.enabled", occlusion.enabled);
+    occlusion.width = powerOfTwo(settings.getInt("occlusion.width", occlusion.width), 32, 1024);
+    occlusion.height = powerOfTwo(settings.getInt("occlusion.height", occlusion.height), 32, 1024);
+    occlusion.distance = settings.getFloat("occlusion.distance", occlusion.distance);
+    occlusion.minSize = settings.getFloat("occlusion.min_size", occlusion.minSize);
+    return occlusion;
+}
+
+OccluderMesh::OccluderMesh(const Heightfield& heightfield)
+{
+    const glm::vec3& min = heightfield.getMin();
+    const glm::vec3& max = heightfield.getMax();
+    float cellSize = heightfield.getCellSize();
+    int fineWidth = std::max(static_cast<int>(std::ceil((max.x - min.x) / cellSize)), 1);
+    int fineDepth = std::max(static_cast<int>(std::ceil((max.z - min.z) / cellSize)), 1);
+    int step = std::max((std::max(fineWidth, fineDepth) + CELLS - 1) / CELLS, 1);
+    int width = (fineWidth + step - 1) / step;
+    int depth = (fineDepth + step - 1) / step;
+
+    // the lowest of the highest points in every coarse cell. Nothing is lower than the
+    // bottom of the model, where the heightfield has no ground
+    std::vector<float> lowest(static_cast<size_t>(width) * depth, max.y);
+    for (int z = 0; z < fineDepth; z++)
+        for (int x = 0; x < fineWidth; x++) {
+            float height = std::max(heightfield.height(min.x + (x + 0.5f) * cellSize, min.z + (z + 0.5f) * cellSize), min.y);
+            float& cell = lowest[static_cast<size_t>(z / step) * width + x / step];
+            cell = std::min(cell, height);
+        }
+
+    // every vertex takes the lowest of the cells around it, so the triangles between them
+    // stay under the ground of their cell. The vertices on the border are at the bottom
+    BoundingBox box;
+    for (int z = 0; z <= depth; z++)
+        for (int x = 0; x <= width; x++) {
+            float height = max.y;
+            for (int cz = z - 1; cz <= z; cz++)
+                for (int cx = x - 1; cx <= x; cx++)
+                    height = std::min(height, cx < 0 || cz < 0 || cx >= width || cz >= depth ? min.y : lowest[static_cast<size_t>(cz) * width + cx]);
+            vertices.push_back(glm::vec3(min.x + x * step * cellSize, height, min.z + z * step * cellSize));
+            box.add(vertices.back());
+        }
+    bounds = box.sphere();
+
+    for (int z = 0; z < depth; z++)
+        for (int x = 0; x < width; x++) {
+            unsigned int corner = static_cast<unsigned int>(z * (width + 1) + x);
+            unsigned int quad[4] = { corner, corner + 1, corner + width + 1, corner + width + 2 };
+            // a cell with all its corners at the bottom hides nothing above the sea
+            bool raised = false;
+            for (unsigned int vertex : quad)
+                raised = raised || vertices[vertex].y > min.y;
+            if (!raised)
+                continue;
+            indices.insert(indices.end(), { quad[0], quad[2], quad[1], quad[1], quad[2], quad[3] });
+        }
+}
+
+OcclusionCuller::OcclusionCuller(const OcclusionSettings& settings) : m_settings(settings)
+{
+    // the buffer, then every level half the size of the one below, down to one texel
+    int width = settings.width;
+    int height = settings.height;
+    for (;;) {
+        Level level;
+        level.width = width;
+        level.height = height;
+        level.depth.assign(static_cast<size_t>(width) * height, 1.0f);
+        m_levels.push_back(std::move(level));
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    m_triangles.reserve(16 * 1024);
+}
+
+void OcclusionCuller::begin(const glm::mat4& view, const glm::mat4& projection)
+{
+    m_view = view;
+    m_projection = projection;
+    m_viewProjection = projection * view;
+    m_near = projection[3][2] / (projection[2][2] - 1.0f);
+    m_triangles.clear();
+    m_occluders = 0;
+    m_tested = 0;
+    m_culled = 0;
+}
+
+// the rectangle of texels of the box around a sphere in view space. A sphere around the
+// camera may cover any texel
+bool OcclusionCuller::screenRect(const glm::vec3& center, float radius, glm::ivec4& rect) const
+{
+    const Level& buffer = m_levels[0];
+    float depth = -center.z;
+    if (depth + radius < m_near)
+        return false;
+    if (depth - radius <= m_near) {
+        rect = glm::ivec4(0, 0, buffer.width - 1, buffer.height - 1);
+        return true;
+    }
+
+    float nearDepth = depth - radius;
+    float farDepth = depth + radius;
+    float left = std::min((center.x - radius) / nearDepth, (center.x - radius) / farDepth) * m_projection[0][0];
+    float right = std::max((center.x + radius) / nearDepth, (center.x + radius) / farDepth) * m_projection[0][0];
+    float bottom = std::min((center.y - radius) / nearDepth, (center.y - radius) / farDepth) * m_projection[1][1];
+    float top = std::max((center.y + radius) / nearDepth, (center.y + radius) / farDepth) * m_projection[1][1];
+    if (right < -1.0f || left > 1.0f || top < -1.0f || bottom > 1.0f)
+        return false;
+
+    auto texel = [](float ndc, int size) {
+        return std::clamp(static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * size)), 0, size - 1);
+    };
+    rect = glm::ivec4(texel(left, buffer.width), texel(bottom, buffer.height), texel(right, buffer.width), texel(top, buffer.height));
+    return true;
+}
+
+void OcclusionCuller::addOccluder(const OccluderMesh& mesh, const glm::mat4& model)
+{
+    BoundingSphere sphere = mesh.bounds.transformed(model);
+    glm::vec3 center = glm::vec3(m_view * glm::vec4(sphere.center, 1.0f));
+    glm::ivec4 rect;
+    if (-center.z - sphere.radius > m_settings.distance || !screenRect(center, sphere.radius, rect))
+        return;
+    if (rect.z - rect.x + 1 < m_settings.minSize && rect.w - rect.y + 1 < m_settings.minSize)
+        return;
+
+    m_occluders++;
+    glm::mat4 toClip = m_viewProjection * model;
+    m_clip.clear();
+    for (const glm::vec3& vertex : mesh.vertices)
+        m_clip.push_back(toClip * glm::vec4(vertex, 1.0f));
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        glm::vec4 triangle[3] = { m_clip[mesh.indices[i]], m_clip[mesh.indices[i + 1]], m_clip[mesh.indices[i + 2]] };
+        clipAndAdd(triangle);
+    }
+}
+
+// cuts the triangle at the near plane, where z = -w, and adds what is left as seen on the buffer
+void OcclusionCuller::clipAndAdd(const glm::vec4* clip)
+{
+    // all three out on the same side: nothing of it is on the screen
+    for (int axis = 0; axis < 2; axis++) {
+        if (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w)
+            return;
+        if (clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w)
+            return;
+    }
+
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        const glm::vec4& from = clip[i];
+        const glm::vec4& to = clip[(i + 1) % 3];
+        float fromDistance = from.z + from.w;
+        float toDistance = to.z + to.w;
+        if (fromDistance >= 0.0f)
+            polygon[count++] = from;
+        if ((fromDistance >= 0.0f) != (toDistance >= 0.0f))
+            polygon[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+    }
+    if (count < 3)
+        return;
+
+    const Level& buffer = m_levels[0];
+    glm::vec3 screen[4];
+    for (int i = 0; i < count; i++) {
+        glm::vec3 ndc = glm::vec3(polygon[i]) / polygon[i].w;
+        screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * buffer.width, (ndc.y * 0.5f + 0.5f) * buffer.height, ndc.z);
+    }
+    for (int i = 1; i + 1 < count; i++)
+        m_triangles.push_back({ screen[0], screen[i], screen[i + 1] });
+}
+
+// writes the nearest depth of the triangle into the texels of some rows whose centers it covers
+void OcclusionCuller::rasterize(const Triangle& triangle, int firstRow, int endRow)
+{
+    Level& buffer = m_levels[0];
+    glm::vec3 a = triangle.a;
+    glm::vec3 b = triangle.b;
+    glm::vec3 c = triangle.c;
+    float area = edge(a, b, c.x, c.y);
+    if (std::abs(area) < 1e-6f)
+        return;
+    if (area < 0.0f) {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    int minX = std::max(static_cast<int>(std::floor(std::min({ a.x, b.x, c.x }))), 0);
+    int maxX = std::min(static_cast<int>(std::ceil(std::max({ a.x, b.x, c.x }))), buffer.width - 1);
+    int minY = std::max(static_cast<int>(std::floor(std::min({ a.y, b.y, c.y }))), firstRow);
+    int maxY = std::min(static_cast<int>(std::ceil(std::max({ a.y, b.y, c.y }))), endRow - 1);
+    for (int y = minY; y <= maxY; y++) {
+        float* row = &buffer.depth[static_cast<size_t>(y) * buffer.width];
+        for (int x = minX; x <= maxX; x++) {
+            float px = x + 0.5f;
+            float py = y + 0.5f;
+            float wa = edge(b, c, px, py);
+            float wb = edge(c, a, px, py);
+            float wc = edge(a, b, px, py);
+            if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+                continue;
+            // the depth in normalized device coordinates is linear on the screen
+            float depth = (wa * a.z + wb * b.z + wc * c.z) / area;
+            row[x] = std::min(row[x], depth);
+        }
+    }
+}
+
+void OcclusionCuller::finish()
+{
+    Level& buffer = m_levels[0];
+    std::fill(buffer.depth.begin(), buffer.depth.end(), 1.0f);
+
+    // every worker owns a band of rows, and goes through all the triangles for it
+    Parallel::forRange(static_cast<size_t>(buffer.height), 16, [this](size_t begin, size_t end) {
+        for (const Triangle& triangle : m_triangles)
+            rasterize(triangle, static_cast<int>(begin), static_cast<int>(end));
+    });
+
+    // every texel of a level keeps the farthest of the texels under it
+    for (size_t l = 1; l < m_levels.size(); l++) {
+        const Level& below = m_levels[l - 1];
+        Level& level = m_levels[l];
+        for (int y = 0; y < level.height; y++)
+            for (int x = 0; x < level.width; x++) {
+                int x0 = std::min(2 * x, below.width - 1);
+                int x1 = std::min(2 * x + 1, below.width - 1);
+                int y0 = std::min(2 * y, below.height - 1);
+                int y1 = std::min(2 * y + 1, below.height - 1);
+                level.depth[static_cast<size_t>(y) * level.width + x] = std::max(
+                    std::max(below.depth[static_cast<size_t>(y0) * below.width + x0], below.depth[static_cast<size_t>(y0) * below.width + x1]),
+                    std::max(below.depth[static_cast<size_t>(y1) * below.width + x0], below.depth[static_cast<size_t>(y1) * below.width + x1]));
+            }
+    }
+}
+
+bool OcclusionCuller::isVisible(const BoundingSphere& sphere) const
+{
+    m_tested++;
+    glm::vec3 center = glm::vec3(m_view * glm::vec4(sphere.center, 1.0f));
+    glm::ivec4 rect;
+    if (!screenRect(center, sphere.radius, rect)) {
+        m_culled++;
+        return false;
+    }
+    float nearDepth = -center.z - sphere.radius;
+    if (nearDepth <= m_near || m_triangles.empty())
+        return true;
+
+    // a texel more on every side, for the occluder edges that cover a texel center only
+    const Level& buffer = m_levels[0];
+    rect = glm::ivec4(std::max(rect.x - 1, 0), std::max(rect.y - 1, 0), std::min(rect.z + 1, buffer.width - 1), std::min(rect.w + 1, buffer.height - 1));
+
+    // the lowest level where the rectangle spans no more than 2x2 texels
+    size_t l = 0;
+    while (l + 1 < m_levels.size() && ((rect.z >> l) - (rect.x >> l) > 1 || (rect.w >> l) - (rect.y >> l) > 1))
+        l++;
+    const Level& level = m_levels[l];
+    float farthest = 0.0f;
+    for (int y = std::min(rect.y >> l, level.height - 1); y <= std::min(rect.w >> l, level.height - 1); y++)
+        for (int x = std::min(rect.x >> l, level.width - 1); x <= std::min(rect.z >> l, level.width - 1); x++)
+            farthest = std::max(farthest, level.depth[static_cast<size_t>(y) * level.width + x]);
+
+    float depth = (m_projection[2][2] * -nearDepth + m_projection[3][2]) / nearDepth;
+    if (depth > farthest) {
+        m_culled++;
+        return false;
+    }
+    return true;
+}
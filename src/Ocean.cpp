@@ -0,0 +1,114 @@
+#include "Ocean.h"
+
+#include <GeometryArena.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    const std::string oceanVertexShader{ "shaders\\vShaderOcean.txt" };
+    const std::string oceanFragmentShader{ "shaders\\fShaderOcean.txt" };
+
+    // cells at the outer edge of every ring that morph into the grid of the next ring
+    const int MORPH_CELLS = 4;
+}
+
+OceanSettings OceanSettings::load(const Settings& settings)
+{
+    OceanSettings ocean;
+    ocean.enabled = settings.getBool("ocean.enabled", ocean.enabled);
+    ocean.levels = std::clamp(settings.getInt("ocean.levels", ocean.levels), 1, 16);
+    // the rings are halved and quartered, and the morph band must fit in them
+    ocean.gridSize = std::clamp(settings.getInt("ocean.grid_size", ocean.gridSize) / 8 * 8, 16, 512);
+    ocean.cellSize = std::max(settings.getFloat("ocean.cell_size", ocean.cellSize), 0.01f);
+    return ocean;
+}
+
+Ocean::Ocean(const OceanSettings& settings, const glm::vec3& skyColor) :
+    m_settings(settings),
+    m_skyColor(skyColor)
+{
+    buildGrid();
+
+    m_shaders = std::make_unique<ShaderVariants>(oceanVertexShader, oceanFragmentShader);
+    m_shaders->setOnCreate([this](Shader& shader) {
+        shader.setVec4("clipmap", glm::vec4(m_settings.cellSize, m_settings.gridSize / 2, MORPH_CELLS, m_settings.levels));
+        shader.setVec3("skyColor", m_skyColor);
+    });
+    m_shaders->get(0);
+    m_shaders->get(SHADER_FOG);
+}
+
+Ocean::~Ocean()
+{
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_VBO);
+    glDeleteBuffers(1, &m_EBO);
+}
+
+// The grid of every ring, in its own cells around its own center: x, z and the ring.
+// The innermost ring is a full square, the others leave a hole for the ring inside
+// them. The hole is one cell smaller than that ring, because the ring inside snaps to
+// half the cell size and may be off by a cell; the overlap is discarded by the shader
+void Ocean::buildGrid()
+{
+    const int size = m_settings.gridSize;
+    const int half = size / 2;
+    const int hole = half / 2 - 1;
+    const int side = size + 1;
+
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+    vertices.reserve(static_cast<size_t>(side) * side * m_settings.levels);
+
+    for (int level = 0; level < m_settings.levels; level++) {
+        unsigned int first = static_cast<unsigned int>(vertices.size());
+        for (int z = -half; z <= half; z++)
+            for (int x = -half; x <= half; x++)
+                vertices.emplace_back(static_cast<float>(x), static_cast<float>(z), static_cast<float>(level));
+
+        for (int z = -half; z < half; z++) {
+            for (int x = -half; x < half; x++) {
+                if (level > 0 && x >= -hole && x < hole && z >= -hole && z < hole)
+                    continue;
+                unsigned int corner = first + (z + half) * side + (x + half);
+                indices.push_back(corner);
+                indices.push_back(corner + side);
+                indices.push_back(corner + 1);
+                indices.push_back(corner + 1);
+                indices.push_back(corner + side);
+                indices.push_back(corner + side + 1);
+            }
+        }
+    }
+    m_indexCount = static_cast<unsigned int>(indices.size());
+
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glGenBuffers(1, &m_EBO);
+
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glBindVertexArray(0);
+    GeometryArena::invalidateBinding();
+}
+
+void Ocean::Draw()
+{
+    m_shaders->use(0);
+    glBindVertexArray(m_VAO);
+    glDrawElements(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+    GeometryArena::invalidateBinding();
+}
+
+float Ocean::getExtent() const
+{
+    return m_settings.cellSize * static_cast<float>(1 << (m_settings.levels - 1)) * static_cast<float>(m_settings.gridSize / 2);
+}
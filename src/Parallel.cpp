@@ -0,0 +1,115 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    /// <summary>
+    /// The worker threads. Every forRange() is one generation of work: the workers wake up,
+    /// take chunks until there are none left, and report back.
+    /// </summary>
+    class Pool {
+     public:
+        Pool() {
+            unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+            for (unsigned int i = 1; i < cores; i++)
+                m_threads.emplace_back(&Pool::worker, this);
+        }
+
+        ~Pool() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (std::thread& thread : m_threads)
+                thread.join();
+        }
+
+        unsigned int threadCount() const { return static_cast<unsigned int>(m_threads.size()) + 1; }
+
+        void run(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_body = &body;
+                m_count = count;
+                m_grain = grain;
+                m_next = 0;
+                m_active = static_cast<unsigned int>(m_threads.size());
+                m_generation++;
+            }
+            m_wake.notify_all();
+            work();
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this] { return m_active == 0; });
+            m_body = nullptr;
+        }
+
+     private:
+        void work() {
+            for (;;) {
+                size_t begin = m_next.fetch_add(m_grain);
+                if (begin >= m_count)
+                    return;
+                (*m_body)(begin, std::min(begin + m_grain, m_count));
+            }
+        }
+
+        void worker() {
+            unsigned int seen = 0;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;) {
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+                lock.unlock();
+                work();
+                lock.lock();
+                if (--m_active == 0)
+                    m_done.notify_one();
+            }
+        }
+
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        const std::function<void(size_t, size_t)>* m_body = nullptr;
+        size_t m_count = 0;
+        size_t m_grain = 1;
+        std::atomic<size_t> m_next{ 0 };
+        unsigned int m_active = 0;      ///< Workers still on the current generation.
+        unsigned int m_generation = 0;
+        bool m_stop = false;
+    };
+
+    Pool& pool() {
+        static Pool instance;
+        return instance;
+    }
+}
+
+namespace Parallel {
+
+    unsigned int threadCount()
+    {
+        return pool().threadCount();
+    }
+
+    void forRange(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body)
+    {
+        grain = std::max<size_t>(grain, 1);
+        if (count <= grain) {
+            if (count > 0)
+                body(0, count);
+            return;
+        }
+        pool().run(count, grain, body);
+    }
+}
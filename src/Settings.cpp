@@ -0,0 +1,55 @@
+#include "Settings.h"
+
+#include <FileSystem.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+bool Settings::load(const std::string& path)
+{
+    FileSystem::FileView file = FileSystem::vfs().open(path);
+    if (!file)
+        return false;
+
+    std::istringstream lines(std::string(file.data(), file.size()));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        std::string key, value;
+        if (!(words >> key) || key[0] == '#')
+            continue;
+        if (!(words >> value)) {
+            std::cout << "ERROR::SETTINGS:: no value for " << key << " in " << path << std::endl;
+            continue;
+        }
+        m_values[key] = value;
+    }
+    return true;
+}
+
+int Settings::getInt(const std::string& key, int fallback) const
+{
+    auto found = m_values.find(key);
+    return found != m_values.end() ? std::atoi(found->second.c_str()) : fallback;
+}
+
+float Settings::getFloat(const std::string& key, float fallback) const
+{
+    auto found = m_values.find(key);
+    return found != m_values.end() ? static_cast<float>(std::atof(found->second.c_str())) : fallback;
+}
+
+bool Settings::getBool(const std::string& key, bool fallback) const
+{
+    auto found = m_values.find(key);
+    if (found == m_values.end())
+        return fallback;
+    return found->second == "1" || found->second == "true" || found->second == "on";
+}
+
+std::string Settings::getString(const std::string& key, const std::string& fallback) const
+{
+    auto found = m_values.find(key);
+    return found != m_values.end() ? found->second : fallback;
+}
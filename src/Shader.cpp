@@ -1,83 +1,256 @@
 #include "Shader.h"
 
-Shader::Shader(std::string& vertexPath, std::string& fragmentPath, std::string* geometryPath)
+#include <FileSystem.h>
+#include <ShaderCache.h>
+
+#include <string_view>
+
+unsigned int Shader::s_currentProgram = 0;
+
+Shader::Shader(std::string& vertexPath, std::string& fragmentPath, std::string* geometryPath) :
+    m_vertexPath(vertexPath),
+    m_fragmentPath(fragmentPath),
+    m_geometryPath(geometryPath != nullptr ? *geometryPath : "")
+{
+    Build build;
+    start(build);
+    finish(build);
+    ID = build.program;
+}
+
+Shader::Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines) :
+    m_vertexPath(vertexPath),
+    m_fragmentPath(fragmentPath),
+    m_defines(defines)
+{
+    Build build;
+    start(build);
+    finish(build);
+    ID = build.program;
+}
+
+Shader::Shader(const std::string& computePath) :
+    m_computePath(computePath)
+{
+    Build build;
+    start(build);
+    finish(build);
+    ID = build.program;
+}
+
+std::vector<std::string> Shader::getSourcePaths() const
+{
+    if (!m_computePath.empty())
+        return { m_computePath };
+    std::vector<std::string> paths{ m_vertexPath, m_fragmentPath };
+    if (!m_geometryPath.empty())
+        paths.push_back(m_geometryPath);
+    return paths;
+}
+
+void Shader::reload()
 {
-    std::string vShader, fShader, gShader, line;
-    std::ifstream vShaderPath, fShaderPath, gShaderPath;
+    // a reload still in flight is superseded by the newer sources
+    if (m_reloading) {
+        glDeleteProgram(m_reload.program);
+        for (unsigned int i = 0; i < m_reload.shaderCount; i++)
+            glDeleteShader(m_reload.shaders[i]);
+    }
+    m_reload = Build();
+    start(m_reload);
+    m_reloading = true;
+}
 
-    vShaderPath.open(vertexPath, std::ios::in);
-    while (getline(vShaderPath, line)) {
-        vShader.append(line);
-        vShader.push_back('\n');
+bool Shader::update()
+{
+    if (!m_reloading || !isFinished(m_reload))
+        return false;
+    m_reloading = false;
+
+    if (!finish(m_reload)) {
+        std::cout << "ERROR::SHADER::RELOAD_FAILED: " << (m_computePath.empty() ? m_fragmentPath : m_computePath) << ", the old program stays in use" << std::endl;
+        glDeleteProgram(m_reload.program);
+        return false;
     }
-    vShaderPath.close();
-    
-    line = "";
-
-    fShaderPath.open(fragmentPath, std::ios::in);
-    while (getline(fShaderPath, line)) {
-        fShader.append(line);
-        fShader.push_back('\n');
+
+    // swap the programs. The old one is deleted, so it must not be remembered as the current one
+    if (s_currentProgram == ID)
+        s_currentProgram = 0;
+    glDeleteProgram(ID);
+    ID = m_reload.program;
+    return true;
+}
+
+void Shader::start(Build& build)
+{
+    // the extension is only there when glad was generated with it; without it every build
+    // finishes at once, on the thread that asked for it
+#ifdef GL_KHR_parallel_shader_compile
+    static bool parallelCompile = false;
+    if (!parallelCompile && GLAD_GL_KHR_parallel_shader_compile) {
+        // let the driver use as many compiler threads as it likes, so the linking of a
+        // reload happens in the background and update() only picks up the result
+        glMaxShaderCompilerThreadsKHR(0xffffffffu);
+        parallelCompile = true;
     }
-    fShaderPath.close();
+#endif
 
-    line = "";
+    if (!m_computePath.empty()) {
+        startCompute(build);
+        return;
+    }
+
+    // the sources are memory-mapped and given to the driver with their lengths,
+    // so they are never copied into strings
+    FileSystem::FileView vShader = FileSystem::vfs().open(m_vertexPath);
+    FileSystem::FileView fShader = FileSystem::vfs().open(m_fragmentPath);
+    FileSystem::FileView gShader;
+    if (!vShader)
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << m_vertexPath << std::endl;
+    if (!fShader)
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << m_fragmentPath << std::endl;
 
     // geometry shader
-    if (geometryPath != nullptr) {
-        gShaderPath.open(*geometryPath, std::ios::in);
-        while (getline(gShaderPath, line)) {
-            gShader.append(line);
-            gShader.push_back('\n');
-        }
-        gShaderPath.close();
+    bool hasGeometry = !m_geometryPath.empty();
+    if (hasGeometry) {
+        gShader = FileSystem::vfs().open(m_geometryPath);
+        if (!gShader)
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << m_geometryPath << std::endl;
     }
 
-    const char* vShaderCode = vShader.c_str();
-    const char* fShaderCode = fShader.c_str();
-   
-    // compile shaders
-    unsigned int vertex, fragment, geometry;
-    
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    
-    // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-    
-    if (geometryPath != nullptr) {
-        const char* gShaderCode = gShader.c_str();
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &gShaderCode, NULL);
-        glCompileShader(geometry);
-        checkCompileErrors(geometry, "GEOMETRY");
+    // a missing source has no data to give the driver: the program stays empty, and finish() fails
+    build.program = glCreateProgram();
+    if (!vShader || !fShader || (hasGeometry && !gShader)) {
+        build.unread = true;
+        return;
     }
 
+    // a program linked from the same sources and defines on an earlier run is taken from the cache,
+    // when the driver has program binaries at all
+    build.key = ShaderCache::hash(m_defines.data(), m_defines.size());
+    for (const FileSystem::FileView* source : { &vShader, &fShader, &gShader }) {
+        uint64_t size = source->size();
+        build.key = ShaderCache::hash(reinterpret_cast<const char*>(&size), sizeof(size), build.key);
+        build.key = ShaderCache::hash(source->data(), source->size(), build.key);
+    }
+    if (ShaderCache::isSupported() && ShaderCache::load(build.program, build.key)) {
+        build.cached = true;
+        return;
+    }
+
+    // compile shaders. Nothing is queried here, so a driver with parallel compilation does not block
+    build.shaders[build.shaderCount++] = compile(GL_VERTEX_SHADER, vShader.data(), vShader.size(), m_defines);
+    build.shaders[build.shaderCount++] = compile(GL_FRAGMENT_SHADER, fShader.data(), fShader.size(), m_defines);
+    if (hasGeometry)
+        build.shaders[build.shaderCount++] = compile(GL_GEOMETRY_SHADER, gShader.data(), gShader.size(), m_defines);
+
     // shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    if (geometryPath != nullptr)
-        glAttachShader(ID, geometry);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+    for (unsigned int i = 0; i < build.shaderCount; i++)
+        glAttachShader(build.program, build.shaders[i]);
+    if (ShaderCache::isSupported())
+        ShaderCache::prepare(build.program);
+    glLinkProgram(build.program);
+}
+
+void Shader::startCompute(Build& build)
+{
+    FileSystem::FileView cShader = FileSystem::vfs().open(m_computePath);
+    build.program = glCreateProgram();
+    if (!cShader) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << m_computePath << std::endl;
+        build.unread = true;
+        return;
+    }
+
+    uint64_t size = cShader.size();
+    build.key = ShaderCache::hash(m_defines.data(), m_defines.size());
+    build.key = ShaderCache::hash(reinterpret_cast<const char*>(&size), sizeof(size), build.key);
+    build.key = ShaderCache::hash(cShader.data(), cShader.size(), build.key);
+    if (ShaderCache::isSupported() && ShaderCache::load(build.program, build.key)) {
+        build.cached = true;
+        return;
+    }
+
+#ifdef GL_COMPUTE_SHADER
+    build.shaders[build.shaderCount++] = compile(GL_COMPUTE_SHADER, cShader.data(), cShader.size(), m_defines);
+    glAttachShader(build.program, build.shaders[0]);
+    if (ShaderCache::isSupported())
+        ShaderCache::prepare(build.program);
+    glLinkProgram(build.program);
+#else
+    // a glad loader without OpenGL 4.3 has no compute shaders, and the program stays empty
+    std::cout << "ERROR::SHADER::COMPUTE_NOT_SUPPORTED: " << m_computePath << std::endl;
+    build.unread = true;
+#endif
+}
+
+bool Shader::isFinished(const Build& build) const
+{
+#ifdef GL_KHR_parallel_shader_compile
+    if (build.cached || build.unread || !GLAD_GL_KHR_parallel_shader_compile)
+        return true;
+    GLint completed = GL_FALSE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+#else
+    return true;
+#endif
+}
+
+bool Shader::finish(Build& build)
+{
+    if (build.cached)
+        return true;
+    if (build.unread) {
+        build.unread = false;
+        return false;
+    }
+
+    static const char* types[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+    bool success = true;
+    for (unsigned int i = 0; i < build.shaderCount; i++)
+        success = checkCompileErrors(build.shaders[i], m_computePath.empty() ? types[i] : "COMPUTE") && success;
+    success = checkCompileErrors(build.program, "PROGRAM") && success;
+    if (success && ShaderCache::isSupported())
+        ShaderCache::save(build.program, build.key);
 
     // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometryPath != nullptr)
-        glDeleteShader(geometry);
+    for (unsigned int i = 0; i < build.shaderCount; i++)
+        glDeleteShader(build.shaders[i]);
+    build.shaderCount = 0;
+    return success;
+}
+
+unsigned int Shader::compile(unsigned int type, const char* source, size_t size, const std::string& defines)
+{
+    // the #version line has to come first, so the defines go right after it. The source is
+    // passed in three pieces, and #line keeps the line numbers of the errors those of the file
+    std::string_view text(source, size);
+    size_t versionEnd = 0;
+    if (text.compare(0, 8, "#version") == 0) {
+        versionEnd = text.find('\n');
+        versionEnd = versionEnd == std::string_view::npos ? size : versionEnd + 1;
+    }
+    std::string header = defines;
+    if (versionEnd > 0 && !defines.empty())
+        header += "#line 2\n";
+
+    const char* pieces[3] = { source, header.data(), source + versionEnd };
+    GLint lengths[3] = { static_cast<GLint>(versionEnd), static_cast<GLint>(header.size()), static_cast<GLint>(size - versionEnd) };
+
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 3, pieces, lengths);
+    glCompileShader(shader);
+    return shader;
 }
 
 void Shader::use()
 {
+    // switching to the program already in use is skipped
+    if (s_currentProgram == ID)
+        return;
     glUseProgram(ID);
+    s_currentProgram = ID;
 }
 
 void Shader::setBool(const std::string& name, bool value) const
@@ -140,7 +313,7 @@ void Shader::setMat4(const std::string& name, const glm::mat4& mat) const
     glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 }
 
-void Shader::checkCompileErrors(unsigned int shader, std::string type)
+bool Shader::checkCompileErrors(unsigned int shader, std::string type)
 {
     int success;
     char infoLog[1024];
@@ -158,4 +331,5 @@ void Shader::checkCompileErrors(unsigned int shader, std::string type)
             std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
-}
\ No newline at end of file
+    return success != 0;
+}
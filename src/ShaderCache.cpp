@@ -0,0 +1,195 @@
+#include "ShaderCache.h"
+
+#include <glad.h>
+
+#include <FileSystem.h>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// The program binaries come with OpenGL 4.1 or ARB_get_program_binary. A glad loader generated
+// with neither has none of their entry points, and the cache is left out of the build: every
+// program is linked from its sources
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define SHADER_CACHE_BINARIES
+#endif
+
+namespace {
+
+    std::string cacheDirectory = "shadercache";
+
+#ifdef SHADER_CACHE_BINARIES
+    const char CACHE_MAGIC[4] = { 'S', 'S', 'P', 'B' };
+    const uint32_t CACHE_VERSION = 1;
+
+    /// <summary>
+    /// Header at the start of a cached binary. The whole key is stored, as the
+    /// file name only tells which file to try.
+    /// </summary>
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;    ///< The binary format the driver reported.
+        uint32_t length;    ///< Length of the binary that follows.
+    };
+
+    // the driver strings are part of the key: a binary is only valid for the driver that produced it
+    uint64_t driverKey(uint64_t key)
+    {
+        const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : names) {
+            const char* string = reinterpret_cast<const char*>(glGetString(name));
+            if (string != nullptr)
+                key = ShaderCache::hash(string, std::strlen(string), key);
+        }
+        return key;
+    }
+
+    std::string cachePath(uint64_t key)
+    {
+        std::ostringstream path;
+        path << cacheDirectory << '/' << std::hex << key << ".bin";
+        return path.str();
+    }
+#endif
+}
+
+namespace ShaderCache {
+
+    uint64_t hash(const char* data, size_t size, uint64_t seed)
+    {
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+#ifdef SHADER_CACHE_BINARIES
+    bool isSupported()
+    {
+        // without OpenGL 4.1 or the extension glad leaves glGetProgramBinary and glProgramBinary
+        // null, and GL_NUM_PROGRAM_BINARY_FORMATS is not a valid query. Asked once, as there is
+        // a single context
+        static const bool supported = [] {
+            bool loaded = false;
+#ifdef GL_VERSION_4_1
+            loaded = loaded || GLAD_GL_VERSION_4_1;
+#endif
+#ifdef GL_ARB_get_program_binary
+            loaded = loaded || GLAD_GL_ARB_get_program_binary;
+#endif
+            if (!loaded)
+                return false;
+            // a driver may support the entry points but no format at all
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            return formats > 0;
+        }();
+        return supported;
+    }
+
+    bool load(unsigned int program, uint64_t key)
+    {
+        if (!isSupported())
+            return false;
+
+        key = driverKey(key);
+        FileSystem::MappedFile file(cachePath(key));
+        CacheHeader header;
+        if (!file.isValid() || file.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != CACHE_VERSION ||
+            header.key != key ||
+            header.length != file.size() - sizeof(header))
+            return false;
+
+        glProgramBinary(program, header.format, file.data() + sizeof(header), static_cast<GLsizei>(header.length));
+        // the driver may reject a binary even from the same strings, e.g. after an update that kept the version
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    void prepare(unsigned int program)
+    {
+        if (isSupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void save(unsigned int program, uint64_t key)
+    {
+        if (!isSupported())
+            return;
+
+        GLint success = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (success != GL_TRUE || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        CacheHeader header;
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.version = CACHE_VERSION;
+        header.key = driverKey(key);
+        header.format = format;
+        header.length = static_cast<uint32_t>(length);
+
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        // written next to the final file and renamed, so a crash never leaves half a binary behind
+        std::string path = cachePath(header.key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), length);
+            if (!out) {
+                std::cout << "ERROR::SHADER_CACHE:: cannot write " << temporary << std::endl;
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            std::cout << "ERROR::SHADER_CACHE:: cannot write " << path << std::endl;
+            std::remove(temporary.c_str());
+        }
+    }
+#else
+    bool isSupported()
+    {
+        return false;
+    }
+
+    bool load(unsigned int, uint64_t)
+    {
+        return false;
+    }
+
+    void prepare(unsigned int)
+    {
+    }
+
+    void save(unsigned int, uint64_t)
+    {
+    }
+#endif
+
+    void setDirectory(const std::string& directory)
+    {
+        cacheDirectory = directory;
+    }
+}
@@ -0,0 +1,101 @@
+#include "ShaderVariants.h"
+
+#include <iostream>
+
+namespace {
+    const char* FEATURE_DEFINES[SHADER_FEATURE_COUNT] = {
+        "DIFFUSE_MAP",
+        "SPECULAR_MAP",
+        "FOG",
+        "INSTANCED",
+        "SHADOWS",
+        "POINT_LIGHTS"
+    };
+}
+
+ShaderVariants::ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath) :
+    m_vertexPath(vertexPath),
+    m_fragmentPath(fragmentPath)
+{
+}
+
+std::string ShaderVariants::defines(unsigned int features)
+{
+    std::string lines;
+    for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+        if (features & (1u << i)) {
+            lines += "#define ";
+            lines += FEATURE_DEFINES[i];
+            lines += '\n';
+        }
+    }
+    return lines;
+}
+
+Shader& ShaderVariants::get(unsigned int features)
+{
+    return *variant(features).shader;
+}
+
+ShaderVariants::Variant& ShaderVariants::variant(unsigned int features)
+{
+    features |= m_globalFeatures;
+    auto found = m_variants.find(features);
+    if (found != m_variants.end())
+        return found->second;
+
+    Variant& created = m_variants[features];
+    created.shader = std::make_unique<Shader>(m_vertexPath, m_fragmentPath, defines(features));
+    initialize(created);
+    return created;
+}
+
+// sets up a newly compiled (or reloaded) program
+void ShaderVariants::initialize(Variant& variant)
+{
+    Shader& shader = *variant.shader;
+    GLuint frameBlock = glGetUniformBlockIndex(shader.ID, "Frame");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader.ID, frameBlock, FrameUniformBuffer::BINDING);
+    GLuint objectBlock = glGetUniformBlockIndex(shader.ID, "Object");
+    if (objectBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader.ID, objectBlock, ObjectUniformBuffer::BINDING);
+    if (m_onCreate)
+        m_onCreate(shader);
+}
+
+void ShaderVariants::enableHotReload()
+{
+    m_watcher = std::make_unique<FileWatcher>();
+    m_watcher->watch(m_vertexPath);
+    m_watcher->watch(m_fragmentPath);
+}
+
+void ShaderVariants::update()
+{
+    if (!m_watcher)
+        return;
+
+    // all the variants share the sources, so any change reloads all of them
+    if (!m_watcher->poll().empty()) {
+        std::cout << "Reloading " << m_variants.size() << " variants of " << m_fragmentPath << std::endl;
+        for (auto& variant : m_variants)
+            variant.second.shader->reload();
+    }
+    for (auto& variant : m_variants)
+        if (variant.second.shader->update())
+            initialize(variant.second);
+}
+
+void ShaderVariants::setModel(const glm::mat4& model)
+{
+    if (m_objects)
+        m_objects->update(model);
+}
+
+Shader& ShaderVariants::use(unsigned int features)
+{
+    Variant& used = variant(features);
+    used.shader->use();
+    return *used.shader;
+}
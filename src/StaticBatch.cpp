@@ -0,0 +1,148 @@
+#include "StaticBatch.h"
+
+void StaticBatch::add(const Model& model, const glm::mat4& modelMatrix)
+{
+    // normals, tangents and bitangents go through the normal matrix, same as in the vertex shader
+    glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(modelMatrix)));
+    glm::mat3 tangentMatrix = glm::mat3(modelMatrix);
+    BoundingSphere bounds = model.bounds.transformed(modelMatrix);
+    // the groups this object was added to, with the first of its indices in each
+    std::map<Group*, unsigned int> touched;
+
+    for (const Mesh& mesh : model.meshes) {
+        std::vector<unsigned int> key;
+        if (m_table != nullptr) {
+            key.push_back(m_table->getGroup(mesh.tableMaterial));
+        }
+        else {
+            key.reserve(mesh.textures.size());
+            for (const Texture& texture : mesh.textures)
+                key.push_back(texture.id);
+        }
+
+        Group& group = m_groups[key];
+        if (group.vertices.empty()) {
+            group.textures = mesh.textures;
+            group.tableGroup = key.empty() ? 0 : key[0];
+        }
+        // the meshes of one object land next to each other in a group, nothing else is added in between
+        touched.emplace(&group, static_cast<unsigned int>(group.indices.size()));
+
+        unsigned int base = static_cast<unsigned int>(group.vertices.size());
+        group.vertices.reserve(group.vertices.size() + mesh.vertices.size());
+        for (const Vertex& vertex : mesh.vertices) {
+            Vertex baked = vertex;
+            baked.Position = glm::vec3(modelMatrix * glm::vec4(vertex.Position, 1.0f));
+            baked.Normal = glm::normalize(normalMatrix * vertex.Normal);
+            baked.Tangent = tangentMatrix * vertex.Tangent;
+            baked.Bitangent = tangentMatrix * vertex.Bitangent;
+            group.vertices.push_back(baked);
+        }
+        group.materials.insert(group.materials.end(), mesh.vertices.size(), mesh.tableMaterial);
+
+        group.indices.reserve(group.indices.size() + mesh.indices.size());
+        for (unsigned int index : mesh.indices)
+            group.indices.push_back(base + index);
+    }
+
+    for (auto& entry : touched) {
+        Instance instance;
+        instance.firstIndex = entry.second;
+        instance.indexCount = static_cast<unsigned int>(entry.first->indices.size()) - entry.second;
+        instance.bounds = bounds;
+        entry.first->instances.push_back(instance);
+    }
+}
+
+void StaticBatch::build()
+{
+    m_batches.reserve(m_batches.size() + m_groups.size());
+    for (auto& entry : m_groups) {
+        Group& group = entry.second;
+        if (group.indices.empty())
+            continue;
+
+        Batch batch;
+        batch.range = m_arena->append(group.vertices, group.indices, group.materials);
+        batch.textures = std::move(group.textures);
+        batch.tableGroup = group.tableGroup;
+        batch.firstInstance = m_instances.size();
+        batch.instanceCount = group.instances.size();
+        for (Instance& instance : group.instances) {
+            instance.firstIndex += batch.range.firstIndex;
+            instance.baseVertex = batch.range.baseVertex;
+            m_instances.push_back(instance);
+        }
+        m_batches.push_back(std::move(batch));
+    }
+    m_groups.clear();
+    m_arena->upload();
+}
+
+void StaticBatch::Draw(Shader& shader)
+{
+    shader.setMat4("model", glm::mat4(1.0f));
+    m_arena->bind();
+    for (Batch& batch : m_batches) {
+        if (m_table != nullptr)
+            m_table->bind(batch.tableGroup);
+        else
+            BindMaterialTextures(batch.textures, shader);
+        glDrawElementsBaseVertex(GL_TRIANGLES, batch.range.indexCount, GL_UNSIGNED_INT, (void*)(batch.range.firstIndex * sizeof(unsigned int)), batch.range.baseVertex);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void StaticBatch::Draw(ShaderVariants& shaders, const OcclusionCuller* culler)
+{
+    shaders.setModel(glm::mat4(1.0f));
+    m_arena->bind();
+    for (Batch& batch : m_batches) {
+        if (culler != nullptr) {
+            m_depthCounts.clear();
+            m_depthOffsets.clear();
+            m_depthBaseVertices.clear();
+            for (size_t i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++) {
+                const Instance& instance = m_instances[i];
+                if (!culler->isVisible(instance.bounds))
+                    continue;
+                m_depthCounts.push_back(static_cast<GLsizei>(instance.indexCount));
+                m_depthOffsets.push_back((const void*)(instance.firstIndex * sizeof(unsigned int)));
+                m_depthBaseVertices.push_back(instance.baseVertex);
+            }
+            if (m_depthCounts.empty())
+                continue;
+        }
+        if (m_table != nullptr) {
+            shaders.use(m_table->getFeatures(batch.tableGroup));
+            m_table->bind(batch.tableGroup);
+        }
+        else
+            BindMaterialTextures(batch.textures, shaders.use(0));
+        if (culler != nullptr)
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_depthCounts.data(), GL_UNSIGNED_INT, m_depthOffsets.data(), static_cast<GLsizei>(m_depthCounts.size()), m_depthBaseVertices.data());
+        else
+            glDrawElementsBaseVertex(GL_TRIANGLES, batch.range.indexCount, GL_UNSIGNED_INT, (void*)(batch.range.firstIndex * sizeof(unsigned int)), batch.range.baseVertex);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void StaticBatch::DrawDepth(CascadedShadowMap& shadows, int cascade)
+{
+    m_depthCounts.clear();
+    m_depthOffsets.clear();
+    m_depthBaseVertices.clear();
+    for (const Instance& instance : m_instances) {
+        if (!shadows.isVisible(cascade, instance.bounds))
+            continue;
+        m_depthCounts.push_back(static_cast<GLsizei>(instance.indexCount));
+        m_depthOffsets.push_back((const void*)(instance.firstIndex * sizeof(unsigned int)));
+        m_depthBaseVertices.push_back(instance.baseVertex);
+    }
+    if (m_depthCounts.empty())
+        return;
+
+    shadows.setModel(glm::mat4(1.0f));
+    m_arena->bindDepth();
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_depthCounts.data(), GL_UNSIGNED_INT, m_depthOffsets.data(), static_cast<GLsizei>(m_depthCounts.size()), m_depthBaseVertices.data());
+}
@@ -0,0 +1,191 @@
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // how long beginFrame() waits for a fence before it says so, in nanoseconds
+    const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+    bool isSignaled(GLenum result)
+    {
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+
+    // glBufferStorage comes with OpenGL 4.4 or ARB_buffer_storage, and is only in a glad loader
+    // generated with one of them. Without it the ring is always written with glBufferSubData
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAM_BUFFER_STORAGE
+    bool hasBufferStorage()
+    {
+        bool supported = false;
+#ifdef GL_VERSION_4_4
+        supported = supported || GLAD_GL_VERSION_4_4;
+#endif
+#ifdef GL_ARB_buffer_storage
+        supported = supported || GLAD_GL_ARB_buffer_storage;
+#endif
+        return supported;
+    }
+#endif
+}
+
+StreamSettings StreamSettings::load(const Settings& settings)
+{
+    StreamSettings stream;
+    stream.persistent = settings.getBool("stream.persistent", stream.persistent);
+    int kilobytes = settings.getInt("stream.partition_kb", static_cast<int>(stream.partitionSize / 1024));
+    stream.partitionSize = static_cast<size_t>(std::max(kilobytes, 64)) * 1024;
+    return stream;
+}
+
+StreamBuffer::StreamBuffer(const StreamSettings& settings) :
+    m_persistent(settings.persistent)
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_uniformAlignment = std::max<size_t>(static_cast<size_t>(alignment), 16);
+    create(settings.partitionSize);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync& fence : m_fences)
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    for (Retired& retired : m_retired) {
+        if (retired.fence != nullptr)
+            glDeleteSync(retired.fence);
+        glDeleteBuffers(1, &retired.buffer);
+    }
+    // deleting a mapped buffer unmaps it
+    glDeleteBuffers(1, &m_buffer);
+}
+
+// the storage is immutable with ARB_buffer_storage, so the buffer can stay mapped while the
+// GPU reads it. It is coherent: the writes need no flush
+void StreamBuffer::create(size_t partitionSize)
+{
+    m_partitionSize = partitionSize;
+    m_partition = 0;
+    m_offset = 0;
+    m_mapped = nullptr;
+    size_t size = m_partitionSize * PARTITIONS;
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    bool immutable = false;
+#ifdef STREAM_BUFFER_STORAGE
+    if (m_persistent && hasBufferStorage()) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags | GL_DYNAMIC_STORAGE_BIT);
+        m_mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        if (m_mapped == nullptr)
+            std::cout << "ERROR::STREAM:: could not map the stream buffer, it is written with glBufferSubData" << std::endl;
+        immutable = true;
+    }
+#endif
+    if (!immutable)
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    // a buffer the ring grows into is written the same way as the first one
+    m_persistent = m_mapped != nullptr;
+}
+
+// the buffer of the frame cannot be resized while it is mapped or read, so it is retired
+// and a bigger one takes its place, starting with a free partition
+void StreamBuffer::grow(size_t needed)
+{
+    for (GLsync& fence : m_fences) {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    m_retired.push_back({ m_buffer, nullptr });
+    m_retiring++;
+    create(std::max(2 * m_partitionSize, needed));
+}
+
+void StreamBuffer::beginFrame()
+{
+    // the buffers the ring grew out of go once the frames that read them are done
+    for (size_t i = 0; i < m_retired.size();) {
+        Retired& retired = m_retired[i];
+        if (retired.fence != nullptr && isSignaled(glClientWaitSync(retired.fence, 0, 0))) {
+            glDeleteSync(retired.fence);
+            glDeleteBuffers(1, &retired.buffer);
+            m_retired.erase(m_retired.begin() + i);
+        }
+        else
+            i++;
+    }
+
+    m_partition = (m_partition + 1) % PARTITIONS;
+    m_offset = 0;
+    m_frameBytes = 0;
+    GLsync& fence = m_fences[m_partition];
+    if (fence == nullptr)
+        return;
+
+    // the GPU is still reading the frame before last but one: the CPU is far enough ahead
+    if (!isSignaled(glClientWaitSync(fence, 0, 0))) {
+        m_waits++;
+        bool reported = false;
+        for (;;) {
+            GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+            if (isSignaled(result))
+                break;
+            if (result == GL_WAIT_FAILED) {
+                std::cout << "ERROR::STREAM:: waiting for a fence failed" << std::endl;
+                break;
+            }
+            // the partition must not be overwritten while the GPU reads it, so the wait goes on
+            if (!reported) {
+                std::cout << "ERROR::STREAM:: the GPU has not finished a frame in a second, still waiting" << std::endl;
+                reported = true;
+            }
+        }
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void StreamBuffer::endFrame()
+{
+    m_fences[m_partition] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    for (size_t i = m_retired.size() - m_retiring; i < m_retired.size(); i++)
+        m_retired[i].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_retiring = 0;
+
+    m_lastFrameBytes = m_frameBytes;
+    m_peakBytes = std::max(m_peakBytes, m_frameBytes);
+}
+
+StreamRange StreamBuffer::write(const void* data, size_t size, size_t alignment)
+{
+    StreamRange range;
+    if (size == 0) {
+        range.buffer = m_buffer;
+        range.offset = static_cast<size_t>(m_partition) * m_partitionSize;
+        return range;
+    }
+
+    size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+    if (offset + size > m_partitionSize) {
+        grow(size);
+        offset = 0;
+    }
+    m_offset = offset + size;
+    m_frameBytes += size;
+
+    range.buffer = m_buffer;
+    range.offset = static_cast<size_t>(m_partition) * m_partitionSize + offset;
+    range.size = size;
+    if (m_persistent)
+        std::memcpy(m_mapped + range.offset, data, size);
+    else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, size, data);
+    }
+    return range;
+}
@@ -0,0 +1,144 @@
+#include <Systems.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Systems {
+
+    void follow(Ecs::Registry& registry) {
+        registry.each<Transform, Follower>([](Ecs::Entity, Transform& transform, Follower& follower) {
+            transform.position = follower.flock->getPosition(follower.bird);
+            if (glm::length(follower.flock->getVelocity(follower.bird)) > 1e-3f)
+                transform.yaw = follower.flock->getHeading(follower.bird);
+            transform.dirty = true;
+        });
+    }
+
+    // every entity only writes its own Transform and Orbit, so the chunks go to all the cores
+    void orbit(Ecs::Registry& registry, float deltaTime) {
+        registry.eachParallel<Transform, Orbit>([deltaTime](Ecs::Entity, Transform& transform, Orbit& orbit) {
+            orbit.angle = std::fmod(orbit.angle + orbit.speed * deltaTime, 6.2831853f);
+            transform.position = glm::vec3(glm::sin(orbit.angle), 0.0f, glm::cos(orbit.angle)) * orbit.radius;
+            transform.dirty = true;
+        }, Ecs::maskOf<Static>());
+    }
+
+    void collectLights(Ecs::Registry& registry, LightClusters& lights) {
+        registry.each<Transform, PointLight>([&lights](Ecs::Entity, Transform& transform, PointLight& light) {
+            lights.add(glm::vec3(transform.matrix * glm::vec4(light.offset, 1.0f)), light.radius, light.color);
+        });
+    }
+}
+
+// the entities that are not static, breadth first: the roots, then their children, then
+// theirs. The children of every entity are linked through first child and next sibling
+void TransformHierarchy::build(Ecs::Registry& registry)
+{
+    m_entities.clear();
+    registry.each<Transform>([this](Ecs::Entity entity, Transform&) {
+        m_entities.push_back(entity);
+    }, Ecs::maskOf<Static>());
+
+    unsigned int count = static_cast<unsigned int>(m_entities.size());
+    unsigned int indices = 0;
+    for (Ecs::Entity entity : m_entities)
+        indices = std::max(indices, entity.index + 1);
+    m_slotOfIndex.assign(indices, NO_PARENT);
+    for (unsigned int slot = 0; slot < count; slot++)
+        m_slotOfIndex[m_entities[slot].index] = slot;
+
+    // an entity whose parent is gone, or static, is a root. Going backwards keeps the
+    // siblings in the order of the registry
+    m_firstChild.assign(count, NO_PARENT);
+    m_nextSibling.assign(count, NO_PARENT);
+    m_order.clear();
+    for (unsigned int slot = count; slot-- > 0;) {
+        const Parent* parent = registry.get<Parent>(m_entities[slot]);
+        unsigned int parentSlot = NO_PARENT;
+        if (parent != nullptr && registry.isAlive(parent->entity) && parent->entity.index < indices)
+            parentSlot = m_slotOfIndex[parent->entity.index];
+        if (parentSlot == NO_PARENT || parentSlot == slot) {
+            m_order.push_back(slot);
+            continue;
+        }
+        m_nextSibling[slot] = m_firstChild[parentSlot];
+        m_firstChild[parentSlot] = slot;
+    }
+    std::reverse(m_order.begin(), m_order.end());
+    size_t roots = m_order.size();
+
+    // every node brings its children in after the nodes already there. Entities caught in a
+    // cycle of parents are never reached, and left out
+    m_nodeOfSlot.assign(count, NO_PARENT);
+    m_nodes.clear();
+    for (unsigned int head = 0; head < m_order.size(); head++) {
+        unsigned int slot = m_order[head];
+        m_nodeOfSlot[slot] = head;
+        unsigned int parentNode = NO_PARENT;
+        if (head >= roots)
+            parentNode = m_nodeOfSlot[m_slotOfIndex[registry.get<Parent>(m_entities[slot])->entity.index]];
+        m_nodes.push_back({ registry.get<Transform>(m_entities[slot]), parentNode });
+        for (unsigned int child = m_firstChild[slot]; child != NO_PARENT; child = m_nextSibling[child])
+            m_order.push_back(child);
+    }
+
+    m_changed.assign(m_nodes.size(), 0);
+    m_version = registry.getVersion();
+    m_built = true;
+}
+
+void TransformHierarchy::update(Ecs::Registry& registry)
+{
+    // an entity may have lost its parent, so after a build every matrix is computed again
+    bool rebuilt = !m_built || m_version != registry.getVersion();
+    if (rebuilt)
+        build(registry);
+
+    // a parent always comes before its children, so its matrix is final when they need it
+    m_updated = 0;
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        Node& node = m_nodes[i];
+        bool moved = node.parent != NO_PARENT && m_changed[node.parent];
+        if (!rebuilt && !node.transform->dirty && !moved) {
+            m_changed[i] = 0;
+            continue;
+        }
+        if (node.parent == NO_PARENT)
+            node.transform->matrix = node.transform->local();
+        else
+            node.transform->matrix = m_nodes[node.parent].transform->matrix * node.transform->local();
+        node.transform->dirty = false;
+        m_changed[i] = 1;
+        m_updated++;
+    }
+}
+
+unsigned int RenderSystem::load(const std::string& path, MaterialTable* table) {
+    for (unsigned int i = 0; i < m_paths.size(); i++) {
+        if (m_paths[i] == path)
+            return i;
+    }
+    m_models.push_back(std::make_unique<Model>(path, false, nullptr, table));
+    m_paths.push_back(path);
+    return static_cast<unsigned int>(m_models.size() - 1);
+}
+
+void RenderSystem::render(Ecs::Registry& registry, ShaderVariants& shaders, const OcclusionCuller* culler) {
+    registry.each<Transform, Renderable>([this, &shaders, culler](Ecs::Entity, Transform& transform, Renderable& renderable) {
+        Model& model = *m_models[renderable.model];
+        if (culler != nullptr && !culler->isVisible(model.bounds.transformed(transform.matrix)))
+            return;
+        shaders.setModel(transform.matrix);
+        model.Draw(shaders);
+    });
+}
+
+void RenderSystem::renderShadow(Ecs::Registry& registry, CascadedShadowMap& shadows, int cascade) {
+    registry.each<Transform, Renderable>([this, &shadows, cascade](Ecs::Entity, Transform& transform, Renderable& renderable) {
+        Model& model = *m_models[renderable.model];
+        if (!renderable.castsShadow || !shadows.isVisible(cascade, model.bounds.transformed(transform.matrix)))
+            return;
+        shadows.setModel(transform.matrix);
+        model.DrawDepth();
+    });
+}
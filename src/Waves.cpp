@@ -0,0 +1,198 @@
+#include "Waves.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WAVES_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const float PI = 3.14159265f;
+    const float GRAVITY = 9.81f;
+
+    // fixed-point steps from the point asked for back to the point of the flat sea
+    // that the waves move there. With waves this far from breaking, three get within
+    // a few millimetres
+    const int ITERATIONS = 3;
+
+    float smoothstep(float edge0, float edge1, float x) {
+        float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+#ifdef WAVES_SSE2
+    // sine and cosine of four angles: the angles are reduced to [-pi/4, pi/4] around the
+    // nearest multiple of pi/2, and the quadrant picks the polynomial and the sign
+    void sincos4(__m128 x, __m128& sine, __m128& cosine) {
+        const __m128 twoOverPi = _mm_set1_ps(0.636619772f);
+        const __m128 piOver2High = _mm_set1_ps(1.5703125f);
+        const __m128 piOver2Low = _mm_set1_ps(4.83826794897e-4f);
+
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, twoOverPi));
+        __m128 q = _mm_cvtepi32_ps(quadrant);
+        __m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(q, piOver2High)), _mm_mul_ps(q, piOver2Low));
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 s = _mm_add_ps(_mm_set1_ps(8.3333333e-3f), _mm_mul_ps(r2, _mm_set1_ps(-1.9841270e-4f)));
+        s = _mm_add_ps(_mm_set1_ps(-1.6666667e-1f), _mm_mul_ps(r2, s));
+        s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+        __m128 c = _mm_add_ps(_mm_set1_ps(4.1666667e-2f), _mm_mul_ps(r2, _mm_set1_ps(-1.3888889e-3f)));
+        c = _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(r2, c));
+        c = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, c));
+
+        // odd quadrants swap sine and cosine
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 sinePart = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+        __m128 cosinePart = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+        // the sine is negative in quadrants 2 and 3, the cosine in 1 and 2
+        __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+        __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        sine = _mm_xor_ps(sinePart, sineSign);
+        cosine = _mm_xor_ps(cosinePart, cosineSign);
+    }
+
+    __m128 smoothstep4(__m128 edge0, __m128 edge1, __m128 x) {
+        __m128 t = _mm_div_ps(_mm_sub_ps(x, edge0), _mm_sub_ps(edge1, edge0));
+        t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t)));
+    }
+#endif
+}
+
+void Waves::update(float time, const glm::vec2& viewer)
+{
+    m_time = time;
+    m_viewer = viewer;
+    m_terms.clear();
+    for (const GerstnerWave& wave : m_waves) {
+        Term term;
+        term.directionX = wave.direction.x;
+        term.directionZ = wave.direction.y;
+        term.k = 2.0f * PI / wave.wavelength;
+        term.phase = term.k * std::sqrt(GRAVITY / term.k) * time;
+        term.steepness = wave.steepness;
+        term.fadeStart = 20.0f * wave.wavelength;
+        term.fadeEnd = 40.0f * wave.wavelength;
+        m_terms.push_back(term);
+    }
+}
+
+// The same sum as vShaderOcean.txt
+WaveSample Waves::sample(float x, float z) const
+{
+    float px = x;
+    float pz = z;
+    for (int i = 0; i < ITERATIONS; i++) {
+        float distance = std::hypot(px - m_viewer.x, pz - m_viewer.y);
+        float dx = 0.0f;
+        float dz = 0.0f;
+        for (const Term& term : m_terms) {
+            float steepness = term.steepness * (1.0f - smoothstep(term.fadeStart, term.fadeEnd, distance));
+            float f = term.k * (term.directionX * px + term.directionZ * pz) - term.phase;
+            float offset = steepness / term.k * std::cos(f);
+            dx += term.directionX * offset;
+            dz += term.directionZ * offset;
+        }
+        px = x - dx;
+        pz = z - dz;
+    }
+
+    float distance = std::hypot(px - m_viewer.x, pz - m_viewer.y);
+    WaveSample result;
+    glm::vec3 tangent(1.0f, 0.0f, 0.0f);
+    glm::vec3 binormal(0.0f, 0.0f, 1.0f);
+    for (const Term& term : m_terms) {
+        float steepness = term.steepness * (1.0f - smoothstep(term.fadeStart, term.fadeEnd, distance));
+        float f = term.k * (term.directionX * px + term.directionZ * pz) - term.phase;
+        float c = std::cos(f);
+        float s = std::sin(f);
+        result.height += steepness / term.k * s;
+        tangent += glm::vec3(-term.directionX * term.directionX * steepness * s, term.directionX * steepness * c, -term.directionX * term.directionZ * steepness * s);
+        binormal += glm::vec3(-term.directionX * term.directionZ * steepness * s, term.directionZ * steepness * c, -term.directionZ * term.directionZ * steepness * s);
+    }
+    result.normal = glm::normalize(glm::cross(binormal, tangent));
+    return result;
+}
+
+void Waves::sample(const float* x, const float* z, size_t count, float* heights, glm::vec3* normals) const
+{
+    size_t i = 0;
+#ifdef WAVES_SSE2
+    const __m128 viewerX = _mm_set1_ps(m_viewer.x);
+    const __m128 viewerZ = _mm_set1_ps(m_viewer.y);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128 targetX = _mm_loadu_ps(x + i);
+        const __m128 targetZ = _mm_loadu_ps(z + i);
+        __m128 px = targetX;
+        __m128 pz = targetZ;
+        __m128 sine, cosine;
+
+        for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+            __m128 vx = _mm_sub_ps(px, viewerX);
+            __m128 vz = _mm_sub_ps(pz, viewerZ);
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz)));
+            __m128 dx = _mm_setzero_ps();
+            __m128 dz = _mm_setzero_ps();
+            for (const Term& term : m_terms) {
+                __m128 directionX = _mm_set1_ps(term.directionX);
+                __m128 directionZ = _mm_set1_ps(term.directionZ);
+                __m128 fade = _mm_sub_ps(one, smoothstep4(_mm_set1_ps(term.fadeStart), _mm_set1_ps(term.fadeEnd), distance));
+                __m128 amplitude = _mm_mul_ps(_mm_set1_ps(term.steepness / term.k), fade);
+                __m128 f = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(term.k), _mm_add_ps(_mm_mul_ps(directionX, px), _mm_mul_ps(directionZ, pz))), _mm_set1_ps(term.phase));
+                sincos4(f, sine, cosine);
+                __m128 offset = _mm_mul_ps(amplitude, cosine);
+                dx = _mm_add_ps(dx, _mm_mul_ps(directionX, offset));
+                dz = _mm_add_ps(dz, _mm_mul_ps(directionZ, offset));
+            }
+            px = _mm_sub_ps(targetX, dx);
+            pz = _mm_sub_ps(targetZ, dz);
+        }
+
+        __m128 vx = _mm_sub_ps(px, viewerX);
+        __m128 vz = _mm_sub_ps(pz, viewerZ);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz)));
+        __m128 height = _mm_setzero_ps();
+        __m128 tangentX = one, tangentY = _mm_setzero_ps(), tangentZ = _mm_setzero_ps();
+        __m128 binormalX = _mm_setzero_ps(), binormalY = _mm_setzero_ps(), binormalZ = one;
+        for (const Term& term : m_terms) {
+            __m128 directionX = _mm_set1_ps(term.directionX);
+            __m128 directionZ = _mm_set1_ps(term.directionZ);
+            __m128 steepness = _mm_mul_ps(_mm_set1_ps(term.steepness), _mm_sub_ps(one, smoothstep4(_mm_set1_ps(term.fadeStart), _mm_set1_ps(term.fadeEnd), distance)));
+            __m128 f = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(term.k), _mm_add_ps(_mm_mul_ps(directionX, px), _mm_mul_ps(directionZ, pz))), _mm_set1_ps(term.phase));
+            sincos4(f, sine, cosine);
+            height = _mm_add_ps(height, _mm_mul_ps(_mm_mul_ps(steepness, _mm_set1_ps(1.0f / term.k)), sine));
+            if (normals) {
+                __m128 steepSine = _mm_mul_ps(steepness, sine);
+                __m128 steepCosine = _mm_mul_ps(steepness, cosine);
+                __m128 xz = _mm_mul_ps(directionX, directionZ);
+                tangentX = _mm_sub_ps(tangentX, _mm_mul_ps(_mm_mul_ps(directionX, directionX), steepSine));
+                tangentY = _mm_add_ps(tangentY, _mm_mul_ps(directionX, steepCosine));
+                tangentZ = _mm_sub_ps(tangentZ, _mm_mul_ps(xz, steepSine));
+                binormalX = _mm_sub_ps(binormalX, _mm_mul_ps(xz, steepSine));
+                binormalY = _mm_add_ps(binormalY, _mm_mul_ps(directionZ, steepCosine));
+                binormalZ = _mm_sub_ps(binormalZ, _mm_mul_ps(_mm_mul_ps(directionZ, directionZ), steepSine));
+            }
+        }
+        _mm_storeu_ps(heights + i, height);
+
+        if (normals) {
+            float t[3][4], b[3][4];
+            _mm_storeu_ps(t[0], tangentX); _mm_storeu_ps(t[1], tangentY); _mm_storeu_ps(t[2], tangentZ);
+            _mm_storeu_ps(b[0], binormalX); _mm_storeu_ps(b[1], binormalY); _mm_storeu_ps(b[2], binormalZ);
+            for (int lane = 0; lane < 4; lane++)
+                normals[i + lane] = glm::normalize(glm::cross(glm::vec3(b[0][lane], b[1][lane], b[2][lane]), glm::vec3(t[0][lane], t[1][lane], t[2][lane])));
+        }
+    }
+#endif
+    // what does not fill four lanes, or everything without SSE2
+    for (; i < count; i++) {
+        WaveSample result = sample(x[i], z[i]);
+        heights[i] = result.height;
+        if (normals)
+            normals[i] = result.normal;
+    }
+}
@@ -0,0 +1,511 @@
+#include "WorldStreamer.h"
+
+#include <FileSystem.h>
+#include <Memory.h>
+#include <GameObject.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace {
+    const size_t MEGABYTE = 1024 * 1024;
+
+    // the bytes a model takes on the CPU: the vertices and indices of its meshes
+    size_t modelBytes(const Model& model)
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : model.meshes)
+            bytes += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(unsigned int);
+        return bytes;
+    }
+
+    // the bytes one instance of a model takes once baked: the vertices, their materials and
+    // their positions for the depth passes (see GeometryArena), and the indices
+    size_t bakedBytes(const Model& model)
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : model.meshes)
+            bytes += mesh.vertices.size() * (sizeof(Vertex) + sizeof(unsigned int) + sizeof(glm::vec3)) + mesh.indices.size() * sizeof(unsigned int);
+        return bytes;
+    }
+}
+
+WorldSettings WorldSettings::load(const Settings& settings)
+{
+    WorldSettings world;
+    world.tileSize = std::max(settings.getFloat("world.tile_size", world.tileSize), 4.0f);
+    world.loadRadius = std::max(settings.getInt("world.load_radius", world.loadRadius), 0);
+    world.unloadRadius = std::max(settings.getInt("world.unload_radius", world.unloadRadius), world.loadRadius);
+    world.prefetch = std::max(settings.getInt("world.prefetch", world.prefetch), 0);
+    world.cpuBudget = static_cast<size_t>(std::max(settings.getInt("world.cpu_budget_mb", static_cast<int>(world.cpuBudget)), 1));
+    world.gpuBudget = static_cast<size_t>(std::max(settings.getInt("world.gpu_budget_mb", static_cast<int>(world.gpuBudget)), 1));
+    world.scatter = std::max(settings.getInt("world.scatter", world.scatter), 0);
+    world.clearRadius = std::max(settings.getFloat("world.clear_radius", world.clearRadius), 0.0f);
+    world.seed = static_cast<unsigned int>(settings.getInt("world.seed", static_cast<int>(world.seed)));
+    world.file = settings.getString("world.file", world.file);
+    return world;
+}
+
+void WorldMap::addIsland(const IslandPlacement& island)
+{
+    m_listed[tileOf(glm::vec2(island.position.x, island.position.z))].push_back(island);
+}
+
+bool WorldMap::load(const std::string& path)
+{
+    FileSystem::FileView file = FileSystem::vfs().open(path);
+    if (!file) {
+        std::cout << "ERROR::WORLD:: could not open " << path << std::endl;
+        return false;
+    }
+
+    std::istringstream lines(std::string(file.data(), file.size()));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        std::string kind;
+        IslandPlacement island;
+        if (!(words >> kind) || kind != "island")
+            continue;
+        if (words >> island.model >> island.position.x >> island.position.z) {
+            island.position.y = 0.0f;
+            addIsland(island);
+        }
+    }
+    return true;
+}
+
+TileCoord WorldMap::tileOf(const glm::vec2& position) const
+{
+    TileCoord tile;
+    tile.x = static_cast<int>(std::floor(position.x / m_settings.tileSize));
+    tile.z = static_cast<int>(std::floor(position.y / m_settings.tileSize));
+    return tile;
+}
+
+void WorldMap::islandsIn(const TileCoord& tile, std::vector<IslandPlacement>& islands) const
+{
+    auto listed = m_listed.find(tile);
+    if (listed != m_listed.end())
+        islands.insert(islands.end(), listed->second.begin(), listed->second.end());
+
+    if (m_settings.scatter == 0 || m_scatterModel.empty())
+        return;
+
+    // the same seed for the same tile, every time it is asked for
+    unsigned int hash = static_cast<unsigned int>(tile.x) * 73856093u ^ static_cast<unsigned int>(tile.z) * 83492791u ^ m_settings.seed * 19349663u;
+    std::mt19937 random(hash);
+    std::uniform_int_distribution<int> count(0, 2 * m_settings.scatter);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (int i = count(random); i > 0; i--) {
+        IslandPlacement island;
+        island.model = m_scatterModel;
+        island.position = glm::vec3((static_cast<float>(tile.x) + unit(random)) * m_settings.tileSize, 0.0f, (static_cast<float>(tile.z) + unit(random)) * m_settings.tileSize);
+        if (glm::length(glm::vec2(island.position.x, island.position.z)) >= m_settings.clearRadius)
+            islands.push_back(island);
+    }
+}
+
+std::vector<std::string> WorldMap::getModels() const
+{
+    std::set<std::string> models;
+    for (const auto& tile : m_listed)
+        for (const IslandPlacement& island : tile.second)
+            models.insert(island.model);
+    if (m_settings.scatter > 0 && !m_scatterModel.empty())
+        models.insert(m_scatterModel);
+    return std::vector<std::string>(models.begin(), models.end());
+}
+
+WorldStreamer::WorldStreamer(const WorldMap& map, const CollisionSettings& collision, MaterialTable* table, Ecs::Registry& registry) :
+    m_map(map),
+    m_registry(registry),
+    m_settings(map.getSettings()),
+    m_collisionSettings(collision),
+    m_table(table),
+    m_collision(collision)
+{
+    m_loader = std::thread(&WorldStreamer::loaderThread, this);
+}
+
+WorldStreamer::~WorldStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_loader.join();
+}
+
+void WorldStreamer::registerMaterials()
+{
+    // the model registers its materials while it loads, and is thrown away
+    for (const std::string& path : m_map.getModels()) {
+        ModelData data;
+        if (ModelImporter::import(path, data))
+            Model(SourceOnly{}, data, path, m_table);
+    }
+}
+
+// imports the models of the tiles, one tile at a time, and hands them back
+void WorldStreamer::loaderThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+        if (m_stop)
+            return;
+        LoadJob job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+
+        LoadedTile loaded;
+        loaded.tile = job.tile;
+        loaded.islands = std::move(job.islands);
+        for (const std::string& path : job.models) {
+            ModelData data;
+            std::shared_ptr<const Heightfield> heightfield;
+            std::shared_ptr<const OccluderMesh> occluder;
+            if (ModelImporter::import(path, data)) {
+                heightfield = std::make_shared<const Heightfield>(data, m_collisionSettings.resolution);
+                occluder = std::make_shared<const OccluderMesh>(*heightfield);
+            } else {
+                std::cout << "ERROR::WORLD:: could not load the island model " << path << std::endl;
+            }
+            loaded.models.push_back(path);
+            loaded.data.push_back(std::move(data));
+            loaded.heightfields.push_back(std::move(heightfield));
+            loaded.occluders.push_back(std::move(occluder));
+        }
+
+        lock.lock();
+        m_loaded.push_back(std::move(loaded));
+        m_done.notify_all();
+    }
+}
+
+std::vector<std::string> WorldStreamer::distinctModels(const std::vector<IslandPlacement>& islands)
+{
+    std::vector<std::string> models;
+    for (const IslandPlacement& island : islands)
+        if (std::find(models.begin(), models.end(), island.model) == models.end())
+            models.push_back(island.model);
+    return models;
+}
+
+// the cached models the tile uses are held on to while it loads, so they are not freed
+// in the meantime; the loader only imports the others
+void WorldStreamer::request(const TileCoord& tile, std::vector<IslandPlacement>&& islands)
+{
+    LoadJob job;
+    job.tile = tile;
+    PendingTile& pending = m_pending[tile];
+    for (const std::string& model : distinctModels(islands)) {
+        auto cached = m_models.find(model);
+        if (cached != m_models.end()) {
+            cached->second.users++;
+            pending.held.push_back(model);
+        } else {
+            job.models.push_back(model);
+        }
+    }
+    pending.importing = job.models;
+    job.islands = std::move(islands);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+}
+
+void WorldStreamer::release(const std::string& model)
+{
+    auto cached = m_models.find(model);
+    if (cached == m_models.end() || --cached->second.users > 0)
+        return;
+    m_cpuBytes -= m_costs[model].cpuBytes;
+    m_models.erase(cached);
+}
+
+void WorldStreamer::install(LoadedTile& loaded)
+{
+    std::vector<std::string> held = std::move(m_pending[loaded.tile].held);
+    m_pending.erase(loaded.tile);
+
+    // the models the loader imported, unless another tile brought them in first
+    for (size_t i = 0; i < loaded.models.size(); i++) {
+        const std::string& path = loaded.models[i];
+        auto cached = m_models.find(path);
+        if (cached != m_models.end()) {
+            cached->second.users++;
+            held.push_back(path);
+            continue;
+        }
+        if (!loaded.heightfields[i])
+            continue;
+        CachedModel& model = m_models[path];
+        // only the batches of the tiles and the heightfield read the model, so it stages nothing to draw
+        model.model = std::make_shared<Model>(SourceOnly{}, loaded.data[i], path, m_table);
+        model.heightfield = std::move(loaded.heightfields[i]);
+        model.occluder = std::move(loaded.occluders[i]);
+        model.users = 1;
+        held.push_back(path);
+
+        ModelCost& cost = m_costs[path];
+        cost.cpuBytes = modelBytes(*model.model) + model.heightfield->getByteSize() + model.occluder->getByteSize();
+        cost.bakedBytes = bakedBytes(*model.model);
+        m_cpuBytes += cost.cpuBytes;
+    }
+
+    Tile& tile = m_tiles[loaded.tile];
+    tile.models = std::move(held);
+    if (!loaded.islands.empty())
+        tile.batch = std::make_unique<StaticBatch>(std::make_shared<GeometryArena>(), m_table);
+    for (const IslandPlacement& placement : loaded.islands) {
+        auto cached = m_models.find(placement.model);
+        if (cached == m_models.end())
+            continue;
+        // the island is a static entity, placed once, with its harbour light; the batch and
+        // the collision world keep copies of its matrix
+        Transform transform = GameObject::islandTransform(placement.position);
+        tile.islands.push_back(m_registry.create(transform, Static{}, harbourLight(cached->second.model->bounds)));
+        tile.batch->add(*cached->second.model, transform.matrix);
+        tile.colliders.push_back(m_collision.add(cached->second.heightfield, transform.matrix));
+        tile.occluders.push_back({ cached->second.occluder, transform.matrix });
+        tile.gpuBytes += m_costs[placement.model].bakedBytes;
+    }
+    if (tile.batch)
+        tile.batch->build();
+    m_gpuBytes += tile.gpuBytes;
+    m_collisionDirty = true;
+}
+
+void WorldStreamer::unload(const TileCoord& coord)
+{
+    auto found = m_tiles.find(coord);
+    if (found == m_tiles.end())
+        return;
+    Tile& tile = found->second;
+    for (unsigned int collider : tile.colliders)
+        m_collision.remove(collider);
+    for (Ecs::Entity island : tile.islands)
+        m_registry.destroy(island);
+    for (const std::string& model : tile.models)
+        release(model);
+    m_gpuBytes -= tile.gpuBytes;
+    m_tiles.erase(found);
+    m_collisionDirty = true;
+}
+
+// installs the finished tiles that are still wanted; the others are dropped
+void WorldStreamer::collectLoaded()
+{
+    // the two queues are swapped, rather than a new one made, so this does not allocate
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_loaded.empty())
+            return;
+        m_collected.swap(m_loaded);
+    }
+    m_stale = true;
+    for (LoadedTile& tile : m_collected) {
+        if (m_wanted.count(tile.tile) != 0) {
+            install(tile);
+            continue;
+        }
+        for (const std::string& model : m_pending[tile.tile].held)
+            release(model);
+        m_pending.erase(tile.tile);
+    }
+    m_collected.clear();
+}
+
+void WorldStreamer::update(const glm::vec3& position, const glm::vec3& front)
+{
+    m_shipPosition = position;
+    m_shipFront = front;
+    collectLoaded();
+
+    // the temporaries of this update live in the frame arena
+    Memory::LinearArena& arena = Memory::frameArena();
+    using Ranked = std::pair<float, TileCoord>;
+
+    // the tiles ahead of the ship
+    glm::vec2 ship(position.x, position.z);
+    TileCoord center = m_map.tileOf(ship);
+    Memory::ArenaVector<TileCoord> ahead{ Memory::ArenaAllocator<TileCoord>(arena) };
+    glm::vec2 heading(front.x, front.z);
+    if (glm::length(heading) > 1e-4f) {
+        heading = glm::normalize(heading);
+        for (int k = 1; k <= m_settings.prefetch + m_settings.loadRadius; k++)
+            ahead.push_back(m_map.tileOf(ship + heading * m_settings.tileSize * static_cast<float>(k)));
+    }
+
+    // nothing changes while the ship stays over the same tiles and no tile is loading,
+    // which is most frames
+    if (!m_stale && m_pending.empty() && center == m_lastCenter && std::equal(ahead.begin(), ahead.end(), m_lastAhead.begin(), m_lastAhead.end()))
+        return;
+    m_stale = false;
+    m_lastCenter = center;
+    m_lastAhead.assign(ahead.begin(), ahead.end());
+
+    // the tiles around the ship, and the ones ahead of it, which come first: the ship is
+    // sailing into them. Each with the distance it is kept by
+    std::map<TileCoord, float, std::less<TileCoord>, Memory::ArenaAllocator<std::pair<const TileCoord, float>>> priorities{ Memory::ArenaAllocator<std::pair<const TileCoord, float>>(arena) };
+    auto want = [&](const TileCoord& tile, float priority) {
+        auto found = priorities.find(tile);
+        if (found == priorities.end() || priority < found->second)
+            priorities[tile] = priority;
+    };
+    for (int dz = -m_settings.loadRadius; dz <= m_settings.loadRadius; dz++)
+        for (int dx = -m_settings.loadRadius; dx <= m_settings.loadRadius; dx++) {
+            TileCoord tile{ center.x + dx, center.z + dz };
+            glm::vec2 middle((static_cast<float>(tile.x) + 0.5f) * m_settings.tileSize, (static_cast<float>(tile.z) + 0.5f) * m_settings.tileSize);
+            want(tile, glm::length(middle - ship));
+        }
+    want(center, 0.0f);
+    for (size_t k = 0; k < ahead.size(); k++)
+        want(ahead[k], 0.5f * m_settings.tileSize * static_cast<float>(k + 1));
+    Memory::ArenaVector<Ranked> ordered{ Memory::ArenaAllocator<Ranked>(arena) };
+    for (const auto& tile : priorities)
+        ordered.emplace_back(tile.second, tile.first);
+    std::sort(ordered.begin(), ordered.end(), [](const Ranked& a, const Ranked& b) { return a.first < b.first; });
+
+    // the budgets, nearest tile first. The tile of the ship is always kept, whatever it costs
+    size_t cpuBudget = m_settings.cpuBudget * MEGABYTE;
+    size_t gpuBudget = m_settings.gpuBudget * MEGABYTE;
+    size_t cpuUsed = 0, gpuUsed = 0;
+    std::set<std::string> counted;
+    auto fits = [&](const TileCoord& tile, const std::vector<IslandPlacement>& islands) {
+        size_t cpu = 0, gpu = 0;
+        auto resident = m_tiles.find(tile);
+        for (const IslandPlacement& island : islands) {
+            auto cost = m_costs.find(island.model);
+            if (cost == m_costs.end())
+                continue;
+            if (resident == m_tiles.end())
+                gpu += cost->second.bakedBytes;
+            if (counted.count(island.model) == 0)
+                cpu += cost->second.cpuBytes;
+        }
+        if (resident != m_tiles.end())
+            gpu = resident->second.gpuBytes;
+        if (!(tile == center) && (cpuUsed + cpu > cpuBudget || gpuUsed + gpu > gpuBudget))
+            return false;
+        cpuUsed += cpu;
+        gpuUsed += gpu;
+        for (const IslandPlacement& island : islands)
+            counted.insert(island.model);
+        return true;
+    };
+
+    m_wanted.clear();
+    using Request = std::pair<TileCoord, std::vector<IslandPlacement>>;
+    Memory::ArenaVector<Request> requests{ Memory::ArenaAllocator<Request>(arena) };
+    for (const auto& entry : ordered) {
+        std::vector<IslandPlacement> islands;
+        m_map.islandsIn(entry.second, islands);
+        if (!fits(entry.second, islands))
+            continue;
+        m_wanted.insert(entry.second);
+        if (m_tiles.count(entry.second) == 0 && m_pending.count(entry.second) == 0)
+            requests.emplace_back(entry.second, std::move(islands));
+    }
+
+    // the resident tiles no longer wanted stay while they are near and fit, so a ship going
+    // back and forth over a border does not load the same tiles again and again
+    Memory::ArenaVector<Ranked> leftBehind{ Memory::ArenaAllocator<Ranked>(arena) };
+    for (const auto& tile : m_tiles)
+        if (m_wanted.count(tile.first) == 0)
+            leftBehind.emplace_back(static_cast<float>(std::max(std::abs(tile.first.x - center.x), std::abs(tile.first.z - center.z))), tile.first);
+    std::sort(leftBehind.begin(), leftBehind.end(), [](const Ranked& a, const Ranked& b) { return a.first < b.first; });
+    for (const auto& entry : leftBehind) {
+        std::vector<IslandPlacement> islands;
+        m_map.islandsIn(entry.second, islands);
+        if (entry.first <= static_cast<float>(m_settings.unloadRadius) && fits(entry.second, islands))
+            m_wanted.insert(entry.second);
+        else
+            unload(entry.second);
+    }
+
+    // the queued tiles no longer wanted are not loaded at all
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto job = m_jobs.begin(); job != m_jobs.end();) {
+            if (m_wanted.count(job->tile) != 0) {
+                ++job;
+                continue;
+            }
+            for (const std::string& model : m_pending[job->tile].held)
+                release(model);
+            m_pending.erase(job->tile);
+            job = m_jobs.erase(job);
+        }
+    }
+
+    // a tile waits for the models another tile is already importing, so every model is
+    // imported once, and its cost is known before the tiles after it are budgeted
+    std::set<std::string> importing;
+    for (const auto& pending : m_pending)
+        for (const std::string& model : pending.second.importing)
+            importing.insert(model);
+    for (auto& entry : requests) {
+        bool waits = false;
+        for (const std::string& model : distinctModels(entry.second))
+            if (m_models.count(model) == 0 && !importing.insert(model).second)
+                waits = true;
+        if (!waits)
+            request(entry.first, std::move(entry.second));
+        else
+            m_stale = true;
+    }
+
+    if (m_collisionDirty) {
+        m_collision.build();
+        m_collisionDirty = false;
+    }
+}
+
+// the tiles waiting for a model are only asked for once it is in, so this goes on
+// until an update() asks for nothing more
+void WorldStreamer::finishLoading()
+{
+    for (;;) {
+        while (!m_pending.empty()) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this] { return !m_loaded.empty(); });
+            }
+            collectLoaded();
+        }
+        update(m_shipPosition, m_shipFront);
+        if (m_pending.empty())
+            break;
+    }
+}
+
+void WorldStreamer::Draw(ShaderVariants& shaders, const OcclusionCuller* culler)
+{
+    for (auto& tile : m_tiles)
+        if (tile.second.batch)
+            tile.second.batch->Draw(shaders, culler);
+}
+
+void WorldStreamer::DrawOccluders(OcclusionCuller& culler)
+{
+    for (auto& tile : m_tiles)
+        for (const Occluder& occluder : tile.second.occluders)
+            culler.addOccluder(*occluder.mesh, occluder.model);
+}
+
+void WorldStreamer::DrawDepth(CascadedShadowMap& shadows, int cascade)
+{
+    for (auto& tile : m_tiles)
+        if (tile.second.batch)
+            tile.second.batch->DrawDepth(shadows, cascade);
+}
@@ -0,0 +1,95 @@
+/*****************************************************************//**
+ * \file   AssetPacker.cpp
+ * \brief  Builds the asset pack the game loads at startup.
+ * Usage: AssetPacker <output.pack> <file or directory>...
+ * Run it from the directory the game runs in, so the paths stored in
+ * the pack are the ones the game asks for. Directories are added
+ * recursively. Models are imported with Assimp here, once, and stored
+ * as .mesh files, flattened and merged by material (see
+ * ModelImporter.h); textures and shaders are stored as they are.
+ *********************************************************************/
+#include <AssetPack.h>
+#include <FileSystem.h>
+#include <ModelImporter.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// the model formats that are imported ahead of time
+bool isModel(const fs::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".obj" || extension == ".fbx" || extension == ".dae" || extension == ".3ds" || extension == ".gltf" || extension == ".glb";
+}
+
+bool addFile(FileSystem::AssetPackWriter& pack, const fs::path& file)
+{
+    std::string path = FileSystem::Vfs::normalize(file.generic_string());
+
+    if (isModel(file)) {
+        ModelData model;
+        std::ostringstream mesh;
+        if (ModelImporter::importWithAssimp(path, model) && ModelImporter::writeMeshFile(model, mesh)) {
+            std::string data = mesh.str();
+            std::cout << "mesh    " << ModelImporter::meshFilePath(path) << std::endl;
+            return pack.add(ModelImporter::meshFilePath(path), data.data(), data.size());
+        }
+        std::cout << "WARNING::ASSET_PACKER:: cannot import " << path << ", storing it as is" << std::endl;
+    }
+
+    FileSystem::MappedFile mapped(file.string());
+    if (!mapped.isValid()) {
+        std::cout << "ERROR::ASSET_PACKER:: cannot read " << path << std::endl;
+        return false;
+    }
+    std::cout << "file    " << path << std::endl;
+    return pack.add(path, mapped.data(), mapped.size());
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::cout << "Usage: " << argv[0] << " <output.pack> <file or directory>..." << std::endl;
+        return 1;
+    }
+
+    // the importer reads through the Vfs, from the working directory
+    FileSystem::vfs().mount(std::make_shared<FileSystem::DirectoryMount>());
+
+    // gather the files first, sorted so that the same inputs always give the same pack
+    std::vector<fs::path> files;
+    for (int i = 2; i < argc; i++) {
+        fs::path input(argv[i]);
+        std::error_code error;
+        if (fs::is_directory(input, error)) {
+            for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input, error))
+                if (entry.is_regular_file())
+                    files.push_back(entry.path());
+        }
+        else if (fs::is_regular_file(input, error))
+            files.push_back(input);
+        else
+            std::cout << "WARNING::ASSET_PACKER:: " << input.string() << " does not exist" << std::endl;
+    }
+    std::sort(files.begin(), files.end());
+
+    FileSystem::AssetPackWriter pack(argv[1]);
+    bool ok = true;
+    for (const fs::path& file : files)
+        ok = addFile(pack, file) && ok;
+
+    if (!pack.finish()) {
+        std::cout << "ERROR::ASSET_PACKER:: cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << files.size() << " files packed into " << argv[1] << std::endl;
+    return ok ? 0 : 1;
+}